@@ -0,0 +1,300 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Poco/Exception.h"
+#include "Poco/Random.h"
+#include "Poco/Runnable.h"
+#include "Poco/SharedPtr.h"
+#include "Poco/Thread.h"
+#include "Poco/Timespan.h"
+#include "Poco/Timestamp.h"
+#include "Poco/Types.h"
+#include "Poco/URI.h"
+#include "Poco/Net/ServerSocket.h"
+#include "Poco/Net/SocketAddress.h"
+#include "pohessian/HessianTypes.h"
+#include "pohessian/HessianClient.h"
+#include "pohessian/HessianDispatcher.h"
+#include "pohessian/HessianServer.h"
+#include "pohessian/HessianTcpServer.h"
+#include "pohessian/HessianStatistics.h"
+
+using namespace std;
+using namespace Poco;
+using namespace Poco::Net;
+using namespace PoHessian;
+
+// Drives one HessianClient from several threads against a local server and
+// reports throughput, latency percentiles and bytes per call, per kind of
+// call and overall. Every call is an "echo" whose reply is its parameter:
+//
+//   scalar  one Integer
+//   list    a List of --list-size Integers
+//   binary  a Binary of --binary-size bytes
+//
+// Options, all --name=value:
+//
+//   --uri          server to call; when absent, one is started in process
+//   --transport    http or tcp, for the server started in process
+//   --concurrency  calling threads, 4 by default
+//   --duration     seconds measured, 10 by default
+//   --warmup       seconds run before measuring, 1 by default
+//   --mix          relative weights, "scalar=8,list=1,binary=1" by default
+//   --list-size    1000 by default
+//   --binary-size  65536 by default
+//   --compression  request bodies larger than this many bytes are sent
+//                  gzipped, 0 (never) by default
+
+enum CallKind {
+    CALL_SCALAR,
+    CALL_LIST,
+    CALL_BINARY,
+    CALL_KINDS
+};
+
+static const char* CALL_KIND_NAMES[CALL_KINDS] = {"scalar", "list", "binary"};
+
+static string option(int argc, char* argv[], const string& name, const string& fallback) {
+    string prefix = "--" + name + "=";
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg.compare(0, prefix.size(), prefix) == 0)
+            return arg.substr(prefix.size());
+    }
+    return fallback;
+}
+
+static int intOption(int argc, char* argv[], const string& name, const int fallback) {
+    ostringstream value;
+    value << fallback;
+    return atoi(option(argc, argv, name, value.str()).c_str());
+}
+
+// "scalar=8,list=1,binary=1"
+static vector<int> parseMix(const string& mix) {
+    vector<int> weights(CALL_KINDS, 0);
+    istringstream in(mix);
+    string entry;
+    while (getline(in, entry, ',')) {
+        string::size_type equals = entry.find('=');
+        string name = entry.substr(0, equals);
+        int weight = equals == string::npos ? 1 : atoi(entry.substr(equals + 1).c_str());
+        int kind = 0;
+        while (kind < CALL_KINDS && name != CALL_KIND_NAMES[kind])
+            kind++;
+        if (kind == CALL_KINDS)
+            throw Exception("Unknown call kind: " + name);
+        weights[kind] = weight;
+    }
+    int total = 0;
+    for (int kind = 0; kind < CALL_KINDS; kind++)
+        total += weights[kind];
+    if (total <= 0)
+        throw Exception("Empty call mix: " + mix);
+    return weights;
+}
+
+static ValuePtr echo(const CallPtr& call) {
+    const ParameterList& parameters = call->getParameters();
+    return parameters.empty() ? new Value() : parameters[0];
+}
+
+class Caller : public Runnable {
+public:
+
+    Caller(HessianClient& client, const vector<ParameterList>& parameters, const vector<int>& weights,
+            const Timestamp& measureFrom, const Timestamp& measureUntil, const UInt32 seed)
+    : histograms(CALL_KINDS),
+    errors(0),
+    _client(client),
+    _parameters(parameters),
+    _weights(weights),
+    _measureFrom(measureFrom),
+    _measureUntil(measureUntil),
+    _random() {
+        _random.seed(seed);
+    }
+
+    void run() {
+        int total = 0;
+        for (int kind = 0; kind < CALL_KINDS; kind++)
+            total += _weights[kind];
+        for (;;) {
+            Timestamp start;
+            if (start >= _measureUntil)
+                break;
+            int pick = (int) _random.next(total);
+            int kind = 0;
+            while (pick >= _weights[kind])
+                pick -= _weights[kind++];
+            try {
+                _client.call("echo", _parameters[kind]);
+            } catch (std::exception&) {
+                if (start >= _measureFrom)
+                    errors++;
+                continue;
+            }
+            if (start >= _measureFrom)
+                histograms[kind].record(Timespan(start.elapsed()));
+        }
+    }
+
+    vector<LatencyHistogram> histograms;
+    UInt64 errors;
+
+private:
+    HessianClient& _client;
+    const vector<ParameterList>& _parameters;
+    const vector<int>& _weights;
+    const Timestamp _measureFrom;
+    const Timestamp _measureUntil;
+    Random _random;
+};
+
+static void report(const string& name, const LatencyHistogram& histogram, const Timespan& duration) {
+    Int64 us = duration.totalMicroseconds();
+    cout << left << setw(8) << name << right
+            << setw(10) << histogram.getCount() << " calls"
+            << setw(10) << (us > 0 ? (Int64) histogram.getCount() * 1000000LL / us : 0) << " calls/s"
+            << "  p50 " << histogram.getPercentile(50.0).totalMicroseconds() << "us"
+            << "  p99 " << histogram.getPercentile(99.0).totalMicroseconds() << "us"
+            << "  p99.9 " << histogram.getPercentile(99.9).totalMicroseconds() << "us"
+            << "  max " << histogram.getMax().totalMicroseconds() << "us" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        string uri = option(argc, argv, "uri", "");
+        string transport = option(argc, argv, "transport", "http");
+        int concurrency = intOption(argc, argv, "concurrency", 4);
+        int duration = intOption(argc, argv, "duration", 10);
+        int warmup = intOption(argc, argv, "warmup", 1);
+        vector<int> weights = parseMix(option(argc, argv, "mix", "scalar=8,list=1,binary=1"));
+        int listSize = intOption(argc, argv, "list-size", 1000);
+        int binarySize = intOption(argc, argv, "binary-size", 65536);
+        int compression = intOption(argc, argv, "compression", 0);
+        if (concurrency < 1 || duration < 1 || warmup < 0 || listSize < 0 || binarySize < 0 || compression < 0)
+            throw Exception("Invalid option value");
+
+        SharedPtr<HessianDispatcher> dispatcher = new HessianDispatcher;
+        dispatcher->registerFunction("echo", echo);
+        SharedPtr<HessianServer> httpServer;
+        SharedPtr<HessianTcpServer> tcpServer;
+        if (uri.empty()) {
+            ServerSocket socket(SocketAddress("127.0.0.1", 0));
+            ostringstream local;
+            if (transport == "http") {
+                httpServer = new HessianServer(dispatcher, socket, concurrency, concurrency);
+                httpServer->start();
+                local << "http://127.0.0.1:" << httpServer->getPort() << "/bench";
+            } else if (transport == "tcp") {
+                tcpServer = new HessianTcpServer(dispatcher, socket);
+                tcpServer->start();
+                local << "tcp://127.0.0.1:" << tcpServer->getPort();
+            } else {
+                throw Exception("Unknown transport: " + transport);
+            }
+            uri = local.str();
+        }
+
+        vector<ParameterList> parameters(CALL_KINDS);
+        parameters[CALL_SCALAR].push_back(new Value((Int32) 47));
+        ValuePtr list = new Value(Value::TYPE_LIST);
+        list->reserve(listSize);
+        for (int i = 0; i < listSize; i++)
+            list->add(new Value((Int32) i));
+        parameters[CALL_LIST].push_back(list);
+        parameters[CALL_BINARY].push_back(new Value(string(binarySize, 'x'), Value::TYPE_BINARY));
+        // every Caller thread sends them, see Value::share()
+        for (vector<ParameterList>::iterator it = parameters.begin(); it != parameters.end(); it++)
+            for (ParameterList::iterator parameter = it->begin(); parameter != it->end(); parameter++)
+                (*parameter)->share();
+
+        HessianClient client(HessianClient::HESSIAN_VERSION_1, URI(uri));
+        client.setMaxIdleConnections(concurrency);
+        client.setCompressionThreshold(compression);
+        cout << uri << ", " << concurrency << " threads, " << warmup << "s warmup, " << duration << "s measured";
+        if (compression > 0)
+            cout << ", gzip past " << compression << " bytes";
+        cout << endl;
+
+        Timestamp measureFrom;
+        measureFrom += (Timestamp::TimeDiff) warmup * 1000000;
+        Timestamp measureUntil(measureFrom);
+        measureUntil += (Timestamp::TimeDiff) duration * 1000000;
+        vector<Caller*> callers;
+        vector<Thread*> threads;
+        for (int i = 0; i < concurrency; i++) {
+            callers.push_back(new Caller(client, parameters, weights, measureFrom, measureUntil, i + 1));
+            threads.push_back(new Thread);
+            threads.back()->start(*callers.back());
+        }
+        // byte counters are global to the client, sampled around the measured window
+        Timestamp::TimeDiff untilMeasured = measureFrom - Timestamp();
+        if (untilMeasured > 0)
+            Thread::sleep((long) (untilMeasured / 1000));
+        UInt64 sentFrom = client.getBytesSent();
+        UInt64 receivedFrom = client.getBytesReceived();
+        for (int i = 0; i < concurrency; i++)
+            threads[i]->join();
+        Timespan measured(measureUntil - measureFrom);
+        UInt64 bytes = client.getBytesSent() - sentFrom + client.getBytesReceived() - receivedFrom;
+
+        LatencyHistogram all;
+        UInt64 errors = 0;
+        for (int kind = 0; kind < CALL_KINDS; kind++) {
+            LatencyHistogram histogram;
+            for (int i = 0; i < concurrency; i++)
+                histogram.merge(callers[i]->histograms[kind]);
+            if (histogram.getCount() > 0)
+                report(CALL_KIND_NAMES[kind], histogram, measured);
+            all.merge(histogram);
+        }
+        for (int i = 0; i < concurrency; i++) {
+            errors += callers[i]->errors;
+            delete threads[i];
+            delete callers[i];
+        }
+        report("all", all, measured);
+        cout << "errors " << errors
+                << ", " << (all.getCount() > 0 ? bytes / all.getCount() : 0) << " bytes/call" << endl;
+
+        if (!tcpServer.isNull())
+            tcpServer->stop();
+        if (!httpServer.isNull())
+            httpServer->stop();
+        return errors == 0 ? 0 : -1;
+    } catch (Exception& e) {
+        cerr << e.displayText() << endl;
+        return -1;
+    }
+}
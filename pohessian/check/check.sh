@@ -0,0 +1,77 @@
+#!/bin/sh
+#
+# PoHessian
+# Portable C++ Hessian Implementation
+#
+# Copyright (C) 2012  Pierre-David Belanger
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# Runs pohessiancheck against a pohessiancheckserver on the loopback
+# interface, over HTTP and raw TCP, over unix domain sockets where Poco
+# supports them, over a shared memory channel on Linux and over HTTPS when
+# built with Poco NetSSL, then pohessianexample over HTTP. First runs every case of pohessiancodecbench for
+# the shortest time, so that the writer and each way of reading stay
+# exercised.
+
+if ! ./pohessiancodecbench --min-time=0 > /dev/null; then
+    echo "pohessiancodecbench failed"
+    exit 1
+fi
+
+ports=pohessiancheckserver.ports
+# unix domain socket paths are short, keep them out of the build tree
+sockets=${TMPDIR:-/tmp}/pohessiancheck.$$
+channel=pohessiancheck.$$
+# self-signed, for 127.0.0.1
+certificate=${srcdir:-.}/check/server.pem
+rm -f $ports
+./pohessiancheckserver 0 0 $sockets $channel $certificate > $ports &
+server=$!
+
+tries=0
+while [ ! -s $ports ]; do
+    tries=`expr $tries + 1`
+    if [ $tries -gt 10 ] || ! kill -0 $server 2> /dev/null; then
+        echo "pohessiancheckserver did not start"
+        kill $server 2> /dev/null
+        exit 1
+    fi
+    sleep 1
+done
+read http_port tcp_port unix shm https_port < $ports
+
+set -- "http://127.0.0.1:$http_port/test2" "tcp://127.0.0.1:$tcp_port"
+if [ "$unix" = 1 ]; then
+    set -- "$@" "unix://$sockets.http?transport=http&path=/test2" "unix://$sockets.raw"
+fi
+if [ "$shm" = 1 ]; then
+    set -- "$@" "shm://$channel"
+fi
+if [ "${https_port:-0}" != 0 ]; then
+    set -- "$@" "https://127.0.0.1:$https_port/test2"
+fi
+
+POHESSIAN_CHECK_CA=$certificate ./pohessiancheck "http://127.0.0.1:$http_port/basic" "$@"
+status=$?
+if [ $status = 0 ]; then
+    ./pohessianexample "http://127.0.0.1:$http_port/test2" "http://127.0.0.1:$http_port/basic" > /dev/null
+    status=$?
+fi
+
+kill $server
+wait $server
+rm -f $ports
+exit $status
@@ -0,0 +1,434 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Poco/Exception.h"
+#include "Poco/SharedPtr.h"
+#include "Poco/Timestamp.h"
+#include "Poco/Types.h"
+#include "pohessian/HessianTypes.h"
+#include "pohessian/Hessian1StreamReader.h"
+#include "pohessian/HessianInternTable.h"
+#include "pohessian/Hessian1StreamWriter.h"
+
+using namespace std;
+using namespace Poco;
+using namespace PoHessian;
+
+// Times Hessian1StreamWriter::writeReply and Hessian1StreamReader::readReply,
+// the latter plain, with an arena, with an intern table and into arrays, on in-memory
+// buffers, one sample reply per case, plus Value::atKey over every string key
+// of the maps in a case and a copy on write edit of a frozen list or map, and
+// prints one CSV line per case and operation:
+//
+//   case,op,bytes,iterations,ns_per_op,mb_per_s,allocs_per_op
+//
+// so the output of two builds can be diffed. Options, all --name=value:
+//
+//   --min-time  milliseconds each case and operation runs, 200 by default
+//   --filter    only run cases whose name contains this
+//
+// Building it, and the library, with and without
+// --enable-local-reference-count compares the two reference counters.
+
+// Every heap allocation of the process goes through here; the benchmark is
+// single threaded so a plain counter will do.
+static UInt64 allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size) {
+    allocations++;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) throw () {
+    free(p);
+}
+
+void operator delete[](void* p) throw () {
+    free(p);
+}
+
+// Appends to a string whose capacity survives from one iteration to the next
+class StringStreamBuf : public streambuf {
+public:
+
+    StringStreamBuf(string& buffer) : _buffer(buffer) {
+    }
+
+protected:
+
+    int_type overflow(int_type c) {
+        if (c != traits_type::eof())
+            _buffer.push_back((char) c);
+        return traits_type::not_eof(c);
+    }
+
+    streamsize xsputn(const char* s, streamsize n) {
+        _buffer.append(s, (string::size_type) n);
+        return n;
+    }
+
+private:
+    string& _buffer;
+};
+
+class MemoryStreamBuf : public streambuf {
+public:
+
+    MemoryStreamBuf(const string& buffer) {
+        char* begin = const_cast<char*> (buffer.data());
+        setg(begin, begin, begin + buffer.size());
+    }
+};
+
+static string pattern(const string::size_type length) {
+    string s;
+    s.reserve(length);
+    while (s.size() < length)
+        s.push_back((char) ('0' + s.size() % 10));
+    return s;
+}
+
+static ValuePtr intList(const int length) {
+    ValuePtr list = new Value(Value::TYPE_LIST);
+    list->reserve(length);
+    for (int i = 0; i < length; i++)
+        list->add(new Value((Int32) i));
+    return list;
+}
+
+static ValuePtr doubleList(const int length) {
+    ValuePtr list = new Value("[double", Value::TYPE_LIST);
+    list->reserve(length);
+    for (int i = 0; i < length; i++)
+        list->add(new Value(i * 0.25));
+    return list;
+}
+
+static ValuePtr intArray(const int length) {
+    Value::IntArray array;
+    array.reserve(length);
+    for (int i = 0; i < length; i++)
+        array.push_back(i % 100000 * 7919);
+    return new Value(array);
+}
+
+static ValuePtr longArray(const int length) {
+    Value::LongArray array;
+    array.reserve(length);
+    for (int i = 0; i < length; i++)
+        array.push_back((Int64) i << 24);
+    return new Value(array);
+}
+
+static ValuePtr doubleArray(const int length) {
+    Value::DoubleArray array;
+    array.reserve(length);
+    for (int i = 0; i < length; i++)
+        array.push_back(i * 0.25);
+    return new Value(array);
+}
+
+static ValuePtr nested(const int depth) {
+    ValuePtr value = new Value((Int32) 0);
+    for (int i = 0; i < depth; i++) {
+        ValuePtr list = new Value(Value::TYPE_LIST);
+        list->add(value);
+        value = list;
+    }
+    return value;
+}
+
+static ValuePtr wideMap(const int entries) {
+    ValuePtr map = new Value(Value::TYPE_MAP);
+    for (int i = 0; i < entries; i++) {
+        ostringstream key;
+        key << "key" << i;
+        map->put(new Value(key.str()), new Value((Int32) i));
+    }
+    return map;
+}
+
+static ValuePtr object(const Int32 id) {
+    ValuePtr map = new Value("com.example.Position", Value::TYPE_MAP);
+    map->put(new Value("id"), new Value(id));
+    map->put(new Value("symbol"), new Value("ACME"));
+    map->put(new Value("quantity"), new Value((Int64) 100));
+    map->put(new Value("price"), new Value(12.5));
+    return map;
+}
+
+static ValuePtr objectList(const int length) {
+    ValuePtr list = new Value("[com.example.Position", Value::TYPE_LIST);
+    list->reserve(length);
+    for (int i = 0; i < length; i++)
+        list->add(object(i));
+    return list;
+}
+
+// a few objects referenced over and over, plus a cycle
+static ValuePtr references(const int length) {
+    ValuePtr shared = new Value(Value::TYPE_LIST);
+    for (int i = 0; i < 8; i++)
+        shared->add(object(i));
+    ValuePtr list = new Value(Value::TYPE_LIST);
+    list->reserve(length + 2);
+    list->add(shared);
+    for (int i = 0; i < length; i++)
+        list->add(shared->atIndex(i % 8));
+    ValuePtr cons = new Value("com.example.Cons", Value::TYPE_MAP);
+    cons->put(new Value("first"), new Value("a"));
+    cons->put(new Value("rest"), ValuePtr(cons, false));
+    list->add(cons);
+    return list;
+}
+
+static void benchRead(const string& name, const char* op, const string& encoded,
+        const Timestamp::TimeDiff limit, const bool useArena, const SharedPtr<HessianInternTable>& internTable,
+        const bool useArrays) {
+    UInt64 iterations = 0;
+    UInt64 allocated = allocations;
+    Timestamp start;
+    do {
+        for (int i = 0; i < 16; i++) {
+            MemoryStreamBuf in_buf(encoded);
+            istream in(&in_buf);
+            Hessian1StreamReader hessian_reader(in);
+            hessian_reader.setUseArena(useArena);
+            hessian_reader.setInternTable(internTable);
+            hessian_reader.setUseArrays(useArrays);
+            hessian_reader.readReply();
+        }
+        iterations += 16;
+    } while (start.elapsed() < limit);
+    Timestamp::TimeDiff elapsed = start.elapsed();
+    cout << name << "," << op << "," << encoded.size() << "," << iterations
+            << "," << elapsed * 1000 / (Timestamp::TimeDiff) iterations
+            << "," << (elapsed > 0 ? (Timestamp::TimeDiff) (encoded.size() * iterations) / elapsed : 0)
+            << "," << (allocations - allocated) / iterations << endl;
+}
+
+static void collectMaps(const ValuePtr& value, vector<ValuePtr>& maps) {
+    if (value->isMap()) {
+        maps.push_back(value);
+    } else if (value->isList()) {
+        for (Value::List::size_type i = 0; i < value->getListSize(); i++)
+            if (!!value->atIndex(i) && (value->atIndex(i)->isMap() || value->atIndex(i)->isList()))
+                collectMaps(value->atIndex(i), maps);
+    }
+}
+
+static void benchLookup(const string& name, const ValuePtr& value, const string& encoded,
+        const Timestamp::TimeDiff limit) {
+    vector<ValuePtr> maps;
+    collectMaps(value, maps);
+    vector<pair<ValuePtr, string> > lookups;
+    for (vector<ValuePtr>::const_iterator it = maps.begin(); it != maps.end(); it++) {
+        const Value::Map& map = (*it)->getMap();
+        for (Value::Map::const_iterator entry = map.begin(); entry != map.end(); entry++)
+            if (entry->first->isString())
+                lookups.push_back(make_pair(*it, entry->first->getString()));
+    }
+    if (lookups.empty())
+        return;
+
+    UInt64 iterations = 0;
+    UInt64 allocated = allocations;
+    UInt64 found = 0;
+    Timestamp start;
+    do {
+        for (int i = 0; i < 16; i++)
+            for (vector<pair<ValuePtr, string> >::const_iterator it = lookups.begin(); it != lookups.end(); it++)
+                if (!!it->first->atKey(it->second))
+                    found++;
+        iterations += 16;
+    } while (start.elapsed() < limit);
+    Timestamp::TimeDiff elapsed = start.elapsed();
+    if (found != iterations * lookups.size())
+        throw Exception("Lookup missed a key");
+    cout << name << ",lookup," << encoded.size() << "," << iterations
+            << "," << elapsed * 1000 / (Timestamp::TimeDiff) iterations
+            << "," << (elapsed > 0 ? (Timestamp::TimeDiff) (encoded.size() * iterations) / elapsed : 0)
+            << "," << (allocations - allocated) / iterations << endl;
+}
+
+// copies a frozen value on write and changes the innermost list or map
+// along the first path of nested ones, so only the path is copied
+static ValuePtr editPath(const ValuePtr& frozen) {
+    ValuePtr root = new Value(*frozen);
+    ValuePtr value = root;
+    for (int depth = 0; depth < 64; depth++) {
+        ValuePtr next;
+        if (value->isList()) {
+            for (Value::List::size_type i = 0; i < value->getListSize() && !next; i++)
+                if (!!value->atIndex(i) && (value->atIndex(i)->isList() || value->atIndex(i)->isMap()))
+                    next = value->editAtIndex(i);
+        } else {
+            const Value::Map& map = value->getMap();
+            for (Value::Map::const_iterator entry = map.begin(); entry != map.end(); entry++)
+                if (!!entry->second && (entry->second->isList() || entry->second->isMap())) {
+                    ValuePtr key = entry->first;
+                    next = value->editAtKey(key);
+                    break;
+                }
+        }
+        if (!next)
+            break;
+        value = next;
+    }
+    if (value->isList())
+        value->add(new Value(true));
+    else
+        value->put(new Value("edited"), new Value(true));
+    return root;
+}
+
+static void benchEdit(const string& name, const ValuePtr& value, const string& encoded,
+        const Timestamp::TimeDiff limit) {
+    if (!value->isList() && !value->isMap())
+        return;
+    ValuePtr frozen = new Value(*value);
+    frozen->freeze();
+
+    UInt64 iterations = 0;
+    UInt64 allocated = allocations;
+    Timestamp start;
+    do {
+        for (int i = 0; i < 16; i++)
+            editPath(frozen);
+        iterations += 16;
+    } while (start.elapsed() < limit);
+    Timestamp::TimeDiff elapsed = start.elapsed();
+    cout << name << ",cow_edit," << encoded.size() << "," << iterations
+            << "," << elapsed * 1000 / (Timestamp::TimeDiff) iterations
+            << "," << (elapsed > 0 ? (Timestamp::TimeDiff) (encoded.size() * iterations) / elapsed : 0)
+            << "," << (allocations - allocated) / iterations << endl;
+}
+
+static void bench(const string& name, const ValuePtr& value, const long minTime) {
+    ReplyPtr reply = new Reply(value);
+    string buffer;
+    StringStreamBuf out_buf(buffer);
+    ostream out(&out_buf);
+    {
+        Hessian1StreamWriter hessian_writer(out);
+        hessian_writer.writeReply(reply);
+    }
+    const string encoded(buffer);
+    const Timestamp::TimeDiff limit = (Timestamp::TimeDiff) minTime * 1000;
+
+    UInt64 iterations = 0;
+    UInt64 allocated = allocations;
+    Timestamp start;
+    do {
+        for (int i = 0; i < 16; i++) {
+            buffer.clear();
+            Hessian1StreamWriter hessian_writer(out);
+            hessian_writer.writeReply(reply);
+        }
+        iterations += 16;
+    } while (start.elapsed() < limit);
+    Timestamp::TimeDiff elapsed = start.elapsed();
+    cout << name << ",write," << encoded.size() << "," << iterations
+            << "," << elapsed * 1000 / (Timestamp::TimeDiff) iterations
+            << "," << (elapsed > 0 ? (Timestamp::TimeDiff) (encoded.size() * iterations) / elapsed : 0)
+            << "," << (allocations - allocated) / iterations << endl;
+
+    benchRead(name, "read", encoded, limit, false, NULL, false);
+    benchRead(name, "read_arena", encoded, limit, true, NULL, false);
+    benchRead(name, "read_interned", encoded, limit, false, new HessianInternTable, false);
+    benchRead(name, "read_arrays", encoded, limit, false, NULL, true);
+    benchLookup(name, value, encoded, limit);
+    benchEdit(name, value, encoded, limit);
+}
+
+int main(int argc, char* argv[]) {
+    long minTime = 200;
+    string filter;
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg.compare(0, 11, "--min-time=") == 0)
+            minTime = atol(arg.substr(11).c_str());
+        else if (arg.compare(0, 9, "--filter=") == 0)
+            filter = arg.substr(9);
+    }
+    try {
+        typedef pair<string, ValuePtr> Case;
+        vector<Case> cases;
+        cases.push_back(Case("null", new Value()));
+        cases.push_back(Case("boolean", new Value(true)));
+        cases.push_back(Case("int", new Value((Int32) 0x3ffff)));
+        cases.push_back(Case("long", new Value((Int64) 0x80000000LL)));
+        cases.push_back(Case("double", new Value(3.14159)));
+        cases.push_back(Case("date", new Value((Int64) 894621091000LL, Value::TYPE_DATE)));
+        cases.push_back(Case("string_32", new Value(pattern(32))));
+        cases.push_back(Case("string_1023", new Value(pattern(1023))));
+        cases.push_back(Case("string_1024", new Value(pattern(1024))));
+        cases.push_back(Case("string_65536", new Value(pattern(65536))));
+        cases.push_back(Case("xml_1024", new Value("<a>" + pattern(1017) + "</a>", Value::TYPE_XML)));
+        cases.push_back(Case("binary_1024", new Value(pattern(1024), Value::TYPE_BINARY)));
+        cases.push_back(Case("binary_65536", new Value(pattern(65536), Value::TYPE_BINARY)));
+        cases.push_back(Case("remote", new Value("com.example.Service", "http://localhost/service")));
+        cases.push_back(Case("fault", new Value("ServiceException", "sample exception", new Value(pattern(64)))));
+        cases.push_back(Case("list_int_1000", intList(1000)));
+        cases.push_back(Case("list_double_100000", doubleList(100000)));
+        cases.push_back(Case("array_double_100000", doubleArray(100000)));
+        cases.push_back(Case("array_int_1000000", intArray(1000000)));
+        cases.push_back(Case("array_long_1000000", longArray(1000000)));
+        cases.push_back(Case("array_double_1000000", doubleArray(1000000)));
+        cases.push_back(Case("nested_64", nested(64)));
+        cases.push_back(Case("map_wide_1000", wideMap(1000)));
+        cases.push_back(Case("objects_1000", objectList(1000)));
+        cases.push_back(Case("references_1000", references(1000)));
+
+        cout << "case,op,bytes,iterations,ns_per_op,mb_per_s,allocs_per_op" << endl;
+        for (vector<Case>::const_iterator it = cases.begin(); it != cases.end(); it++)
+            if (filter.empty() || it->first.find(filter) != string::npos)
+                bench(it->first, it->second, minTime);
+    } catch (Exception& e) {
+        cerr << e.displayText() << endl;
+        return -1;
+    }
+    return 0;
+}
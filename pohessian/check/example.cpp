@@ -19,6 +19,7 @@
 //
 
 #include <iostream>
+#include <string>
 
 #include "Poco/URI.h"
 #include "Poco/Timestamp.h"
@@ -30,11 +31,15 @@ using namespace std;
 using namespace Poco;
 using namespace PoHessian;
 
+// The public test services by default; check.sh passes the loopback
+// pohessiancheckserver instead: pohessianexample [TEST2_URI [BASIC_URI]]
 int main(int argc, char* argv[]) {
+    const string test2 = argc > 1 ? argv[1] : "http://hessian.caucho.com/test/test2";
+    const string basic = argc > 2 ? argv[2] : "http://hessian-test.appspot.com/basic";
     
     cout << "*" << endl << "* GettingStarted" << endl << "*" << endl;
     {
-        URI uri("http://hessian.caucho.com/test/test2");
+        URI uri(test2);
         HessianClient client(HessianClient::HESSIAN_VERSION_1, uri);
         cout << client.call("replyString_32")->getString() << endl;
     }
@@ -190,7 +195,7 @@ int main(int argc, char* argv[]) {
     
     cout << "*" << endl << "* HessianClient" << endl << "*" << endl;
     {
-        HessianClient client(HessianClient::HESSIAN_VERSION_1, URI("http://hessian-test.appspot.com/basic"));
+        HessianClient client(HessianClient::HESSIAN_VERSION_1, URI(basic));
         
         {
             cout << "* call with no return, no parameter, no header (void nullCall()) " << endl;
@@ -0,0 +1,467 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "Poco/Exception.h"
+#include "Poco/Runnable.h"
+#include "Poco/SharedPtr.h"
+#include "Poco/Thread.h"
+#include "Poco/Types.h"
+#include "Poco/Net/ServerSocket.h"
+#include "Poco/Net/SocketAddress.h"
+#ifdef HAVE_POCO_NET_HTTPSCLIENTSESSION_H
+#include "Poco/Net/Context.h"
+#include "Poco/Net/NetSSL.h"
+#include "Poco/Net/SecureServerSocket.h"
+#endif
+#include "pohessian/HessianTypes.h"
+#include "pohessian/HessianDispatcher.h"
+#include "pohessian/HessianServer.h"
+#include "pohessian/HessianShmChannel.h"
+#include "pohessian/HessianTcpServer.h"
+
+using namespace std;
+using namespace Poco;
+using namespace Poco::Net;
+using namespace PoHessian;
+
+// Stands in for http://hessian-test.appspot.com/basic and
+// http://hessian.caucho.com/test/test2 on the loopback interface, over
+// HTTP and raw TCP, over both on the unix domain sockets PREFIX.http and
+// PREFIX.raw when given a third argument PREFIX, on the shared memory
+// channel /NAME when given a fourth argument NAME, and over HTTPS when
+// given a fifth argument, a PEM file holding a private key and its
+// certificate. Every replyX method answers the sample X and every argX
+// method answers true when given that same sample, or says what it got
+// instead. Prints the HTTP and TCP ports, then 1 or 0 for whether it
+// serves the unix domain sockets and the same for the shared memory
+// channel, then the HTTPS port or 0, then serves until SIGINT or SIGTERM.
+
+typedef map<string, ValuePtr> SampleMap;
+
+static string sampleString(const string::size_type length) {
+    ostringstream sb;
+    if (length <= 1024) {
+        for (int i = 0; i < 16; i++)
+            sb << (i / 10) << (i % 10) << " 456789012345678901234567890123456789012345678901234567890123\n";
+    } else {
+        for (int i = 0; i < 64 * 16; i++)
+            sb << (i / 100) << (i / 10 % 10) << (i % 10) << " 56789012345678901234567890123456789012345678901234567890123\n";
+    }
+    string s = sb.str();
+    s.resize(length);
+    return s;
+}
+
+static ValuePtr sampleList(const string& type, const int length) {
+    ValuePtr list = new Value(type, Value::TYPE_LIST);
+    for (int i = 1; i <= length; i++) {
+        ostringstream element;
+        element << i;
+        list->add(new Value(element.str()));
+    }
+    return list;
+}
+
+static ValuePtr sampleMap(const string& type, const int entries) {
+    ValuePtr map = new Value(type, Value::TYPE_MAP);
+    if (entries == 1) {
+        map->put(new Value("a"), new Value((Int32) 0));
+    } else if (entries == 2) {
+        map->put(new Value((Int32) 0), new Value("a"));
+        map->put(new Value((Int32) 1), new Value("b"));
+    } else if (entries == 3) {
+        ValuePtr list = new Value(Value::TYPE_LIST);
+        list->add(new Value("a"));
+        map->put(list, new Value((Int32) 0));
+    }
+    return map;
+}
+
+static ValuePtr testObject(const Int32 value) {
+    ValuePtr map = new Value("com.caucho.hessian.test.TestObject", Value::TYPE_MAP);
+    map->put(new Value("_value"), new Value(value));
+    return map;
+}
+
+static SampleMap samples() {
+    SampleMap s;
+    s["Null"] = new Value();
+    s["True"] = new Value(true);
+    s["False"] = new Value(false);
+
+    s["Int_0"] = new Value((Int32) 0);
+    s["Int_1"] = new Value((Int32) 1);
+    s["Int_47"] = new Value((Int32) 47);
+    s["Int_m16"] = new Value((Int32) -16);
+    s["Int_0x30"] = new Value((Int32) 0x30);
+    s["Int_0x7ff"] = new Value((Int32) 0x7ff);
+    s["Int_m17"] = new Value((Int32) -17);
+    s["Int_m0x800"] = new Value((Int32) -0x800);
+    s["Int_0x800"] = new Value((Int32) 0x800);
+    s["Int_0x3ffff"] = new Value((Int32) 0x3ffff);
+    s["Int_m0x801"] = new Value((Int32) -0x801);
+    s["Int_m0x40000"] = new Value((Int32) -0x40000);
+    s["Int_0x40000"] = new Value((Int32) 0x40000);
+    s["Int_0x7fffffff"] = new Value((Int32) 0x7fffffff);
+    s["Int_m0x40001"] = new Value((Int32) -0x40001);
+    s["Int_m0x80000000"] = new Value((Int32) -0x80000000);
+
+    s["Long_0"] = new Value((Int64) 0LL);
+    s["Long_1"] = new Value((Int64) 1LL);
+    s["Long_15"] = new Value((Int64) 15LL);
+    s["Long_m8"] = new Value((Int64) -8LL);
+    s["Long_0x10"] = new Value((Int64) 0x10LL);
+    s["Long_0x7ff"] = new Value((Int64) 0x7ffLL);
+    s["Long_m9"] = new Value((Int64) -9LL);
+    s["Long_m0x800"] = new Value((Int64) -0x800LL);
+    s["Long_0x800"] = new Value((Int64) 0x800LL);
+    s["Long_0x3ffff"] = new Value((Int64) 0x3ffffLL);
+    s["Long_m0x801"] = new Value((Int64) -0x801LL);
+    s["Long_m0x40000"] = new Value((Int64) -0x40000LL);
+    s["Long_0x40000"] = new Value((Int64) 0x40000LL);
+    s["Long_0x7fffffff"] = new Value((Int64) 0x7fffffffLL);
+    s["Long_m0x40001"] = new Value((Int64) -0x40001LL);
+    s["Long_m0x80000000"] = new Value((Int64) -0x80000000LL);
+    s["Long_0x80000000"] = new Value((Int64) 0x80000000LL);
+    s["Long_m0x80000001"] = new Value((Int64) -0x80000001LL);
+
+    s["Double_0_0"] = new Value(0.0);
+    s["Double_1_0"] = new Value(1.0);
+    s["Double_2_0"] = new Value(2.0);
+    s["Double_127_0"] = new Value(127.0);
+    s["Double_m128_0"] = new Value(-128.0);
+    s["Double_128_0"] = new Value(128.0);
+    s["Double_m129_0"] = new Value(-129.0);
+    s["Double_32767_0"] = new Value(32767.0);
+    s["Double_m32768_0"] = new Value(-32768.0);
+    s["Double_0_001"] = new Value(0.001);
+    s["Double_m0_001"] = new Value(-0.001);
+    s["Double_65_536"] = new Value(65.536);
+    s["Double_3_14159"] = new Value(3.14159);
+
+    s["Date_0"] = new Value((Int64) 0LL, Value::TYPE_DATE);
+    s["Date_1"] = new Value((Int64) 894621091000LL, Value::TYPE_DATE);
+    s["Date_2"] = new Value((Int64) (894621091000LL - (894621091000LL % 60000LL)), Value::TYPE_DATE);
+
+    s["String_0"] = new Value("");
+    s["String_null"] = new Value();
+    s["String_1"] = new Value("0");
+    s["String_31"] = new Value("0123456789012345678901234567890");
+    s["String_32"] = new Value("01234567890123456789012345678901");
+    s["String_1023"] = new Value(sampleString(1023));
+    s["String_1024"] = new Value(sampleString(1024));
+    s["String_65536"] = new Value(sampleString(65536));
+
+    s["Binary_0"] = new Value("", Value::TYPE_BINARY);
+    s["Binary_null"] = new Value();
+    s["Binary_1"] = new Value("0", Value::TYPE_BINARY);
+    s["Binary_15"] = new Value("012345678901234", Value::TYPE_BINARY);
+    s["Binary_16"] = new Value("0123456789012345", Value::TYPE_BINARY);
+    s["Binary_1023"] = new Value(sampleString(1023), Value::TYPE_BINARY);
+    s["Binary_1024"] = new Value(sampleString(1024), Value::TYPE_BINARY);
+    s["Binary_65536"] = new Value(sampleString(65536), Value::TYPE_BINARY);
+
+    s["UntypedFixedList_0"] = sampleList("", 0);
+    s["UntypedFixedList_1"] = sampleList("", 1);
+    s["UntypedFixedList_7"] = sampleList("", 7);
+    s["UntypedFixedList_8"] = sampleList("", 8);
+    s["TypedFixedList_0"] = sampleList("[string", 0);
+    s["TypedFixedList_1"] = sampleList("[string", 1);
+    s["TypedFixedList_7"] = sampleList("[string", 7);
+    s["TypedFixedList_8"] = sampleList("[string", 8);
+
+    s["UntypedMap_0"] = sampleMap("", 0);
+    s["UntypedMap_1"] = sampleMap("", 1);
+    s["UntypedMap_2"] = sampleMap("", 2);
+    s["UntypedMap_3"] = sampleMap("", 3);
+    s["TypedMap_0"] = sampleMap("java.util.Hashtable", 0);
+    s["TypedMap_1"] = sampleMap("java.util.Hashtable", 1);
+    s["TypedMap_2"] = sampleMap("java.util.Hashtable", 2);
+    s["TypedMap_3"] = sampleMap("java.util.Hashtable", 3);
+
+    s["Object_0"] = new Value("com.caucho.hessian.test.A0", Value::TYPE_MAP);
+    ValuePtr objects = new Value(Value::TYPE_LIST);
+    for (int i = 0; i <= 16; i++) {
+        ostringstream type;
+        type << "com.caucho.hessian.test.A" << i;
+        objects->add(new Value(type.str(), Value::TYPE_MAP));
+    }
+    s["Object_16"] = objects;
+    s["Object_1"] = testObject(0);
+    ValuePtr object2 = new Value(Value::TYPE_LIST);
+    object2->add(testObject(0));
+    object2->add(testObject(1));
+    s["Object_2"] = object2;
+    ValuePtr object2a = new Value(Value::TYPE_LIST);
+    ValuePtr shared = testObject(0);
+    object2a->add(shared);
+    object2a->add(shared);
+    s["Object_2a"] = object2a;
+    ValuePtr object2b = new Value(Value::TYPE_LIST);
+    object2b->add(testObject(0));
+    object2b->add(testObject(0));
+    s["Object_2b"] = object2b;
+    ValuePtr cons = new Value("com.caucho.hessian.test.TestCons", Value::TYPE_MAP);
+    cons->put(new Value("_first"), new Value("a"));
+    cons->put(new Value("_rest"), ValuePtr(cons, false));
+    s["Object_3"] = cons;
+    // every server thread hands them out, see Value::share()
+    for (SampleMap::iterator it = s.begin(); it != s.end(); it++)
+        it->second->share();
+    return s;
+}
+
+static const ValuePtr& parameter(const CallPtr& call, const ParameterList::size_type n) {
+    const ParameterList& parameters = call->getParameters();
+    if (n >= parameters.size())
+        throw HessianException("IllegalArgumentException", call->getMethod() + ": missing parameter", new Value());
+    return parameters[n];
+}
+
+class ReplySample : public HessianHandler {
+public:
+
+    ReplySample(const ValuePtr& sample) : _sample(sample) {
+    }
+
+    ValuePtr handle(const CallPtr&) {
+        return _sample;
+    }
+
+private:
+    const ValuePtr _sample;
+};
+
+class ArgSample : public HessianHandler {
+public:
+
+    ArgSample(const ValuePtr& sample) : _sample(sample) {
+    }
+
+    ValuePtr handle(const CallPtr& call) {
+        const ValuePtr& arg = parameter(call, 0);
+        if (!!arg && arg->equals(*_sample))
+            return new Value(true);
+        ostringstream message;
+        message << call->getMethod() << ": expected " << &*_sample << " got ";
+        if (!arg)
+            message << "nothing";
+        else
+            message << &*arg;
+        return new Value(message.str());
+    }
+
+private:
+    const ValuePtr _sample;
+};
+
+static ValuePtr nullCall(const CallPtr&) {
+    return new Value();
+}
+
+static ValuePtr hello(const CallPtr&) {
+    return new Value("Hello, World");
+}
+
+static ValuePtr subtract(const CallPtr& call) {
+    return new Value((Int32) (parameter(call, 0)->getInteger() - parameter(call, 1)->getInteger()));
+}
+
+static ValuePtr echo(const CallPtr& call) {
+    return parameter(call, 0);
+}
+
+static ValuePtr fault(const CallPtr&) {
+    ValuePtr exception = new Value("java.lang.NullPointerException", Value::TYPE_MAP);
+    exception->put(new Value("detailMessage"), new Value("sample exception"));
+    exception->put(new Value("cause"), ValuePtr(exception, false));
+    throw HessianException("ServiceException", "sample exception", exception);
+}
+
+// answers its argument after sleeping that many milliseconds
+static ValuePtr sleepFor(const CallPtr& call) {
+    const ValuePtr& milliseconds = parameter(call, 0);
+    Thread::sleep((long) milliseconds->getInteger());
+    return milliseconds;
+}
+
+static void registerMethods(HessianDispatcher& dispatcher, const SampleMap& samples) {
+    dispatcher.registerFunction("nullCall", nullCall);
+    dispatcher.registerFunction("hello", hello);
+    dispatcher.registerFunction("subtract", subtract);
+    dispatcher.registerFunction("echo", echo);
+    dispatcher.registerFunction("fault", fault);
+    dispatcher.registerFunction("sleep", sleepFor);
+    for (SampleMap::const_iterator it = samples.begin(); it != samples.end(); it++) {
+        dispatcher.registerHandler("reply" + it->first, new ReplySample(it->second));
+        dispatcher.registerHandler("arg" + it->first, new ArgSample(it->second));
+    }
+}
+
+#if defined(HAVE_LINUX_FUTEX_H) && defined(HAVE_SYS_MMAN_H)
+#define POHESSIAN_CHECK_SHM 1
+
+// Answers the calls of one shared memory client at a time, until the call
+// stop() sends
+class ShmServer : public Runnable {
+public:
+
+    ShmServer(const SharedPtr<HessianDispatcher>& dispatcher, const string& name)
+    : _dispatcher(dispatcher),
+    _name(name),
+    _channel(name, HessianShmChannel::SIDE_SERVER) {
+    }
+
+    void run() {
+        for (;;) {
+            CallPtr call;
+            try {
+                call = _channel.readCall();
+            } catch (Exception&) {
+                continue;
+            }
+            const bool stopping = call->getMethod() == "_stop";
+            ReplyPtr reply = stopping ? new Reply(new Value()) : _dispatcher->dispatch(call);
+            try {
+                _channel.writeReply(reply);
+            } catch (Exception&) {
+            }
+            if (stopping)
+                return;
+        }
+    }
+
+    void stop() {
+        HessianShmChannel client(_name, HessianShmChannel::SIDE_CLIENT);
+        client.call(new Call("_stop"));
+    }
+
+private:
+    SharedPtr<HessianDispatcher> _dispatcher;
+    const string _name;
+    HessianShmChannel _channel;
+};
+#endif
+
+#ifdef HAVE_POCO_UNIX_LOCAL
+static ServerSocket unixServerSocket(const string& path) {
+    unlink(path.c_str());
+    return ServerSocket(SocketAddress(SocketAddress::UNIX_LOCAL, path));
+}
+#endif
+
+int main(int argc, char* argv[]) {
+    UInt16 httpPort = argc > 1 ? (UInt16) atoi(argv[1]) : 0;
+    UInt16 tcpPort = argc > 2 ? (UInt16) atoi(argv[2]) : 0;
+    string unixPrefix = argc > 3 ? argv[3] : "";
+    string shmName = argc > 4 ? argv[4] : "";
+    string certificate = argc > 5 ? argv[5] : "";
+    // every server thread inherits the mask, only main() sees the signals
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    try {
+        SampleMap s = samples();
+        SharedPtr<HessianDispatcher> dispatcher = new HessianDispatcher;
+        registerMethods(*dispatcher, s);
+        HessianServer http(dispatcher, ServerSocket(SocketAddress("127.0.0.1", httpPort)));
+        HessianTcpServer tcp(dispatcher, ServerSocket(SocketAddress("127.0.0.1", tcpPort)));
+        http.start();
+        tcp.start();
+        SharedPtr<HessianServer> unixHttp;
+        SharedPtr<HessianTcpServer> unixRaw;
+#ifdef HAVE_POCO_UNIX_LOCAL
+        if (!unixPrefix.empty()) {
+            unixHttp = new HessianServer(dispatcher, unixServerSocket(unixPrefix + ".http"));
+            unixRaw = new HessianTcpServer(dispatcher, unixServerSocket(unixPrefix + ".raw"));
+            unixHttp->start();
+            unixRaw->start();
+        }
+#endif
+        Thread shmThread;
+#ifdef POHESSIAN_CHECK_SHM
+        SharedPtr<ShmServer> shm;
+        if (!shmName.empty()) {
+            shm = new ShmServer(dispatcher, "/" + shmName);
+            shmThread.start(*shm);
+        }
+        const bool servesShm = !shm.isNull();
+#else
+        const bool servesShm = false;
+#endif
+        UInt16 httpsPort = 0;
+#ifdef HAVE_POCO_NET_HTTPSCLIENTSESSION_H
+        SharedPtr<HessianServer> https;
+        if (!certificate.empty()) {
+            initializeSSL();
+            Context::Ptr context = new Context(Context::SERVER_USE, certificate, certificate, "", Context::VERIFY_NONE);
+            context->enableSessionCache(true, "pohessiancheckserver");
+            https = new HessianServer(dispatcher, SecureServerSocket(SocketAddress("127.0.0.1", 0), 64, context));
+            https->start();
+            httpsPort = https->getPort();
+        }
+#endif
+        cout << http.getPort() << " " << tcp.getPort() << " " << (unixRaw.isNull() ? 0 : 1) << " " << (servesShm ? 1 : 0) << " " << httpsPort << endl;
+        int signal;
+        sigwait(&signals, &signal);
+#ifdef HAVE_POCO_NET_HTTPSCLIENTSESSION_H
+        if (!https.isNull()) {
+            https->stop();
+            https = NULL;
+            uninitializeSSL();
+        }
+#endif
+#ifdef POHESSIAN_CHECK_SHM
+        if (servesShm) {
+            shm->stop();
+            shmThread.join();
+        }
+#endif
+        if (!unixRaw.isNull()) {
+            unixRaw->stop();
+            unixHttp->stop();
+            unlink((unixPrefix + ".raw").c_str());
+            unlink((unixPrefix + ".http").c_str());
+        }
+        tcp.stop();
+        http.stop();
+    } catch (Exception& e) {
+        cerr << e.displayText() << endl;
+        return -1;
+    }
+    return 0;
+}
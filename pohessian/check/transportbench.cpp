@@ -0,0 +1,185 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+#include "Poco/Exception.h"
+#include "Poco/Runnable.h"
+#include "Poco/Thread.h"
+#include "Poco/Timespan.h"
+#include "Poco/Timestamp.h"
+#include "Poco/URI.h"
+#include "Poco/Net/ServerSocket.h"
+#include "Poco/Net/SocketAddress.h"
+#include "Poco/Net/SocketStream.h"
+#include "Poco/Net/StreamSocket.h"
+#include "pohessian/HessianTypes.h"
+#include "pohessian/HessianClient.h"
+#include "pohessian/HessianStatistics.h"
+#include "pohessian/HessianShmChannel.h"
+#include "pohessian/Hessian1StreamReader.h"
+#include "pohessian/Hessian1StreamWriter.h"
+
+using namespace std;
+using namespace Poco;
+using namespace Poco::Net;
+using namespace PoHessian;
+
+// Answers every call of one connection with its first parameter until the
+// client hangs up.
+class EchoServer : public Runnable {
+public:
+
+    EchoServer(const SocketAddress& address)
+    : _server(address) {
+    }
+
+    UInt16 port() const {
+        return _server.address().port();
+    }
+
+    void run() {
+        try {
+            StreamSocket socket = _server.acceptConnection();
+            socket.setNoDelay(true);
+            SocketInputStream in(socket);
+            SocketOutputStream out(socket);
+            while (in.peek() != char_traits<char>::eof()) {
+                Hessian1StreamReader hessian_reader(in);
+                CallPtr call = hessian_reader.readCall();
+                const ParameterList& parameters = call->getParameters();
+                Hessian1StreamWriter hessian_writer(out);
+                hessian_writer.writeReply(new Reply(parameters.empty() ? new Value() : parameters[0]));
+                out.flush();
+            }
+        } catch (Exception& e) {
+            cerr << "server: " << e.displayText() << endl;
+        }
+    }
+
+private:
+    ServerSocket _server;
+};
+
+// Answers a given number of calls on a shared memory channel.
+class ShmEchoServer : public Runnable {
+public:
+
+    ShmEchoServer(HessianShmChannel& channel, const int calls)
+    : _channel(channel),
+    _calls(calls) {
+    }
+
+    void run() {
+        try {
+            for (int i = 0; i < _calls; i++) {
+                CallPtr call = _channel.readCall();
+                const ParameterList& parameters = call->getParameters();
+                _channel.writeReply(new Reply(parameters.empty() ? new Value() : parameters[0]));
+            }
+        } catch (Exception& e) {
+            cerr << "server: " << e.displayText() << endl;
+        }
+    }
+
+private:
+    HessianShmChannel& _channel;
+    const int _calls;
+};
+
+static void bench(const string& name, const URI& uri, const int calls) {
+    HessianClient client(HessianClient::HESSIAN_VERSION_1, uri);
+    ParameterList parameters;
+    parameters.push_back(new Value(string(64, 'x')));
+    for (int i = 0; i < calls / 10; i++)
+        client.call("echo", parameters);
+    LatencyHistogram histogram;
+    Timestamp start;
+    for (int i = 0; i < calls; i++) {
+        Timestamp call_start;
+        client.call("echo", parameters);
+        histogram.record(Timespan(call_start.elapsed()));
+    }
+    Timespan total(start.elapsed());
+    cout << name << ": " << calls << " calls"
+            << ", mean " << histogram.getMean().totalMicroseconds() << "us"
+            << ", p50 " << histogram.getPercentile(50.0).totalMicroseconds() << "us"
+            << ", p99 " << histogram.getPercentile(99.0).totalMicroseconds() << "us"
+            << ", " << (total.totalMicroseconds() > 0 ? calls * 1000000LL / total.totalMicroseconds() : 0) << " calls/s" << endl;
+}
+
+// Round-trip latency of raw Hessian framing over loopback TCP, over a unix
+// domain socket and over a shared memory channel, one call at a time.
+int main(int argc, char* argv[]) {
+    int calls = argc > 1 ? atoi(argv[1]) : 20000;
+    try {
+        {
+            EchoServer server(SocketAddress("127.0.0.1", 0));
+            Thread thread;
+            thread.start(server);
+            ostringstream uri;
+            uri << "tcp://127.0.0.1:" << server.port();
+            bench("tcp loopback", URI(uri.str()), calls);
+            thread.join();
+        }
+#ifdef HAVE_POCO_UNIX_LOCAL
+        {
+            ostringstream path;
+            path << "/tmp/pohessian-bench-" << getpid() << ".sock";
+            remove(path.str().c_str());
+            EchoServer server(SocketAddress(SocketAddress::UNIX_LOCAL, path.str()));
+            Thread thread;
+            thread.start(server);
+            bench("unix socket", URI("unix://" + path.str()), calls);
+            thread.join();
+            remove(path.str().c_str());
+        }
+#else
+        cout << "unix socket: not supported by this Poco" << endl;
+#endif
+        try {
+            ostringstream name;
+            name << "/pohessian-bench-" << getpid();
+            HessianShmChannel channel(name.str(), HessianShmChannel::SIDE_SERVER);
+            ShmEchoServer server(channel, calls + calls / 10);
+            Thread thread;
+            thread.start(server);
+            bench("shared memory", URI("shm://" + name.str().substr(1)), calls);
+            thread.join();
+        } catch (NotImplementedException&) {
+            cout << "shared memory: not supported on this system" << endl;
+        }
+    } catch (Exception& e) {
+        cerr << e.displayText() << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef pohessian_HessianArena_INCLUDED
+#define pohessian_HessianArena_INCLUDED
+
+#include "pohessian/PoHessian.h"
+#include "pohessian/HessianTypes.h"
+
+namespace PoHessian {
+
+    // Region the values of one decoded reply are bump allocated from, with
+    // new (arena) Value(..., arena), together with their strings, lists,
+    // maps and arrays. Values do not count references to the arena: they
+    // are all destroyed at once with it, whatever their own counts. The
+    // Reply holds a reference to the arena, and so does its value, the
+    // root, while it has references of its own: the graph stays valid for
+    // as long as either is held, and no longer, so a part of it that must
+    // outlive both has to be copied out. Strings keep what does not fit in
+    // the std::string itself on the heap.
+    //
+    // The root and the reply may be released from any thread, so the count
+    // of an arena stays atomic whatever the DefaultReferenceCounter; values
+    // must be allocated from one thread at a time.
+    class PoHessian_API HessianArena : public RefCounted<Poco::ReferenceCounter> {
+    public:
+
+        // blocks start small and double up to blockSize, so that an arena
+        // for a small reply stays small
+        HessianArena(const std::size_t blockSize = 16384);
+        // destroys every value allocated from the arena
+        ~HessianArena();
+
+        void* allocate(const std::size_t size);
+        // storage for one value, see Value::operator new
+        void* allocateValue();
+
+        // the next value allocated is the one adoptRoot() may take for the
+        // root; the first block of values keeps a slot for it
+        void reserveRoot();
+        // value holds a reference to the arena once it is the root, which
+        // it is when allocated first after reserveRoot(); returns whether
+        // it is
+        bool adoptRoot(Value* value);
+        // the root has no references left
+        static void releaseRoot(Value* root);
+
+        std::size_t getBlockCount() const;
+        // bytes handed out so far, padding and values included
+        std::size_t getBytesAllocated() const;
+        std::size_t getValueCount() const;
+
+    private:
+
+        struct ValueBlock;
+
+        HessianArena(const HessianArena&);
+        HessianArena& operator=(const HessianArena&);
+
+        char* newBlock(const std::size_t size);
+        Value* rootSlot() const;
+
+        const std::size_t _blockSize;
+        std::size_t _nextBlockSize;
+        // last block allocated, each block starts with a link to the
+        // one allocated before it
+        char* _blocks;
+        std::size_t _blockCount;
+        char* _next;
+        char* _end;
+        std::size_t _bytesAllocated;
+        // values, in blocks of their own so that they can all be destroyed:
+        // the first and the last block
+        ValueBlock* _firstValues;
+        ValueBlock* _values;
+        std::size_t _valueCount;
+        // the root slot is handed out next, or has been
+        bool _rootReserved;
+        bool _rootAllocated;
+    };
+
+    typedef Ptr<HessianArena, Poco::ReferenceCounter> HessianArenaPtr;
+
+}
+
+#endif
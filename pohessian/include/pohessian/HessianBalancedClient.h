@@ -0,0 +1,117 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef pohessian_HessianBalancedClient_INCLUDED
+#define pohessian_HessianBalancedClient_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include "pohessian/PoHessian.h"
+#include "pohessian/HessianTypes.h"
+#include "pohessian/HessianClient.h"
+#include "pohessian/HessianStatistics.h"
+
+#include "Poco/Types.h"
+#include "Poco/URI.h"
+#include "Poco/Mutex.h"
+#include "Poco/Random.h"
+#include "Poco/SharedPtr.h"
+#include "Poco/Timespan.h"
+#include "Poco/Timestamp.h"
+
+namespace PoHessian {
+
+    // Spreads calls over several equivalent endpoints. Each call goes to the
+    // better of two endpoints drawn at random, judged on the calls it has in
+    // flight and on its latency moving average. An endpoint failing too many
+    // calls in a row is ejected for a while, then gets a single probe call;
+    // a success brings it back, a failure ejects it twice as long. Every
+    // endpoint is a HessianClient with its own connection pool.
+    class PoHessian_API HessianBalancedClient {
+    public:
+
+        HessianBalancedClient(const HessianClient::HessianVersion version, const std::vector<Poco::URI>& uris);
+        ~HessianBalancedClient();
+
+        HessianClient& getEndpoint(const std::vector<Poco::URI>::size_type index);
+        std::vector<Poco::URI>::size_type getEndpointCount() const;
+
+        // consecutive failed calls that eject an endpoint, 5 by default;
+        // only transport errors count, a fault reply is an answer
+        void setFailureThreshold(const unsigned int failures);
+        unsigned int getFailureThreshold() const;
+        // first ejection period, 10 seconds by default
+        void setEjectionTime(const Poco::Timespan& time);
+        Poco::Timespan getEjectionTime() const;
+        // the ejection period doubles at each failed probe up to this,
+        // 5 minutes by default
+        void setMaxEjectionTime(const Poco::Timespan& time);
+        Poco::Timespan getMaxEjectionTime() const;
+        // weight of the newest sample in the latency moving average
+        void setLatencyWeight(const double weight);
+        double getLatencyWeight() const;
+
+        unsigned int getOutstanding(const std::vector<Poco::URI>::size_type index) const;
+        Poco::Timespan getLatencyAverage(const std::vector<Poco::URI>::size_type index) const;
+        bool isEjected(const std::vector<Poco::URI>::size_type index) const;
+        Poco::UInt64 getEjectionCount() const;
+        Poco::UInt64 getProbeCount() const;
+
+        ValuePtr call(const std::string& method);
+        ValuePtr call(const std::string& method, const HeaderList& headers);
+        ValuePtr call(const std::string& method, const ParameterList& parameters);
+        ValuePtr call(const std::string& method, const HeaderList& headers, const ParameterList& parameters);
+        ReplyPtr call(const CallPtr& call);
+
+    private:
+
+        struct Endpoint {
+            Poco::SharedPtr<HessianClient> client;
+            unsigned int outstanding;
+            MovingAverage latency;
+            unsigned int failures;
+            bool ejected;
+            bool probing;
+            Poco::Timestamp ejectedUntil;
+            Poco::Timespan ejectionTime;
+        };
+
+        HessianBalancedClient(const HessianBalancedClient&);
+        HessianBalancedClient& operator=(const HessianBalancedClient&);
+
+        std::vector<Endpoint>::size_type pick();
+        void succeeded(const std::vector<Endpoint>::size_type index, const Poco::Timespan& latency);
+        void failed(const std::vector<Endpoint>::size_type index);
+
+        mutable Poco::FastMutex _mutex;
+        std::vector<Endpoint> _endpoints;
+        Poco::Random _random;
+        unsigned int _failureThreshold;
+        Poco::Timespan _ejectionTime;
+        Poco::Timespan _maxEjectionTime;
+        Poco::UInt64 _ejectionCount;
+        Poco::UInt64 _probeCount;
+    };
+
+}
+
+#endif
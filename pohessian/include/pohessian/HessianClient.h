@@ -23,17 +23,62 @@
 
 #include <string>
 #include <vector>
+#include <set>
+#include <ios>
 #include <ostream>
 
 #include "pohessian/PoHessian.h"
 #include "pohessian/HessianTypes.h"
+#include "pohessian/HessianReplyCache.h"
+#include "pohessian/HessianInternTable.h"
 
+#include "Poco/Types.h"
+#include "Poco/AutoPtr.h"
+#include "Poco/Mutex.h"
+#include "Poco/SharedPtr.h"
+#include "Poco/Timespan.h"
 #include "Poco/URI.h"
 
+namespace Poco {
+    namespace Net {
+        class Context;
+        class StreamSocket;
+    }
+}
+
 namespace PoHessian {
 
     class PoHessian_API HessianClientImpl;
     
+    // Aborts a call from another thread: cancel() shuts the connection of
+    // the call down, so that it fails at once, and the connection is then
+    // dropped rather than kept for another call. A call cancelled before it
+    // got its connection fails without waiting for a reply. shm:// calls
+    // and calls waiting on a coalesced call are not interrupted.
+    class PoHessian_API HessianCancellation {
+    public:
+        
+        HessianCancellation();
+        ~HessianCancellation();
+        
+        void cancel();
+        bool isCancelled() const;
+        
+        // the connection a call waits on, between the two; attach() throws
+        // once cancelled
+        void attach(const Poco::Net::StreamSocket& socket);
+        void detach();
+        
+    private:
+        
+        HessianCancellation(const HessianCancellation&);
+        HessianCancellation& operator=(const HessianCancellation&);
+        
+        mutable Poco::FastMutex _mutex;
+        bool _cancelled;
+        Poco::Net::StreamSocket* _socket;
+    };
+    
     class PoHessian_API HessianClient {
     public:
         
@@ -41,17 +86,124 @@ namespace PoHessian {
             HESSIAN_VERSION_1
         };
         
+        // http[s]://host:port/path, tcp://host:port, unix:///path/to/socket
+        // (with ?transport=http&path=/path for HTTP over it) or shm://name
+        // for the HessianShmChannel "/name"
+        //
+        // https:// needs Poco::Net::initializeSSL() called before the client
+        // is constructed. Its connections use the given TLS context, or the
+        // default client context of Poco's SSLManager; the context gets its
+        // session cache turned on, as resuming TLS sessions needs it.
         HessianClient(const HessianVersion version, const Poco::URI& uri);
+        HessianClient(const HessianVersion version, const Poco::URI& uri, const Poco::AutoPtr<Poco::Net::Context>& context);
+        ~HessianClient();
+        
+        HessianVersion getVersion() const;
+        const Poco::URI& getURI() const;
+        
+        // HTTP request bodies larger than this many bytes are streamed with
+        // chunked transfer encoding while they are being encoded, smaller ones
+        // are staged in memory and sent with a Content-Length; 0 (the default)
+        // always stages the whole body
+        void setChunkedThreshold(const std::streamsize threshold);
+        std::streamsize getChunkedThreshold() const;
+        
+        // advertise "Accept-Encoding: gzip, deflate" and decode compressed
+        // HTTP replies on the fly; on by default
+        void setAcceptCompression(const bool accept);
+        bool getAcceptCompression() const;
+        
+        // HTTP request bodies larger than this many bytes are sent gzipped;
+        // 0 (the default) never compresses
+        void setCompressionThreshold(const std::streamsize threshold);
+        std::streamsize getCompressionThreshold() const;
+        
+        // zlib level from 0 (none) to 9 (best), -1 for the zlib default
+        void setCompressionLevel(const int level);
+        int getCompressionLevel() const;
+        
+        // decode each reply into a HessianArena of its own, see
+        // HessianStreamReader::setUseArena; HTTP, tcp:// and unix:// only,
+        // off by default
+        void setUseArena(const bool useArena);
+        bool getUseArena() const;
+        
+        // read primitive lists of decoded replies into ARRAY values, see
+        // HessianStreamReader::setUseArrays; HTTP, tcp:// and unix://
+        // only, off by default
+        void setUseArrays(const bool useArrays);
+        bool getUseArrays() const;
+        
+        // share the type names, string map keys and fault codes of decoded
+        // replies through this table, see HessianInternTable; one table can
+        // serve every client of the process. HTTP, tcp:// and unix:// only,
+        // none by default
+        void setInternTable(const Poco::SharedPtr<HessianInternTable>& table);
+        const Poco::SharedPtr<HessianInternTable>& getInternTable() const;
+        
+        // bytes of calls and replies on the wire: HTTP bodies after
+        // compression, tcp:// and unix:// streams, shm:// ring contents
+        Poco::UInt64 getBytesSent() const;
+        Poco::UInt64 getBytesReceived() const;
+        
+        // keep-alive connections kept open between calls, shared by copies
+        // of this client; 8 by default, 0 opens a connection per call
+        void setMaxIdleConnections(const std::size_t max);
+        std::size_t getMaxIdleConnections() const;
+        
+        // idle connections older than this are closed instead of reused,
+        // keep it below the server keep-alive timeout; 5 seconds by default
+        void setIdleTimeout(const Poco::Timespan& timeout);
+        Poco::Timespan getIdleTimeout() const;
+        
+        // connections opened so far, compare with the number of calls to
+        // see how well they are reused
+        Poco::UInt64 getConnectionsOpened() const;
+        
+        // https:// connections opened, and how many of them resumed the
+        // TLS session of an earlier one instead of a full handshake
+        Poco::UInt64 getTLSHandshakes() const;
+        Poco::UInt64 getTLSResumedHandshakes() const;
+        
+        // replies of the methods the cache has a time to live for are served
+        // from it; one cache can be shared by several clients of the same
+        // service. None by default
+        void setReplyCache(const Poco::SharedPtr<HessianReplyCache>& cache);
+        const Poco::SharedPtr<HessianReplyCache>& getReplyCache() const;
+        
+        // identical concurrent calls of a coalesced method (same method,
+        // headers and parameters) are sent once and every caller gets the
+        // same reply, shared (see Value::share()), or the same error; off
+        // for every method by default
+        void setCoalesced(const std::string& method, const bool coalesced = true);
+        bool isCoalesced(const std::string& method) const;
+        
+        // calls that waited on an identical call instead of being sent
+        Poco::UInt64 getCoalescedCount() const;
         
         ValuePtr call(const std::string& method);
         ValuePtr call(const std::string& method, const HeaderList& headers);
         ValuePtr call(const std::string& method, const ParameterList& parameters);
         ValuePtr call(const std::string& method, const HeaderList& headers, const ParameterList& parameters);
         ReplyPtr call(const CallPtr& call);
+        // the same, cancelled by cancellation.cancel() from another thread
+        ReplyPtr call(const CallPtr& call, HessianCancellation& cancellation);
         
     protected:
         const HessianVersion _version;
         const Poco::URI _uri;
+        std::streamsize _chunkedThreshold;
+        bool _acceptCompression;
+        std::streamsize _compressionThreshold;
+        int _compressionLevel;
+        bool _useArena;
+        bool _useArrays;
+        Poco::SharedPtr<HessianInternTable> _internTable;
+        std::size_t _maxIdleConnections;
+        Poco::Timespan _idleTimeout;
+        Poco::SharedPtr<HessianReplyCache> _replyCache;
+        std::set<std::string> _coalesced;
+        Poco::SharedPtr<HessianClientImpl> _impl;
     };
 
 }
@@ -0,0 +1,94 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef pohessian_HessianDispatcher_INCLUDED
+#define pohessian_HessianDispatcher_INCLUDED
+
+#include <string>
+#include <map>
+
+#include "pohessian/PoHessian.h"
+#include "pohessian/HessianTypes.h"
+
+#include "Poco/AtomicCounter.h"
+#include "Poco/Mutex.h"
+#include "Poco/SharedPtr.h"
+
+namespace PoHessian {
+
+    // Serves one method. The returned value becomes the reply; throwing a
+    // HessianException sends its code, message and detail back as a fault,
+    // any other exception becomes a "ServiceException" fault. Called from
+    // several threads at once: a value returned to more than one of them,
+    // a constant sample say, must be shared first, see Value::share().
+    class PoHessian_API HessianHandler {
+    public:
+
+        virtual ~HessianHandler();
+
+        virtual ValuePtr handle(const CallPtr& call) = 0;
+    };
+
+    // Maps method names to handlers and turns a decoded call into a reply,
+    // independently of the transport. Thread safe.
+    class PoHessian_API HessianDispatcher {
+    public:
+
+        typedef Poco::SharedPtr<HessianHandler> HandlerPtr;
+        typedef ValuePtr (*Function)(const CallPtr& call);
+
+        HessianDispatcher();
+
+        // registering a method again replaces its handler
+        void registerHandler(const std::string& method, const HandlerPtr& handler);
+        void registerFunction(const std::string& method, const Function function);
+        void unregister(const std::string& method);
+        bool isRegistered(const std::string& method) const;
+
+        // Never throws for a failing handler, the failure is in the reply;
+        // a correlation id header of the call is echoed in the reply, see
+        // HessianPipeline
+        ReplyPtr dispatch(const CallPtr& call);
+
+        // Reply for a request that could not even be decoded
+        ReplyPtr protocolFault(const std::string& message);
+
+        int getCallCount() const;
+        int getFaultCount() const;
+
+    private:
+
+        HessianDispatcher(const HessianDispatcher&);
+        HessianDispatcher& operator=(const HessianDispatcher&);
+
+        HandlerPtr findHandler(const std::string& method) const;
+        ReplyPtr invoke(const CallPtr& call);
+        ReplyPtr fault(const std::string& code, const std::string& message, const ValuePtr& detail);
+
+        mutable Poco::Mutex _mutex;
+        std::map<std::string, HandlerPtr> _handlers;
+        Poco::AtomicCounter _callCount;
+        Poco::AtomicCounter _faultCount;
+    };
+
+}
+
+#endif
@@ -0,0 +1,113 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef pohessian_HessianHedgedClient_INCLUDED
+#define pohessian_HessianHedgedClient_INCLUDED
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+
+#include "pohessian/PoHessian.h"
+#include "pohessian/HessianTypes.h"
+#include "pohessian/HessianClient.h"
+#include "pohessian/HessianStatistics.h"
+
+#include "Poco/Types.h"
+#include "Poco/URI.h"
+#include "Poco/Mutex.h"
+#include "Poco/SharedPtr.h"
+#include "Poco/Timespan.h"
+#include "Poco/ThreadPool.h"
+#include "Poco/AtomicCounter.h"
+
+namespace PoHessian {
+
+    // Calls one of several equivalent replicas and, for methods marked
+    // idempotent, sends a duplicate to the next replica when the first has
+    // not answered within the hedge percentile of that method's observed
+    // latency. The first reply wins, the other attempt is cancelled: its
+    // connection is shut down and dropped, not returned to the pool of its
+    // replica. shm:// replicas and coalesced methods are not cancelled.
+    class PoHessian_API HessianHedgedClient {
+    public:
+
+        HessianHedgedClient(const HessianClient::HessianVersion version, const std::vector<Poco::URI>& uris);
+        ~HessianHedgedClient();
+
+        HessianClient& getReplica(const std::vector<Poco::URI>::size_type index);
+        std::vector<Poco::URI>::size_type getReplicaCount() const;
+
+        // only idempotent methods are ever hedged
+        void setIdempotent(const std::string& method, const bool idempotent = true);
+        bool isIdempotent(const std::string& method) const;
+
+        // hedge after this percentile of the method latency, 95.0 by default
+        void setHedgePercentile(const double percentile);
+        double getHedgePercentile() const;
+        // hedge delay used until a method has enough latency samples
+        void setDefaultHedgeDelay(const Poco::Timespan& delay);
+        Poco::Timespan getDefaultHedgeDelay() const;
+        // the hedge delay never goes below this
+        void setMinimumHedgeDelay(const Poco::Timespan& delay);
+        Poco::Timespan getMinimumHedgeDelay() const;
+        void setMinimumSamples(const Poco::UInt64 samples);
+        Poco::UInt64 getMinimumSamples() const;
+
+        Poco::Timespan getHedgeDelay(const std::string& method) const;
+        LatencyHistogram getLatencyHistogram(const std::string& method) const;
+        Poco::UInt64 getHedgeCount() const;
+        Poco::UInt64 getHedgeWinCount() const;
+
+        ValuePtr call(const std::string& method);
+        ValuePtr call(const std::string& method, const HeaderList& headers);
+        ValuePtr call(const std::string& method, const ParameterList& parameters);
+        ValuePtr call(const std::string& method, const HeaderList& headers, const ParameterList& parameters);
+        ReplyPtr call(const CallPtr& call);
+
+    private:
+
+        friend class HedgedAttempt;
+
+        void recordLatency(const std::string& method, const Poco::Timespan& latency);
+
+        HessianHedgedClient(const HessianHedgedClient&);
+        HessianHedgedClient& operator=(const HessianHedgedClient&);
+
+        std::vector<Poco::SharedPtr<HessianClient> > _replicas;
+        Poco::AtomicCounter _next;
+        Poco::ThreadPool _pool;
+
+        mutable Poco::FastMutex _mutex;
+        std::set<std::string> _idempotent;
+        std::map<std::string, LatencyHistogram> _histograms;
+        double _hedgePercentile;
+        Poco::Timespan _defaultHedgeDelay;
+        Poco::Timespan _minimumHedgeDelay;
+        Poco::UInt64 _minimumSamples;
+        Poco::UInt64 _hedgeCount;
+        Poco::UInt64 _hedgeWinCount;
+    };
+
+}
+
+#endif
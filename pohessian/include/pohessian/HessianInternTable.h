@@ -0,0 +1,71 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef pohessian_HessianInternTable_INCLUDED
+#define pohessian_HessianInternTable_INCLUDED
+
+#include <string>
+#include <map>
+
+#include "pohessian/PoHessian.h"
+#include "pohessian/HessianTypes.h"
+
+#include "Poco/Types.h"
+#include "Poco/Mutex.h"
+
+namespace PoHessian {
+
+    // Shares one STRING value per distinct string among every reader using
+    // the table: list and map type names, string map keys and fault codes.
+    // Equal interned strings are the same value, so they compare by address.
+    // Once maxEntries strings are held, new ones are no longer kept and
+    // come back unshared. Interned values are shared by every reply and
+    // every thread, so they come back frozen. Thread safe.
+    class PoHessian_API HessianInternTable {
+    public:
+
+        HessianInternTable(const std::size_t maxEntries = 4096);
+
+        ValuePtr intern(const std::string& value);
+
+        void clear();
+
+        std::size_t getSize() const;
+        std::size_t getMaxEntries() const;
+        Poco::UInt64 getHitCount() const;
+        // strings looked up for the first time, or after the table was full
+        Poco::UInt64 getMissCount() const;
+
+    private:
+
+        HessianInternTable(const HessianInternTable&);
+        HessianInternTable& operator=(const HessianInternTable&);
+
+        mutable Poco::FastMutex _mutex;
+        const std::size_t _maxEntries;
+        std::map<std::string, ValuePtr> _values;
+        Poco::UInt64 _hitCount;
+        Poco::UInt64 _missCount;
+    };
+
+}
+
+#endif
@@ -0,0 +1,135 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef pohessian_HessianPipeline_INCLUDED
+#define pohessian_HessianPipeline_INCLUDED
+
+#include <string>
+#include <deque>
+#include <map>
+
+#include "pohessian/PoHessian.h"
+#include "pohessian/HessianTypes.h"
+#include "pohessian/HessianClient.h"
+
+#include "Poco/Types.h"
+#include "Poco/URI.h"
+#include "Poco/Net/StreamSocket.h"
+#include "Poco/Net/SocketStream.h"
+
+namespace PoHessian {
+
+    // Writes several calls back-to-back on one persistent tcp:// connection
+    // without waiting for each reply. Replies are matched to the ticket
+    // returned by send(), either in FIFO order or by a correlation id
+    // header echoed back by the server. Not thread safe.
+    class PoHessian_API HessianPipeline {
+    public:
+
+        typedef Poco::UInt64 Ticket;
+
+        enum MatchingMode {
+            // replies come back in the order the calls were sent
+            MATCHING_FIFO,
+            // each call carries a "correlationId" header; a reply carrying
+            // it back is matched by id, a reply without it falls back to FIFO
+            MATCHING_CORRELATION_ID
+        };
+
+        enum FullPolicy {
+            // send() reads the oldest pending reply off the wire to make room
+            FULL_POLICY_BLOCK,
+            // send() throws when max depth calls are already on the wire
+            FULL_POLICY_THROW
+        };
+
+        static const std::string CORRELATION_ID_HEADER;
+
+        HessianPipeline(const HessianClient::HessianVersion version, const Poco::URI& uri,
+                const std::size_t maxDepth = 16,
+                const MatchingMode matchingMode = MATCHING_FIFO,
+                const FullPolicy fullPolicy = FULL_POLICY_BLOCK);
+
+        ~HessianPipeline();
+
+        HessianClient::HessianVersion getVersion() const;
+        const Poco::URI& getURI() const;
+
+        void setMaxDepth(const std::size_t maxDepth);
+        std::size_t getMaxDepth() const;
+        void setMatchingMode(const MatchingMode matchingMode);
+        MatchingMode getMatchingMode() const;
+        void setFullPolicy(const FullPolicy fullPolicy);
+        FullPolicy getFullPolicy() const;
+
+        Ticket send(const CallPtr& call);
+        ReplyPtr receive(const Ticket ticket);
+        ReplyPtr receive();
+
+        // a failed write or read, or a reply for no call in flight, closes
+        // the connection: the calls in flight are lost, but the replies
+        // already read can still be received. close() drops those too.
+        void close();
+
+        // calls written but whose reply has not been read off the wire yet
+        std::size_t getDepth() const;
+        // replies read off the wire but not claimed by receive() yet
+        std::size_t getBufferedCount() const;
+        std::size_t getMaxObservedDepth() const;
+        Poco::UInt64 getSentCount() const;
+        Poco::UInt64 getReceivedCount() const;
+        // replies that had to be buffered because a later ticket was awaited
+        Poco::UInt64 getHeadOfLineStallCount() const;
+        // send() calls that had to drain a reply because the pipeline was full
+        Poco::UInt64 getFullStallCount() const;
+
+    private:
+
+        HessianPipeline(const HessianPipeline&);
+        HessianPipeline& operator=(const HessianPipeline&);
+
+        void connect();
+        void disconnect();
+        void readOne();
+
+        const HessianClient::HessianVersion _version;
+        const Poco::URI _uri;
+        std::size_t _maxDepth;
+        MatchingMode _matchingMode;
+        FullPolicy _fullPolicy;
+
+        Poco::Net::StreamSocket _socket;
+        Poco::Net::SocketOutputStream* _out;
+        Poco::Net::SocketInputStream* _in;
+
+        Ticket _nextTicket;
+        std::deque<Ticket> _pending;
+        std::map<Ticket, ReplyPtr> _buffered;
+
+        std::size_t _maxObservedDepth;
+        Poco::UInt64 _sentCount;
+        Poco::UInt64 _receivedCount;
+        Poco::UInt64 _headOfLineStallCount;
+        Poco::UInt64 _fullStallCount;
+    };
+
+}
+
+#endif
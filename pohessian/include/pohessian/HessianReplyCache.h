@@ -0,0 +1,106 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef pohessian_HessianReplyCache_INCLUDED
+#define pohessian_HessianReplyCache_INCLUDED
+
+#include <string>
+#include <list>
+#include <map>
+
+#include "pohessian/PoHessian.h"
+#include "pohessian/HessianTypes.h"
+
+#include "Poco/Types.h"
+#include "Poco/Mutex.h"
+#include "Poco/Timespan.h"
+#include "Poco/Timestamp.h"
+
+namespace PoHessian {
+
+    // Caches replies of idempotent methods, keyed by a hash of the Hessian 1
+    // encoding of the method and parameters; headers are not part of the
+    // key. Only methods given a time to live are cached, and fault replies
+    // never are. The least recently used entry goes when the cache is full.
+    // Cached replies are shared by every caller and every thread, so their
+    // values and header values are frozen when stored. Thread safe.
+    class PoHessian_API HessianReplyCache {
+    public:
+
+        HessianReplyCache(const std::size_t maxEntries = 1024);
+
+        void setMaxEntries(const std::size_t maxEntries);
+        std::size_t getMaxEntries() const;
+
+        // a zero time to live stops caching the method
+        void setTimeToLive(const std::string& method, const Poco::Timespan& ttl);
+        Poco::Timespan getTimeToLive(const std::string& method) const;
+        bool isCached(const std::string& method) const;
+
+        // Returns a null ReplyPtr on a miss
+        ReplyPtr lookup(const CallPtr& call);
+        void store(const CallPtr& call, const ReplyPtr& reply);
+
+        void invalidate(const CallPtr& call);
+        void invalidate(const std::string& method);
+        void clear();
+
+        std::size_t getSize() const;
+        Poco::UInt64 getHitCount() const;
+        Poco::UInt64 getMissCount() const;
+        // entries dropped to make room
+        Poco::UInt64 getEvictionCount() const;
+        // entries dropped because their time to live was over
+        Poco::UInt64 getExpirationCount() const;
+
+    private:
+
+        struct Entry {
+            Poco::UInt64 hash;
+            std::string key;
+            std::string method;
+            ReplyPtr reply;
+            Poco::Timestamp expires;
+        };
+
+        typedef std::list<Entry> EntryList;
+        typedef std::map<Poco::UInt64, EntryList::iterator> EntryIndex;
+
+        HessianReplyCache(const HessianReplyCache&);
+        HessianReplyCache& operator=(const HessianReplyCache&);
+
+        void erase(const EntryIndex::iterator it);
+
+        mutable Poco::FastMutex _mutex;
+        std::size_t _maxEntries;
+        std::map<std::string, Poco::Timespan> _timeToLive;
+        // most recently used first
+        EntryList _entries;
+        EntryIndex _index;
+        Poco::UInt64 _hitCount;
+        Poco::UInt64 _missCount;
+        Poco::UInt64 _evictionCount;
+        Poco::UInt64 _expirationCount;
+    };
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef pohessian_HessianServer_INCLUDED
+#define pohessian_HessianServer_INCLUDED
+
+#include "pohessian/PoHessian.h"
+#include "pohessian/HessianDispatcher.h"
+
+#include "Poco/SharedPtr.h"
+#include "Poco/ThreadPool.h"
+#include "Poco/Types.h"
+#include "Poco/Net/HTTPServer.h"
+#include "Poco/Net/ServerSocket.h"
+
+namespace PoHessian {
+
+    // Serves Hessian 1 calls POSTed over HTTP, on any request path. Each
+    // call is decoded straight off the request stream and its reply encoded
+    // straight into a chunked response, nothing is buffered in between.
+    // At most maxThreads calls run at once; up to maxQueued more accepted
+    // connections wait for a thread, past that they are refused.
+    class PoHessian_API HessianServer {
+    public:
+
+        HessianServer(const Poco::SharedPtr<HessianDispatcher>& dispatcher,
+                const Poco::Net::ServerSocket& socket,
+                const int maxThreads = 16, const int maxQueued = 64);
+
+        ~HessianServer();
+
+        const Poco::SharedPtr<HessianDispatcher>& getDispatcher() const;
+        int getMaxThreads() const;
+        int getMaxQueued() const;
+
+        void start();
+        // closes the listening socket, calls already running complete
+        void stop();
+
+        Poco::UInt16 getPort() const;
+        int getCurrentThreads() const;
+        int getCurrentConnections() const;
+        int getQueuedConnections() const;
+        int getRefusedConnections() const;
+
+    private:
+
+        HessianServer(const HessianServer&);
+        HessianServer& operator=(const HessianServer&);
+
+        const Poco::SharedPtr<HessianDispatcher> _dispatcher;
+        const int _maxThreads;
+        const int _maxQueued;
+        Poco::ThreadPool _threadPool;
+        Poco::Net::HTTPServer* _server;
+    };
+
+}
+
+#endif
@@ -0,0 +1,85 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef pohessian_HessianShmChannel_INCLUDED
+#define pohessian_HessianShmChannel_INCLUDED
+
+#include <string>
+
+#include "pohessian/PoHessian.h"
+#include "pohessian/HessianTypes.h"
+
+namespace PoHessian {
+
+    class PoHessian_API ShmChannelImpl;
+
+    // Carries Hessian calls and replies between two processes of the same
+    // host through a shared memory segment holding one single producer,
+    // single consumer ring per direction. Calls and replies are encoded
+    // straight into the ring and decoded straight out of it; a side that
+    // finds its ring empty (or full) spins a while, then sleeps on a futex
+    // the other side wakes. The server side creates the segment and one
+    // client at a time attaches to it. Linux only.
+    class PoHessian_API HessianShmChannel {
+    public:
+
+        enum Side {
+            SIDE_SERVER,
+            SIDE_CLIENT
+        };
+
+        static const std::size_t DEFAULT_CAPACITY;
+
+        // name is the POSIX shared memory object name, e.g. "/risk"; the
+        // capacity of each ring is rounded up to a power of two and only
+        // used by the server side
+        HessianShmChannel(const std::string& name, const Side side, const std::size_t capacity = DEFAULT_CAPACITY);
+        ~HessianShmChannel();
+
+        const std::string& getName() const;
+        Side getSide() const;
+        std::size_t getCapacity() const;
+
+        // ring checks made before sleeping on the futex, 1000 by default
+        void setSpinCount(const unsigned int spinCount);
+        unsigned int getSpinCount() const;
+
+        // client side; the second form adds the bytes the call and its reply
+        // took in the rings to sent and received
+        ReplyPtr call(const CallPtr& call);
+        ReplyPtr call(const CallPtr& call, Poco::UInt64& sent, Poco::UInt64& received);
+
+        // server side; readCall() waits for the next call, forgetting a
+        // client that went away in the middle of one
+        CallPtr readCall();
+        void writeReply(const ReplyPtr& reply);
+
+    private:
+
+        HessianShmChannel(const HessianShmChannel&);
+        HessianShmChannel& operator=(const HessianShmChannel&);
+
+        ShmChannelImpl* _impl;
+    };
+
+}
+
+#endif
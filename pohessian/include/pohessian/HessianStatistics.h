@@ -0,0 +1,86 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef pohessian_HessianStatistics_INCLUDED
+#define pohessian_HessianStatistics_INCLUDED
+
+#include <vector>
+
+#include "pohessian/PoHessian.h"
+
+#include "Poco/Types.h"
+#include "Poco/Timespan.h"
+
+namespace PoHessian {
+
+    // Log-linear latency histogram with microsecond resolution. Each power
+    // of two is split in 8 buckets, so percentiles are within 12.5% of the
+    // recorded value. Not thread safe, callers lock around it.
+    class PoHessian_API LatencyHistogram {
+    public:
+
+        LatencyHistogram();
+
+        void record(const Poco::Timespan& latency);
+        void merge(const LatencyHistogram& histogram);
+        void reset();
+
+        Poco::UInt64 getCount() const;
+        Poco::Timespan getMin() const;
+        Poco::Timespan getMax() const;
+        Poco::Timespan getMean() const;
+        // percentile from 0.0 to 100.0, e.g. 99.9
+        Poco::Timespan getPercentile(const double percentile) const;
+
+    private:
+        std::vector<Poco::UInt64> _buckets;
+        Poco::UInt64 _count;
+        Poco::Int64 _min;
+        Poco::Int64 _max;
+        Poco::Int64 _total;
+    };
+
+    // Exponentially weighted moving average of latency; each new sample
+    // counts for weight, the history for 1 - weight. Not thread safe.
+    class PoHessian_API MovingAverage {
+    public:
+
+        MovingAverage(const double weight = 0.3);
+
+        void setWeight(const double weight);
+        double getWeight() const;
+
+        void record(const Poco::Timespan& latency);
+        void reset();
+
+        Poco::UInt64 getCount() const;
+        // zero until the first sample
+        Poco::Timespan getAverage() const;
+
+    private:
+        double _weight;
+        Poco::UInt64 _count;
+        double _average;
+    };
+
+}
+
+#endif
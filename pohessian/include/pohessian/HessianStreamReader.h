@@ -26,6 +26,9 @@
 
 #include "pohessian/PoHessian.h"
 #include "pohessian/HessianTypes.h"
+#include "pohessian/HessianInternTable.h"
+
+#include "Poco/SharedPtr.h"
 
 namespace PoHessian {
 
@@ -36,12 +39,32 @@ namespace PoHessian {
         virtual CallPtr readCall() = 0;
         virtual ReplyPtr readReply() = 0;
 
+        // each reply is read into a HessianArena of its own, its values
+        // valid for as long as the reply or its value is held; off by
+        // default
+        void setUseArena(const bool useArena);
+        bool getUseArena() const;
+
+        // type names, string map keys and fault codes are shared through
+        // this table, which several readers may use at once; none by default
+        void setInternTable(const Poco::SharedPtr<HessianInternTable>& table);
+        const Poco::SharedPtr<HessianInternTable>& getInternTable() const;
+
+        // lists typed "[int", "[long", "[double" and the like, and untyped
+        // lists of one primitive type, are read into ARRAY values; lists
+        // otherwise, off by default
+        void setUseArrays(const bool useArrays);
+        bool getUseArrays() const;
+
     protected:
         
         HessianStreamReader(std::istream& in);
         
         std::istream& _in;
         RefList _refs;
+        bool _useArena;
+        bool _useArrays;
+        Poco::SharedPtr<HessianInternTable> _internTable;
     };
 
 }
@@ -35,6 +35,12 @@ namespace PoHessian {
         virtual void writeValue(const ValuePtr& value) = 0;
         virtual void writeCall(const CallPtr& call) = 0;
         virtual void writeReply(const ReplyPtr& reply) = 0;
+
+        // hashed maps are written in key order, as flat maps always are,
+        // so that equal maps encode the same whatever order they were
+        // built in; off by default, they are written in insertion order
+        void setSortMaps(const bool sortMaps);
+        bool getSortMaps() const;
         
     protected:
         
@@ -42,6 +48,7 @@ namespace PoHessian {
         
         std::ostream& _out;
         RefList _refs;
+        bool _sortMaps;
     };
 
 }
@@ -0,0 +1,77 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef pohessian_HessianTcpServer_INCLUDED
+#define pohessian_HessianTcpServer_INCLUDED
+
+#include "pohessian/PoHessian.h"
+#include "pohessian/HessianDispatcher.h"
+
+#include "Poco/SharedPtr.h"
+#include "Poco/Types.h"
+#include "Poco/Net/ServerSocket.h"
+
+namespace PoHessian {
+
+    class PoHessian_API TcpServerImpl;
+
+    // Serves Hessian 1 calls written back-to-back on persistent raw tcp://
+    // connections, as HessianClient and HessianPipeline send them, or on
+    // unix:// ones when the socket listens on a unix domain address. A single
+    // reactor thread reads and decodes every connection; decoded calls run
+    // on a pool of workers, each with its own queue, that steal from one
+    // another when idle. Replies go back on each connection in the order
+    // its calls came in. A connection is not read any further while
+    // maxPending of its calls are unanswered. Cannot be restarted.
+    class PoHessian_API HessianTcpServer {
+    public:
+
+        HessianTcpServer(const Poco::SharedPtr<HessianDispatcher>& dispatcher,
+                const Poco::Net::ServerSocket& socket,
+                const int workers = 4, const int maxPending = 64);
+
+        ~HessianTcpServer();
+
+        const Poco::SharedPtr<HessianDispatcher>& getDispatcher() const;
+        int getWorkers() const;
+        int getMaxPending() const;
+
+        void start();
+        // closes the listening socket and every connection, calls still
+        // queued are dropped
+        void stop();
+
+        Poco::UInt16 getPort() const;
+        int getCurrentConnections() const;
+        // calls run by another worker than the one they were queued on
+        int getStolenCount() const;
+
+    private:
+
+        HessianTcpServer(const HessianTcpServer&);
+        HessianTcpServer& operator=(const HessianTcpServer&);
+
+        TcpServerImpl* _impl;
+    };
+
+}
+
+#endif
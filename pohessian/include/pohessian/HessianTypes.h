@@ -25,41 +25,284 @@
 #include <vector>
 #include <map>
 #include <algorithm>
+#include <utility>
+#include <cstddef>
+#include <new>
 
 #include "pohessian/PoHessian.h"
 
+#ifdef PoHessian_HAVE_MOVE
+#include <type_traits>
+#endif
+
+#include "Poco/AtomicCounter.h"
 #include "Poco/SharedPtr.h"
 #include "Poco/Types.h"
 #include "Poco/Timestamp.h"
 
 namespace PoHessian {
 
-    template <class C, class RC = Poco::ReferenceCounter>
+    class HessianArena;
+    class Value;
+
+    // size bytes from arena, or from the heap when it is NULL; see
+    // HessianArena
+    PoHessian_API void* arenaAllocate(HessianArena* arena, const std::size_t size);
+
+    // Allocator of the lists, maps and arrays of values: from a
+    // HessianArena, where memory is only given back with the arena, or
+    // from the heap when it is NULL. Containers take their allocator along
+    // when swapped or moved, so memory always goes back where it came from.
+    // A copy of a container allocates from the heap, or before C++11 from
+    // the same arena; assign to a container of the heap to keep elements
+    // past the arena there.
+    template <class T>
+    class ArenaAllocator {
+    public:
+
+        typedef T value_type;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef std::size_t size_type;
+        typedef std::ptrdiff_t difference_type;
+#ifdef PoHessian_HAVE_MOVE
+        typedef std::true_type propagate_on_container_move_assignment;
+        typedef std::true_type propagate_on_container_swap;
+#endif
+
+        template <class U>
+        struct rebind {
+            typedef ArenaAllocator<U> other;
+        };
+
+        ArenaAllocator(HessianArena* arena = NULL) : _arena(arena) {
+        }
+
+        template <class U>
+        ArenaAllocator(const ArenaAllocator<U>& allocator) : _arena(allocator.getArena()) {
+        }
+
+        HessianArena* getArena() const {
+            return _arena;
+        }
+
+#ifdef PoHessian_HAVE_MOVE
+        ArenaAllocator select_on_container_copy_construction() const {
+            return ArenaAllocator();
+        }
+#endif
+
+        pointer address(reference x) const {
+            return &x;
+        }
+
+        const_pointer address(const_reference x) const {
+            return &x;
+        }
+
+        pointer allocate(const size_type n, const void* = NULL) {
+            if (n > max_size())
+                throw std::bad_alloc();
+            if (!_arena)
+                return static_cast<pointer> (::operator new(n * sizeof(T)));
+            return static_cast<pointer> (arenaAllocate(_arena, n * sizeof(T)));
+        }
+
+        void deallocate(pointer p, const size_type) {
+            if (!_arena)
+                ::operator delete(p);
+        }
+
+        size_type max_size() const {
+            return (size_type) -1 / sizeof(T);
+        }
+
+#ifndef PoHessian_HAVE_MOVE
+        void construct(pointer p, const T& value) {
+            new (static_cast<void*> (p)) T(value);
+        }
+
+        void destroy(pointer p) {
+            p->~T();
+        }
+#endif
+
+        bool operator==(const ArenaAllocator& allocator) const {
+            return _arena == allocator._arena;
+        }
+
+        bool operator!=(const ArenaAllocator& allocator) const {
+            return _arena != allocator._arena;
+        }
+
+    private:
+        HessianArena* _arena;
+    };
+
+    // Reference count of an object confined to one thread: plain increments
+    // and decrements until share() is called, atomic ones from then on.
+    // Sharing moves the count to the atomic counter and leaves _local 0.
+    class PoHessian_API LocalReferenceCounter {
+    public:
+
+        LocalReferenceCounter() : _local(1), _shared() {
+        }
+
+        void duplicate() {
+            if (_local)
+                ++_local;
+            else
+                ++_shared;
+        }
+
+        int release() {
+            if (_local)
+                return --_local;
+            return --_shared;
+        }
+
+        int referenceCount() const {
+            return _local ? _local : _shared.value();
+        }
+
+        void share() {
+            if (_local) {
+                _shared = _local;
+                _local = 0;
+            }
+        }
+
+        bool isShared() const {
+            return _local == 0;
+        }
+
+    private:
+        int _local;
+        Poco::AtomicCounter _shared;
+    };
+
+    // Poco::ReferenceCounter, and any other counter, is always atomic
+    template <class RC>
+    inline void shareCounter(RC&) {
+    }
+
+    template <class RC>
+    inline bool isCounterShared(const RC&) {
+        return true;
+    }
+
+    inline void shareCounter(LocalReferenceCounter& rc) {
+        rc.share();
+    }
+
+    inline bool isCounterShared(const LocalReferenceCounter& rc) {
+        return rc.isShared();
+    }
+
+    // Counter of values, headers, calls and replies. Configuring with
+    // --enable-local-reference-count, which defines
+    // PoHessian_LOCAL_REFERENCE_COUNT in the installed pohessian/Config.h
+    // so the library and every program using it agree, makes it a
+    // LocalReferenceCounter for single-threaded pipelines: an object must
+    // then be shared, see Value::share(), before Ptrs to it are copied or
+    // released by another thread.
+#ifdef PoHessian_LOCAL_REFERENCE_COUNT
+    typedef LocalReferenceCounter DefaultReferenceCounter;
+#else
+    typedef Poco::ReferenceCounter DefaultReferenceCounter;
+#endif
+
+    // Base of the objects a Ptr points to. The reference count lives in the
+    // object itself, so wrapping a new object in a Ptr allocates nothing. As
+    // with Poco::ReferenceCounter, a new object starts with one reference,
+    // which the first Ptr adopts; a copy starts over with its own count.
+    template <class RC = DefaultReferenceCounter>
+    class RefCounted {
+    public:
+
+        void duplicate() const {
+            _rc.duplicate();
+        }
+
+        int release() const {
+            return _rc.release();
+        }
+
+        // makes the count atomic when it is not always, so that Ptrs to
+        // this object may be copied and released by any thread
+        void shareCount() const {
+            shareCounter(_rc);
+        }
+
+        bool isCountShared() const {
+            return isCounterShared(_rc);
+        }
+
+    protected:
+
+        RefCounted() : _rc() {
+        }
+
+        RefCounted(const RefCounted&) : _rc() {
+        }
+
+        RefCounted& operator=(const RefCounted&) {
+            return *this;
+        }
+
+        ~RefCounted() {
+        }
+
+    private:
+        mutable RC _rc;
+    };
+
+    // What becomes of an object once its last reference is gone; values
+    // allocated from a HessianArena are destroyed with it instead
+    template <class C>
+    inline void disposeObject(C* object) {
+        delete object;
+    }
+
+    PoHessian_API void disposeObject(Value* value);
+
+    // C must derive from RefCounted<RC>. A Ptr made with strong set to false
+    // shares the object without holding a reference to it; readers use those
+    // for back references so that cyclic graphs can still be released.
+    template <class C, class RC = DefaultReferenceCounter>
     class Ptr {
     public:
 
-        Ptr() : _strong(false), _rc(NULL), _ptr(NULL) {
+        Ptr() : _strong(false), _ptr(NULL) {
         }
 
-        Ptr(C* ptr) : _strong(true), _rc(new RC), _ptr(ptr) {
+        Ptr(C* ptr) : _strong(ptr != NULL), _ptr(ptr) {
         }
 
-        Ptr(const Ptr& ptr) : _strong(ptr._strong), _rc(ptr._rc), _ptr(ptr._ptr) {
+        Ptr(const Ptr& ptr) : _strong(ptr._strong), _ptr(ptr._ptr) {
             if (_strong)
-                _rc->duplicate();
+                counter()->duplicate();
         }
 
-        Ptr(const Ptr& ptr, bool strong) : _strong(strong), _rc(ptr._rc), _ptr(ptr._ptr) {
+        Ptr(const Ptr& ptr, bool strong) : _strong(strong && ptr._ptr != NULL), _ptr(ptr._ptr) {
             if (_strong)
-                _rc->duplicate();
+                counter()->duplicate();
         }
 
+#ifdef PoHessian_HAVE_MOVE
+        // takes over the reference of ptr, which is left NULL
+        Ptr(Ptr&& ptr) noexcept : _strong(ptr._strong), _ptr(ptr._ptr) {
+            ptr._strong = false;
+            ptr._ptr = NULL;
+        }
+#endif
+
         ~Ptr() {
             if (_strong)
-                if (_rc->release() == 0) {
-                    delete _ptr;
-                    delete _rc;
-                }
+                if (counter()->release() == 0)
+                    disposeObject(_ptr);
         }
 
         C* deref() const {
@@ -70,7 +313,6 @@ namespace PoHessian {
 
         void swap(Ptr& ptr) {
             std::swap(_strong, ptr._strong);
-            std::swap(_rc, ptr._rc);
             std::swap(_ptr, ptr._ptr);
         }
 
@@ -80,6 +322,14 @@ namespace PoHessian {
             return *this;
         }
 
+#ifdef PoHessian_HAVE_MOVE
+        Ptr& operator=(Ptr&& ptr) noexcept {
+            Ptr tmp(std::move(ptr));
+            swap(tmp);
+            return *this;
+        }
+#endif
+
         C* operator->() {
             return deref();
         }
@@ -113,8 +363,12 @@ namespace PoHessian {
         }
 
     protected:
+
+        const RefCounted<RC>* counter() const {
+            return _ptr;
+        }
+
         bool _strong;
-        RC* _rc;
         C* _ptr;
     };
 
@@ -127,15 +381,106 @@ namespace PoHessian {
 
     };
 
-    class Value;
-
     typedef Ptr<Value> ValuePtr;
 
-    class PoHessian_API Value {
+    // Entries of a MAP value, in one contiguous array. A flat map keeps them
+    // sorted by key and finds them by binary search; a hashed map keeps them
+    // in insertion order behind an open addressing index on the key hashes.
+    // Keys are told apart by Value::operator<, as with std::map: lists and
+    // maps used as keys compare by address. The auto representation stays
+    // flat up to FLAT_MAX_SIZE entries, then hashes. Lookups by a Value, a
+    // string or an integer allocate nothing.
+    class PoHessian_API ValueMap {
+    public:
+
+        typedef ValuePtr key_type;
+        typedef ValuePtr mapped_type;
+        typedef std::pair<ValuePtr, ValuePtr> value_type;
+        typedef std::vector<value_type, ArenaAllocator<value_type> > Entries;
+        typedef Entries::size_type size_type;
+        // keys must not be changed through an iterator
+        typedef Entries::iterator iterator;
+        typedef Entries::const_iterator const_iterator;
+
+        enum Representation {
+            REPRESENTATION_AUTO,
+            REPRESENTATION_FLAT,
+            REPRESENTATION_HASH
+        };
+
+        static const size_type FLAT_MAX_SIZE = 16;
+
+        // entries and index are allocated from arena, see ArenaAllocator
+        explicit ValueMap(const Representation representation = REPRESENTATION_AUTO, HessianArena* arena = NULL);
+
+        Representation getRepresentation() const;
+        // whether lookups currently go through the hash index
+        bool isHashed() const;
+
+        iterator begin();
+        iterator end();
+        const_iterator begin() const;
+        const_iterator end() const;
+        size_type size() const;
+        bool empty() const;
+
+        void reserve(const size_type n);
+        void clear();
+        void swap(ValueMap& map);
+
+        // does nothing and returns the entry already there when the key is
+        std::pair<iterator, bool> insert(const value_type& entry);
+#ifdef PoHessian_HAVE_MOVE
+        std::pair<iterator, bool> insert(value_type&& entry);
+#endif
+        mapped_type& operator[](const key_type& key);
+
+        iterator find(const key_type& key);
+        const_iterator find(const key_type& key) const;
+        const_iterator find(const Value& key) const;
+        const_iterator find(const std::string& key) const;
+        const_iterator find(const char* key) const;
+        size_type count(const key_type& key) const;
+
+        // entry by entry, in iteration order
+        bool operator<(const ValueMap& map) const;
+
+    private:
+
+        // position of the entry with key, size() when there is none
+        size_type position(const Value& key) const;
+        size_type position(const char* key, const std::size_t size) const;
+        size_type insertPosition(const Value& key, bool& found);
+        // flat maps only, position of the first key not less than key
+        size_type lowerBound(const Value& key) const;
+        size_type lowerBound(const char* key, const std::size_t size) const;
+        void hash(const size_type capacity);
+        void indexEntry(const size_type position);
+
+        Representation _representation;
+        bool _hashed;
+        Entries _entries;
+        // entry position + 1 by key hash, 0 for a free slot; a power of two
+        // in size, at most half full
+        std::vector<Poco::UInt32, ArenaAllocator<Poco::UInt32> > _slots;
+    };
+
+    // A value can be frozen, after which it and every value reachable from
+    // it can no longer change: any number of threads may then read it and
+    // share Ptrs to it without locking, the reference count being atomic.
+    // A frozen value is changed by copy on write: a copy of it is never
+    // frozen and shares its elements, and editAtIndex() or editAtKey() copy
+    // a frozen element in turn, so only the path to a change is copied.
+    class PoHessian_API Value : public RefCounted<> {
     public:
 
-        typedef std::vector<ValuePtr> List;
-        typedef std::map<ValuePtr, ValuePtr, PtrLess<ValuePtr> > Map;
+        typedef std::vector<ValuePtr, ArenaAllocator<ValuePtr> > List;
+        typedef ValueMap Map;
+        // elements of an ARRAY, stored unboxed
+        typedef std::vector<bool, ArenaAllocator<bool> > BooleanArray;
+        typedef std::vector<Poco::Int32, ArenaAllocator<Poco::Int32> > IntArray;
+        typedef std::vector<Poco::Int64, ArenaAllocator<Poco::Int64> > LongArray;
+        typedef std::vector<double, ArenaAllocator<double> > DoubleArray;
 
         enum Type {
             TYPE_NULL,
@@ -150,29 +495,82 @@ namespace PoHessian {
             TYPE_LIST,
             TYPE_MAP,
             TYPE_REMOTE,
-            TYPE_FAULT
+            TYPE_FAULT,
+            // a list whose elements are all BOOLEAN, INTEGER, LONG or
+            // DOUBLE; written like a LIST
+            TYPE_ARRAY
         };
 
+        // a shallow copy: lists, maps and faults share their elements with
+        // value; the copy is not frozen even when value is, and comes from
+        // the heap even when value comes from an arena
         Value(const Value& value);
-        Value(const Type type = TYPE_NULL);
-        Value(const bool boolean);
-        Value(const Poco::Int32 integer);
-        Value(const double value);
-        Value(const Poco::Int64 value, const Type type = TYPE_LONG);
+        // the constructors taking an arena are for the values of a
+        // HessianArena: new (arena) Value(..., arena) allocates the value
+        // and what it holds from it. The two always go together, a value
+        // made with an arena must come from it and the other way round.
+        Value(const Type type = TYPE_NULL, HessianArena* arena = NULL);
+        Value(const bool boolean, HessianArena* arena = NULL);
+        Value(const Poco::Int32 integer, HessianArena* arena = NULL);
+        Value(const double value, HessianArena* arena = NULL);
+        Value(const Poco::Int64 value, const Type type = TYPE_LONG, HessianArena* arena = NULL);
         Value(const Poco::Timestamp dateAsTimestamp);
+        // the std::string, List and Map arguments below are taken by value
+        // and swapped in, so a temporary or a moved-from local costs no copy
         Value(const char* value, const Type type = TYPE_STRING);
-        Value(const std::string& value, const Type type = TYPE_STRING);
-        Value(const List& list, const char* listType = "");
-        Value(const List& list, const std::string& listType = "");
-        Value(const Map& map, const char* mapType = "");
-        Value(const Map& map, const std::string& mapType = "");
+        Value(std::string value, const Type type = TYPE_STRING, HessianArena* arena = NULL);
+        // a LIST, MAP or ARRAY typed by the STRING value name, which is
+        // shared rather than copied (see HessianInternTable); NULL for no
+        // type. An ARRAY also needs the type of its elements.
+        Value(const ValuePtr& name, const Type type, const Type elementType = TYPE_NULL, HessianArena* arena = NULL);
+        Value(List list, const char* listType = "");
+        Value(List list, const std::string& listType = "");
+        Value(Map map, const char* mapType = "");
+        Value(Map map, const std::string& mapType = "");
+        // an empty arrayType writes the ARRAY as an untyped list
+        Value(BooleanArray array, const std::string& arrayType = "[boolean");
+        Value(IntArray array, const std::string& arrayType = "[int");
+        Value(LongArray array, const std::string& arrayType = "[long");
+        Value(DoubleArray array, const std::string& arrayType = "[double");
         Value(const char* remoteType, const char* remoteUrl);
-        Value(const std::string& remoteType, const std::string& remoteUrl);
+        Value(std::string remoteType, std::string remoteUrl, HessianArena* arena = NULL);
         Value(const char* faultCode, const char* faultMessage, const ValuePtr& faultDetail);
-        Value(const std::string& faultCode, const std::string& faultMessage, const ValuePtr& faultDetail);
+        Value(const std::string& faultCode, std::string faultMessage, const ValuePtr& faultDetail);
+        // faultCode is a shared STRING value, like a type name
+        Value(const ValuePtr& faultCode, std::string faultMessage, const ValuePtr& faultDetail, HessianArena* arena = NULL);
+#ifdef PoHessian_HAVE_MOVE
+        // value is left NULL, unless it is frozen and so copied instead
+        Value(Value&& value);
+#endif
+
+        ~Value();
+
+        // new Value(...) allocates from the heap, new (arena) Value(...,
+        // arena) from arena, or from the heap when it is NULL
+        static void* operator new(std::size_t size);
+        static void* operator new(std::size_t size, HessianArena* arena);
+        static void operator delete(void* ptr);
+        static void operator delete(void* ptr, HessianArena* arena);
+
+        Value& operator=(const Value& value);
+#ifdef PoHessian_HAVE_MOVE
+        Value& operator=(Value&& value);
+#endif
 
         Type getType() const;
 
+        // freezes this value and every value reachable from it, sharing
+        // them first; freezing only takes changes away, so a const value
+        // may be frozen too. Not thread safe: freeze a value before sharing
+        // it between threads.
+        void freeze() const;
+        bool isFrozen() const;
+        // shares the count of this value and of every value reachable from
+        // it, type names included, when they are LocalReferenceCounters; a
+        // value already shared stops the walk, so values added to it later
+        // must be shared on their own
+        void share() const;
+
         bool isNull() const;
         bool isBoolean() const;
         bool isInteger() const;
@@ -186,6 +584,7 @@ namespace PoHessian {
         bool isMap() const;
         bool isRemote() const;
         bool isFault() const;
+        bool isArray() const;
 
         bool getBoolean() const;
         Poco::Int32 getInteger() const;
@@ -207,41 +606,127 @@ namespace PoHessian {
         const std::string& getFaultCode() const;
         const std::string& getFaultMessage() const;
         const ValuePtr& getFaultDetail() const;
-
+        const std::string& getArrayType() const;
+        // TYPE_BOOLEAN, TYPE_INTEGER, TYPE_LONG or TYPE_DOUBLE
+        Type getArrayElementType() const;
+        std::size_t getArraySize() const;
+        // each must match the element type
+        const BooleanArray& getBooleanArray() const;
+        const IntArray& getIntArray() const;
+        const LongArray& getLongArray() const;
+        const DoubleArray& getDoubleArray() const;
+
+        // a LIST or an ARRAY
         void reserve(const List::size_type n);
         void add(const List::value_type& value);
+#ifdef PoHessian_HAVE_MOVE
+        void add(List::value_type&& value);
+#endif
         const List::value_type& atIndex(const List::size_type n) const;
+        // the element at n, first replaced by a copy when it is frozen, so
+        // it can be changed; this list must not be frozen
+        ValuePtr editAtIndex(const List::size_type n);
+        // append to an ARRAY of the matching element type
+        void addBoolean(const bool element);
+        void addInteger(const Poco::Int32 element);
+        void addLong(const Poco::Int64 element);
+        void addDouble(const double element);
+        void addBooleans(const bool* elements, const std::size_t count);
+        void addIntegers(const Poco::Int32* elements, const std::size_t count);
+        void addLongs(const Poco::Int64* elements, const std::size_t count);
+        void addDoubles(const double* elements, const std::size_t count);
 
         std::pair<Map::iterator, bool> put(const Map::key_type& key, const Map::mapped_type& value);
+#ifdef PoHessian_HAVE_MOVE
+        std::pair<Map::iterator, bool> put(Map::key_type&& key, Map::mapped_type&& value);
+#endif
+        // a NULL value when there is no such key; none of these allocate
         const Map::mapped_type& atKey(const Map::key_type& key) const;
         const Map::mapped_type& atKey(const Value& key) const;
+        const Map::mapped_type& atKey(const std::string& key) const;
+        const Map::mapped_type& atKey(const char* key) const;
+        const Map::mapped_type& atKey(const bool key) const;
+        const Map::mapped_type& atKey(const Poco::Int32 key) const;
+        const Map::mapped_type& atKey(const Poco::Int64 key) const;
+        const Map::mapped_type& atKey(const double key) const;
+        // as editAtIndex, a NULL value when there is no such key
+        ValuePtr editAtKey(const Map::key_type& key);
+        ValuePtr editAtKey(const std::string& key);
 
         bool operator<(const Value& value) const;
 
+        // structural hash and equality, nested lists and maps included; a
+        // value met again inside itself stands for its depth in the cycle
+        std::size_t hash() const;
+        bool equals(const Value& value) const;
+
         friend std::ostream& operator<<(std::ostream& out, const Value* value);
+        friend void disposeObject(Value* value);
+        friend class HessianArena;
 
     private:
-        Type _type;
-        bool _bool;
-        Poco::Int64 _integer;
-        double _double;
-        std::string _string;
-        std::string _string2;
-        List _list;
-        Map _map;
-        ValuePtr _value;
+
+        // everything wider than a scalar is kept out of line, so that it
+        // does not widen every value: an INTEGER is as small as a pointer
+        // beside the reference count
+        struct ListData;
+        struct MapData;
+        struct RemoteData;
+        struct FaultData;
+        struct ArrayData;
+
+        void checkMutable() const;
+        void construct(const Value& value);
+        void take(Value& value);
+        void destroy();
+
+        std::string& string();
+        const std::string& string() const;
+        ListData& listData();
+        const ListData& listData() const;
+        MapData& mapData();
+        const MapData& mapData() const;
+
+        // only the member matching _type is alive. The bit fields keep
+        // _type and the flags in the word the reference count leaves:
+        // _arena for a value allocated from an arena, which never changes,
+        // _arenaData for what it holds out of line allocated from one,
+        // which moves along with it, and _root for the one value of an arena
+        // that holds a reference to it.
+        Type _type : 8;
+        mutable bool _frozen : 1;
+        bool _arena : 1;
+        bool _arenaData : 1;
+        bool _root : 1;
+        union {
+            bool _bool;
+            Poco::Int64 _integer;
+            double _double;
+            std::string* _string;
+            ListData* _list;
+            MapData* _map;
+            RemoteData* _remote;
+            FaultData* _fault;
+            ArrayData* _array;
+        };
     };
 
     typedef std::vector<ValuePtr> RefList;
 
-    class PoHessian_API Header {
+    class PoHessian_API Header : public RefCounted<> {
     public:
 
-        Header(const std::string& name, const ValuePtr& value);
+        Header(std::string name, const ValuePtr& value);
 
         const std::string& getName() const;
         const ValuePtr& getValue() const;
 
+        // shares this header and its value, see Value::share()
+        void share() const;
+
+        std::size_t hash() const;
+        bool equals(const Header& header) const;
+
     private:
         std::string _name;
         ValuePtr _value;
@@ -253,18 +738,26 @@ namespace PoHessian {
 
     typedef std::vector<ValuePtr> ParameterList;
 
-    class PoHessian_API Call {
+    class PoHessian_API Call : public RefCounted<> {
     public:
 
-        Call(const std::string& method);
-        Call(const std::string& method, const HeaderList& headers);
-        Call(const std::string& method, const ParameterList& parameters);
-        Call(const std::string& method, const HeaderList& headers, const ParameterList& parameters);
+        // the arguments are taken by value and swapped in, as with Value
+        Call(std::string method);
+        Call(std::string method, HeaderList headers);
+        Call(std::string method, ParameterList parameters);
+        Call(std::string method, HeaderList headers, ParameterList parameters);
 
         const std::string& getMethod() const;
         const HeaderList& getHeaders() const;
         const ParameterList& getParameters() const;
 
+        // shares this call, its headers and parameters, see Value::share()
+        void share() const;
+
+        // method, headers and parameters compared structurally
+        std::size_t hash() const;
+        bool equals(const Call& call) const;
+
     private:
         std::string _method;
         HeaderList _headers;
@@ -273,16 +766,29 @@ namespace PoHessian {
 
     typedef Ptr<Call> CallPtr;
 
-    class PoHessian_API Reply {
+    class PoHessian_API Reply : public RefCounted<> {
     public:
 
         Reply(const ValuePtr& value);
-        Reply(const HeaderList& headers, const ValuePtr& value);
+        Reply(HeaderList headers, const ValuePtr& value);
+        // a reply read into arena holds a reference to it, see HessianArena
+        Reply(HeaderList headers, const ValuePtr& value, HessianArena* arena);
+        Reply(const Reply& reply);
+        ~Reply();
+
+        Reply& operator=(const Reply& reply);
 
         const HeaderList& getHeaders() const;
         const ValuePtr& getValue() const;
+        // NULL when the reply was read into the heap
+        HessianArena* getArena() const;
+
+        // shares this reply, its headers and value, see Value::share()
+        void share() const;
 
     private:
+        // released last, once the values in it are
+        Ptr<HessianArena, Poco::ReferenceCounter> _arena;
         HeaderList _headers;
         ValuePtr _value;
     };
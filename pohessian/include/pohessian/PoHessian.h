@@ -21,6 +21,8 @@
 #ifndef pohessian_PoHessian_INCLUDED
 #define	pohessian_PoHessian_INCLUDED
 
+#include "pohessian/Config.h"
+
 #ifdef WIN32
     #ifdef DLL_EXPORT
         #define PoHessian_API __declspec(dllexport)
@@ -33,4 +35,14 @@
     #define PoHessian_API
 #endif
 
+// With a C++11 compiler Ptr and Value get move constructors and assignments,
+// and PoHessian_MOVE hands a local the library is done with to a sink
+// argument; a C++98 compiler copies it as before
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    #define PoHessian_HAVE_MOVE
+    #define PoHessian_MOVE(x) std::move(x)
+#else
+    #define PoHessian_MOVE(x) (x)
+#endif
+
 #endif
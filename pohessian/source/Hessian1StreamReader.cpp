@@ -24,24 +24,43 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <utility>
 #include <istream>
+#include <streambuf>
 
 #include <string.h>
 
 #include "pohessian/HessianTypes.h"
 #include "pohessian/HessianStreamReader.h"
+#include "pohessian/HessianArena.h"
+#include "pohessian/HessianInternTable.h"
 
 #include "Poco/Types.h"
+#include "Poco/ByteOrder.h"
 #include "Poco/Exception.h"
 
 using Poco::UInt8;
 using Poco::UInt16;
 using Poco::Int32;
 using Poco::Int64;
+using Poco::ByteOrder;
 using Poco::Exception;
 
 namespace PoHessian {
 
+    // what the functions decoding one message share
+    struct ReadContext {
+        RefList& refs;
+        // values are allocated from it, NULL for the heap
+        HessianArena* arena;
+        HessianInternTable* interns;
+        // primitive lists are read into ARRAY values
+        bool arrays;
+        // type names and fault codes met so far, when there is no interns
+        std::map<std::string, ValuePtr> names;
+    };
+
     static UInt16 readUInt16(std::istream& in) {
         UInt16 b2 = in.get() & 0xFF;
         UInt16 b1 = in.get() & 0xFF;
@@ -50,25 +69,15 @@ namespace PoHessian {
     }
 
     static Int32 readInt32(std::istream& in) {
-        Int32 b4 = in.get() & 0xFF;
-        Int32 b3 = in.get() & 0xFF;
-        Int32 b2 = in.get() & 0xFF;
-        Int32 b1 = in.get() & 0xFF;
-        Int32 tmp = (b4 << 24) | (b3 << 16) | (b2 << 8) | b1;
-        return tmp;
+        Int32 tmp = 0;
+        in.read(reinterpret_cast<char*> (&tmp), sizeof (tmp));
+        return ByteOrder::fromBigEndian(tmp);
     }
 
     static Int64 readInt64(std::istream& in) {
-        Int64 b8 = in.get() & 0xFF;
-        Int64 b7 = in.get() & 0xFF;
-        Int64 b6 = in.get() & 0xFF;
-        Int64 b5 = in.get() & 0xFF;
-        Int64 b4 = in.get() & 0xFF;
-        Int64 b3 = in.get() & 0xFF;
-        Int64 b2 = in.get() & 0xFF;
-        Int64 b1 = in.get() & 0xFF;
-        Int64 tmp = (b8 << 56) | (b7 << 48) | (b6 << 40) | (b5 << 32) | (b4 << 24) | (b3 << 16) | (b2 << 8) | b1;
-        return tmp;
+        Int64 tmp = 0;
+        in.read(reinterpret_cast<char*> (&tmp), sizeof (tmp));
+        return ByteOrder::fromBigEndian(tmp);
     }
 
     static void readUtf8String(std::istream& in, std::string& dest, UInt16 size) {
@@ -122,55 +131,55 @@ namespace PoHessian {
         return value;
     }
 
-    static ValuePtr readNull(std::istream& in) {
+    static ValuePtr readNull(std::istream& in, HessianArena* arena) {
         if (in.get() != 'N')
             throw Exception("Expected Null (N)");
-        return new Value;
+        return new (arena) Value(Value::TYPE_NULL, arena);
     }
 
-    static ValuePtr readBoolean(std::istream& in) {
+    static ValuePtr readBoolean(std::istream& in, HessianArena* arena) {
         char tag = in.get();
         if (tag != 'T' && tag != 'F')
             throw Exception("Expected Boolean (T|F)");
-        return new Value(tag == 'T');
+        return new (arena) Value(tag == 'T', arena);
     }
 
-    static ValuePtr readInteger(std::istream& in) {
+    static ValuePtr readInteger(std::istream& in, HessianArena* arena) {
         if (in.get() != 'I')
             throw Exception("Expected Integer (I)");
-        return new Value(readInt32(in));
+        return new (arena) Value(readInt32(in), arena);
     }
 
-    static ValuePtr readLong(std::istream& in) {
+    static ValuePtr readLong(std::istream& in, HessianArena* arena) {
         if (in.get() != 'L')
             throw Exception("Expected Long (L)");
-        return new Value(readInt64(in));
+        return new (arena) Value(readInt64(in), Value::TYPE_LONG, arena);
     }
 
-    static ValuePtr readDouble(std::istream& in) {
+    static ValuePtr readDouble(std::istream& in, HessianArena* arena) {
         if (in.get() != 'D')
             throw Exception("Expected Double (D)");
         Int64 src = readInt64(in);
         double tmp;
         memcpy(&tmp, &src, sizeof (Int64));
-        return new Value(tmp);
+        return new (arena) Value(tmp, arena);
     }
 
-    static ValuePtr readDate(std::istream& in) {
+    static ValuePtr readDate(std::istream& in, HessianArena* arena) {
         if (in.get() != 'd')
             throw Exception("Expected Date (d)");
-        return new Value(readInt64(in), Value::TYPE_DATE);
+        return new (arena) Value(readInt64(in), Value::TYPE_DATE, arena);
     }
 
-    static ValuePtr readString(std::istream& in) {
-        return new Value(readString(in, 's', 'S'));
+    static ValuePtr readString(std::istream& in, HessianArena* arena) {
+        return new (arena) Value(readString(in, 's', 'S'), Value::TYPE_STRING, arena);
     }
 
-    static ValuePtr readXml(std::istream& in) {
-        return new Value(readString(in, 'x', 'X'), Value::TYPE_XML);
+    static ValuePtr readXml(std::istream& in, HessianArena* arena) {
+        return new (arena) Value(readString(in, 'x', 'X'), Value::TYPE_XML, arena);
     }
 
-    static ValuePtr readBinary(std::istream& in) {
+    static std::string readBinary(std::istream& in) {
         char tag;
         tag = in.get();
         if (tag != 'b' && tag != 'B')
@@ -195,51 +204,214 @@ namespace PoHessian {
         //value.append(tmp, size);
         for (UInt16 i = 0; i < size; i++)
             value.push_back(in.get());
-        return new Value(value, Value::TYPE_BINARY);
+        return value;
+    }
+
+    static ValuePtr readBinary(std::istream& in, HessianArena* arena) {
+        return new (arena) Value(readBinary(in), Value::TYPE_BINARY, arena);
+    }
+
+    static ValuePtr readValue(std::istream& in, ReadContext& context);
+
+    // type names and fault codes are shared through the intern table, or
+    // at least within the message when there is none; they are not visible
+    // as values, so sharing them is safe either way
+    static ValuePtr readName(std::istream& in, char initial_type, char type, ReadContext& context) {
+        std::string name = initial_type ? readString(in, initial_type, type) : readString(in, type);
+        if (context.interns)
+            return context.interns->intern(name);
+        std::map<std::string, ValuePtr>::iterator it = context.names.lower_bound(name);
+        if (it == context.names.end() || it->first != name)
+            it = context.names.insert(it, std::make_pair(name, ValuePtr(new Value(name))));
+        return it->second;
+    }
+
+    // the element type of an ARRAY for the list type names Java writes for
+    // its primitive arrays, TYPE_NULL for any other
+    static Value::Type arrayElementType(const std::string& name) {
+        if (name == "[int" || name == "[short")
+            return Value::TYPE_INTEGER;
+        if (name == "[long")
+            return Value::TYPE_LONG;
+        if (name == "[double" || name == "[float")
+            return Value::TYPE_DOUBLE;
+        if (name == "[boolean")
+            return Value::TYPE_BOOLEAN;
+        return Value::TYPE_NULL;
+    }
+
+    static Value::Type arrayElementType(const char tag) {
+        switch (tag) {
+            case 'I':
+                return Value::TYPE_INTEGER;
+            case 'L':
+                return Value::TYPE_LONG;
+            case 'D':
+                return Value::TYPE_DOUBLE;
+            case 'T':
+            case 'F':
+                return Value::TYPE_BOOLEAN;
+            default:
+                return Value::TYPE_NULL;
+        }
     }
 
-    static ValuePtr readValue(std::istream& in, RefList& refs);
+    // turns the ARRAY value into a LIST of the elements read so far
+    static void boxArray(ValuePtr& value, const ValuePtr& type, ReadContext& context) {
+        Value list(type, Value::TYPE_LIST, Value::TYPE_NULL, context.arena);
+        list.reserve(value->getArraySize());
+        switch (value->getArrayElementType()) {
+            case Value::TYPE_BOOLEAN:
+                for (std::size_t i = 0; i < value->getArraySize(); i++)
+                    list.add(new (context.arena) Value((bool) value->getBooleanArray()[i], context.arena));
+                break;
+            case Value::TYPE_INTEGER:
+                for (std::size_t i = 0; i < value->getArraySize(); i++)
+                    list.add(new (context.arena) Value(value->getIntArray()[i], context.arena));
+                break;
+            case Value::TYPE_LONG:
+                for (std::size_t i = 0; i < value->getArraySize(); i++)
+                    list.add(new (context.arena) Value(value->getLongArray()[i], Value::TYPE_LONG, context.arena));
+                break;
+            default:
+                for (std::size_t i = 0; i < value->getArraySize(); i++)
+                    list.add(new (context.arena) Value(value->getDoubleArray()[i], context.arena));
+                break;
+        }
+        *value = PoHessian_MOVE(list);
+    }
 
-    static ValuePtr readList(std::istream& in, RefList& refs) {
+    // ARRAY elements are decoded this many at a time
+    static const std::size_t ARRAY_BLOCK_SIZE = 512;
+
+    // reads up to count elements with the given tag straight off the stream
+    // buffer, stopping before any other tag, then byte-swaps the lot into
+    // elements; returns how many there were
+    template <class T, class Bits>
+    static std::size_t readArrayBlock(std::streambuf& buf, const char tag, T* elements, const std::size_t count) {
+        Bits bits[ARRAY_BLOCK_SIZE];
+        std::size_t n = 0;
+        for (; n < count && buf.sgetc() == std::char_traits<char>::to_int_type(tag); n++) {
+            buf.sbumpc();
+            if (buf.sgetn(reinterpret_cast<char*> (&bits[n]), sizeof (Bits)) != (std::streamsize) sizeof (Bits))
+                throw Exception("Unexpected end of stream");
+        }
+        for (std::size_t i = 0; i < n; i++) {
+            Bits tmp = ByteOrder::fromBigEndian(bits[i]);
+            memcpy(&elements[i], &tmp, sizeof (T));
+        }
+        return n;
+    }
+
+    static std::size_t readBooleanBlock(std::streambuf& buf, bool* elements, const std::size_t count) {
+        std::size_t n = 0;
+        for (; n < count; n++) {
+            std::char_traits<char>::int_type tag = buf.sgetc();
+            if (tag != std::char_traits<char>::to_int_type('T') && tag != std::char_traits<char>::to_int_type('F'))
+                break;
+            elements[n] = buf.sbumpc() == std::char_traits<char>::to_int_type('T');
+        }
+        return n;
+    }
+
+    // elements are read unboxed for as long as they all have the element
+    // type; returns false when one that does not is next, and the value
+    // has to become a LIST
+    static bool readArrayElements(std::istream& in, ValuePtr& value, const Value::Type elementType) {
+        std::streambuf& buf = *in.rdbuf();
+        std::size_t n;
+        switch (elementType) {
+            case Value::TYPE_BOOLEAN:
+            {
+                bool elements[ARRAY_BLOCK_SIZE];
+                do {
+                    n = readBooleanBlock(buf, elements, ARRAY_BLOCK_SIZE);
+                    value->addBooleans(elements, n);
+                } while (n == ARRAY_BLOCK_SIZE);
+                break;
+            }
+            case Value::TYPE_INTEGER:
+            {
+                Int32 elements[ARRAY_BLOCK_SIZE];
+                do {
+                    n = readArrayBlock<Int32, Int32>(buf, 'I', elements, ARRAY_BLOCK_SIZE);
+                    value->addIntegers(elements, n);
+                } while (n == ARRAY_BLOCK_SIZE);
+                break;
+            }
+            case Value::TYPE_LONG:
+            {
+                Int64 elements[ARRAY_BLOCK_SIZE];
+                do {
+                    n = readArrayBlock<Int64, Int64>(buf, 'L', elements, ARRAY_BLOCK_SIZE);
+                    value->addLongs(elements, n);
+                } while (n == ARRAY_BLOCK_SIZE);
+                break;
+            }
+            default:
+            {
+                double elements[ARRAY_BLOCK_SIZE];
+                do {
+                    n = readArrayBlock<double, Int64>(buf, 'D', elements, ARRAY_BLOCK_SIZE);
+                    value->addDoubles(elements, n);
+                } while (n == ARRAY_BLOCK_SIZE);
+                break;
+            }
+        }
+        return in.peek() == 'z';
+    }
+
+    static ValuePtr readList(std::istream& in, ReadContext& context) {
         if (in.get() != 'V')
             throw Exception("Expected List (V)");
-        ValuePtr value;
-        if (in.peek() == 't') {
-            std::string type = readString(in, 't');
-            value = new Value(type, Value::TYPE_LIST);
-        } else {
-            value = new Value(Value::TYPE_LIST);
-        }
+        ValuePtr type;
+        if (in.peek() == 't')
+            type = readName(in, 0, 't', context);
         Int32 length = -1;
         if (in.peek() == 'l') {
             if (in.get() != 'l')
                 throw Exception("Expected List length (l)");
             length = readInt32(in);
-            value->reserve(length);
         }
-        refs.push_back(value);
+        Value::Type elementType = Value::TYPE_NULL;
+        if (context.arrays)
+            elementType = !type ? arrayElementType((char) in.peek()) : arrayElementType(type->getString());
+        ValuePtr value;
+        if (elementType != Value::TYPE_NULL)
+            value = new (context.arena) Value(type, Value::TYPE_ARRAY, elementType, context.arena);
+        else
+            value = new (context.arena) Value(type, Value::TYPE_LIST, Value::TYPE_NULL, context.arena);
+        if (length > 0)
+            value->reserve(length);
+        context.refs.push_back(value);
+        if (elementType != Value::TYPE_NULL && !readArrayElements(in, value, elementType))
+            boxArray(value, type, context);
         while (in.peek() != 'z')
-            value->add(readValue(in, refs));
+            value->add(readValue(in, context));
         if (in.get() != 'z')
             throw Exception("Expected end List (z)");
         return value;
     }
 
-    static ValuePtr readMap(std::istream& in, RefList& refs) {
+    static ValuePtr readMap(std::istream& in, ReadContext& context) {
         if (in.get() != 'M')
             throw Exception("Expected Map (M)");
         ValuePtr value;
         if (in.peek() == 't') {
-            std::string type = readString(in, 't');
-            value = new Value(type, Value::TYPE_MAP);
+            ValuePtr type = readName(in, 0, 't', context);
+            value = new (context.arena) Value(type, Value::TYPE_MAP, Value::TYPE_NULL, context.arena);
         } else {
-            value = new Value(Value::TYPE_MAP);
+            value = new (context.arena) Value(Value::TYPE_MAP, context.arena);
         }
-        refs.push_back(value);
+        context.refs.push_back(value);
         while (in.peek() != 'z') {
-            ValuePtr k = readValue(in, refs);
-            ValuePtr v = readValue(in, refs);
-            value->put(k, v);
+            ValuePtr k;
+            if (context.interns && (in.peek() == 's' || in.peek() == 'S'))
+                k = context.interns->intern(readString(in, 's', 'S'));
+            else
+                k = readValue(in, context);
+            ValuePtr v = readValue(in, context);
+            value->put(PoHessian_MOVE(k), PoHessian_MOVE(v));
         }
         if (in.get() != 'z')
             throw Exception("Expected end Map (z)");
@@ -255,87 +427,87 @@ namespace PoHessian {
         return ValuePtr(refs.at(idx), false);
     }
 
-    static ValuePtr readRemote(std::istream& in) {
+    static ValuePtr readRemote(std::istream& in, HessianArena* arena) {
         if (in.get() != 'r')
             throw Exception("Expected Remote (r)");
         std::string type = readString(in, 't');
         std::string url = readString(in, 's', 'S');
-        return new Value(type, url);
+        return new (arena) Value(PoHessian_MOVE(type), PoHessian_MOVE(url), arena);
     }
 
-    static ValuePtr readFault(std::istream& in, RefList& refs) {
+    static ValuePtr readFault(std::istream& in, ReadContext& context) {
         static const std::string fault_property_code("code");
         static const std::string fault_property_message("message");
         static const std::string fault_property_detail("detail");
         if (in.get() != 'f')
             throw Exception("Expected Fault (f)");
-        std::string code;
+        ValuePtr code;
         std::string message;
         ValuePtr detail;
         while (in.peek() != 'z') {
             std::string fault_property = readString(in, 's', 'S');
             if (fault_property == fault_property_code) {
-                code = readString(in, 's', 'S');
+                code = readName(in, 's', 'S', context);
             } else if (fault_property == fault_property_message) {
                 message = readString(in, 's', 'S');
             } else if (fault_property == fault_property_detail) {
-                detail = readValue(in, refs);
+                detail = readValue(in, context);
             }
         }
         if (in.get() != 'z')
             throw Exception("Expected end Fault (z)");
-        return new Value(code, message, detail);
+        return new (context.arena) Value(code, PoHessian_MOVE(message), detail, context.arena);
     }
 
-    static ValuePtr readValue(std::istream& in, RefList& refs) {
+    static ValuePtr readValue(std::istream& in, ReadContext& context) {
         char tag = in.peek();
         switch (tag) {
             case 'N':
-                return readNull(in);
+                return readNull(in, context.arena);
             case 'T':
             case 'F':
-                return readBoolean(in);
+                return readBoolean(in, context.arena);
             case 'I':
-                return readInteger(in);
+                return readInteger(in, context.arena);
             case 'L':
-                return readLong(in);
+                return readLong(in, context.arena);
             case 'D':
-                return readDouble(in);
+                return readDouble(in, context.arena);
             case 'd':
-                return readDate(in);
+                return readDate(in, context.arena);
             case 's':
             case 'S':
-                return readString(in);
+                return readString(in, context.arena);
             case 'x':
             case 'X':
-                return readXml(in);
+                return readXml(in, context.arena);
             case 'b':
             case 'B':
-                return readBinary(in);
+                return readBinary(in, context.arena);
             case 'V':
-                return readList(in, refs);
+                return readList(in, context);
             case 'M':
-                return readMap(in, refs);
+                return readMap(in, context);
             case 'R':
-                return readRef(in, refs);
+                return readRef(in, context.refs);
             case 'r':
-                return readRemote(in);
+                return readRemote(in, context.arena);
             case 'f':
-                return readFault(in, refs);
+                return readFault(in, context);
             default:
                 throw Exception(std::string("Unexpected tag ") + tag);
         }
     }
 
-    static HeaderPtr readHeader(std::istream& in, RefList& refs) {
+    static HeaderPtr readHeader(std::istream& in, ReadContext& context) {
         if (in.peek() != 'H')
             throw Exception("Expected Header (H)");
         std::string name = readString(in, 'H');
-        ValuePtr value = readValue(in, refs);
-        return new Header(name, value);
+        ValuePtr value = readValue(in, context);
+        return new Header(PoHessian_MOVE(name), value);
     }
 
-    static CallPtr readCall(std::istream& in, RefList& refs) {
+    static CallPtr readCall(std::istream& in, ReadContext& context) {
         if (in.get() != 'c')
             throw Exception("Expected Call (c)");
         if (in.get() != (char) 1)
@@ -344,17 +516,17 @@ namespace PoHessian {
             throw Exception("Expected Call minor version (0)");
         HeaderList headers;
         while (in.peek() == 'H')
-            headers.push_back(readHeader(in, refs));
+            headers.push_back(readHeader(in, context));
         std::string method = readString(in, 'm');
         ParameterList parameters;
         while (in.peek() != 'z')
-            parameters.push_back(readValue(in, refs));
+            parameters.push_back(readValue(in, context));
         if (in.get() != 'z')
             throw Exception("Expected end Call (z)");
-        return new Call(method, headers, parameters);
+        return new Call(PoHessian_MOVE(method), PoHessian_MOVE(headers), PoHessian_MOVE(parameters));
     }
 
-    static ReplyPtr readReply(std::istream& in, RefList& refs) {
+    static ReplyPtr readReply(std::istream& in, ReadContext& context) {
         if (in.get() != 'r')
             throw Exception("Expected Reply (r)");
         if (in.get() != (char) 1)
@@ -363,11 +535,18 @@ namespace PoHessian {
             throw Exception("Expected Reply minor version (0)");
         HeaderList headers;
         while (in.peek() == 'H')
-            headers.push_back(readHeader(in, refs));
-        ValuePtr value = readValue(in, refs);
+            headers.push_back(readHeader(in, context));
+        if (context.arena)
+            context.arena->reserveRoot();
+        ValuePtr value = readValue(in, context);
         if (in.get() != 'z')
             throw Exception("Expected end Reply (z)");
-        return new Reply(headers, value);
+        if (context.arena) {
+            if (!!value)
+                context.arena->adoptRoot(value.deref());
+            return new Reply(PoHessian_MOVE(headers), value, context.arena);
+        }
+        return new Reply(PoHessian_MOVE(headers), value);
     }
 
     Hessian1StreamReader::Hessian1StreamReader(std::istream& in)
@@ -375,15 +554,26 @@ namespace PoHessian {
     }
 
     ValuePtr Hessian1StreamReader::readValue() {
-        return PoHessian::readValue(_in, _refs);
+        ReadContext context = { _refs, NULL, _internTable.get(), _useArrays };
+        return PoHessian::readValue(_in, context);
     }
 
     CallPtr Hessian1StreamReader::readCall() {
-        return PoHessian::readCall(_in, _refs);
+        ReadContext context = { _refs, NULL, _internTable.get(), _useArrays };
+        return PoHessian::readCall(_in, context);
     }
 
+    // the values of an arena are only valid for as long as the reply, so
+    // its back references are kept for this reply alone
     ReplyPtr Hessian1StreamReader::readReply() {
-        return PoHessian::readReply(_in, _refs);
+        if (!_useArena) {
+            ReadContext context = { _refs, NULL, _internTable.get(), _useArrays };
+            return PoHessian::readReply(_in, context);
+        }
+        HessianArenaPtr arena = new HessianArena;
+        RefList refs;
+        ReadContext context = { refs, arena.deref(), _internTable.get(), _useArrays };
+        return PoHessian::readReply(_in, context);
     }
 
 }
@@ -25,6 +25,7 @@
 #include <string>
 #include <vector>
 #include <ostream>
+#include <algorithm>
 
 #include <string.h>
 
@@ -32,12 +33,14 @@
 #include "pohessian/HessianStreamWriter.h"
 
 #include "Poco/Types.h"
+#include "Poco/ByteOrder.h"
 #include "Poco/Exception.h"
 
 using Poco::UInt8;
 using Poco::UInt16;
 using Poco::Int32;
 using Poco::Int64;
+using Poco::ByteOrder;
 using Poco::Exception;
 
 namespace PoHessian {
@@ -51,23 +54,45 @@ namespace PoHessian {
     }
 
     static void writeInt32(std::ostream& out, Int32 value) {
-        Int32 tmp = value;
-        out << (char) ((tmp >> 24) & 0xFF);
-        out << (char) ((tmp >> 16) & 0xFF);
-        out << (char) ((tmp >> 8) & 0xFF);
-        out << (char) (tmp & 0xFF);
+        Int32 tmp = ByteOrder::toBigEndian(value);
+        out.write(reinterpret_cast<const char*> (&tmp), sizeof (tmp));
     }
 
     static void writeInt64(std::ostream& out, Int64 value) {
-        Int64 tmp = value;
-        out << (char) ((tmp >> 56) & 0xFF);
-        out << (char) ((tmp >> 48) & 0xFF);
-        out << (char) ((tmp >> 40) & 0xFF);
-        out << (char) ((tmp >> 32) & 0xFF);
-        out << (char) ((tmp >> 24) & 0xFF);
-        out << (char) ((tmp >> 16) & 0xFF);
-        out << (char) ((tmp >> 8) & 0xFF);
-        out << (char) (tmp & 0xFF);
+        Int64 tmp = ByteOrder::toBigEndian(value);
+        out.write(reinterpret_cast<const char*> (&tmp), sizeof (tmp));
+    }
+
+    // ARRAY elements are encoded this many at a time
+    static const std::size_t ARRAY_BLOCK_SIZE = 512;
+
+    // byte-swaps the elements a block at a time, each behind its tag, and
+    // writes every block at once
+    template <class T, class Bits>
+    static void writeArrayBlocks(std::ostream& out, const char tag, const std::vector<T, ArenaAllocator<T> >& elements) {
+        char records[ARRAY_BLOCK_SIZE * (1 + sizeof (Bits))];
+        for (std::size_t i = 0; i < elements.size(); i += ARRAY_BLOCK_SIZE) {
+            std::size_t n = std::min(ARRAY_BLOCK_SIZE, elements.size() - i);
+            char* record = records;
+            for (std::size_t j = 0; j < n; j++, record += 1 + sizeof (Bits)) {
+                Bits tmp;
+                memcpy(&tmp, &elements[i + j], sizeof (Bits));
+                tmp = ByteOrder::toBigEndian(tmp);
+                record[0] = tag;
+                memcpy(record + 1, &tmp, sizeof (Bits));
+            }
+            out.write(records, record - records);
+        }
+    }
+
+    static void writeBooleanBlocks(std::ostream& out, const Value::BooleanArray& elements) {
+        char records[ARRAY_BLOCK_SIZE];
+        for (std::size_t i = 0; i < elements.size(); i += ARRAY_BLOCK_SIZE) {
+            std::size_t n = std::min(ARRAY_BLOCK_SIZE, elements.size() - i);
+            for (std::size_t j = 0; j < n; j++)
+                records[j] = elements[i + j] ? 'T' : 'F';
+            out.write(records, n);
+        }
     }
 
     static RefList::size_type vectorIndexOf(const RefList& refs, const ValuePtr& ref) {
@@ -220,32 +245,87 @@ namespace PoHessian {
             out << tmp.substr(pos, count);
     }
 
-    static void writeValue(std::ostream& out, RefList& refs, const ValuePtr& value);
+    struct WriteContext {
+        RefList& refs;
+        // hashed maps are written in key order too, as flat ones are
+        bool sortMaps;
+    };
+
+    // orders map entries as a flat map keeps them, a NULL key first
+    struct EntryKeyLess {
+
+        bool operator()(const Value::Map::value_type* e1, const Value::Map::value_type* e2) const {
+            if (!e2->first)
+                return false;
+            if (!e1->first)
+                return true;
+            return *e1->first < *e2->first;
+        }
+
+    };
 
-    static void writeList(std::ostream& out, RefList& refs, const ValuePtr& value) {
+    static void writeValue(std::ostream& out, WriteContext& context, const ValuePtr& value);
+
+    static void writeList(std::ostream& out, WriteContext& context, const ValuePtr& value) {
         out << 'V';
         if (!value->getListType().empty()) {
             writeString(out, 't', value->getListType());
         }
         out << 'l';
         writeInt32(out, value->getListSize());
-        refs.push_back(value);
+        context.refs.push_back(value);
         const Value::List& list = value->getList();
         for (Value::List::const_iterator it = list.begin(); it != list.end(); it++)
-            writeValue(out, refs, *it);
+            writeValue(out, context, *it);
         out << 'z';
     }
 
-    static void writeMap(std::ostream& out, RefList& refs, const ValuePtr& value) {
+    // the same bytes as a LIST of BOOLEAN, INTEGER, LONG or DOUBLE values
+    static void writeArray(std::ostream& out, WriteContext& context, const ValuePtr& value) {
+        out << 'V';
+        if (!value->getArrayType().empty())
+            writeString(out, 't', value->getArrayType());
+        out << 'l';
+        writeInt32(out, value->getArraySize());
+        context.refs.push_back(value);
+        switch (value->getArrayElementType()) {
+            case Value::TYPE_BOOLEAN:
+                writeBooleanBlocks(out, value->getBooleanArray());
+                break;
+            case Value::TYPE_INTEGER:
+                writeArrayBlocks<Int32, Int32>(out, 'I', value->getIntArray());
+                break;
+            case Value::TYPE_LONG:
+                writeArrayBlocks<Int64, Int64>(out, 'L', value->getLongArray());
+                break;
+            default:
+                writeArrayBlocks<double, Int64>(out, 'D', value->getDoubleArray());
+                break;
+        }
+        out << 'z';
+    }
+
+    static void writeMap(std::ostream& out, WriteContext& context, const ValuePtr& value) {
         out << 'M';
         if (!value->getMapType().empty())
             writeString(out, 't', value->getMapType());
-        refs.push_back(value);
+        context.refs.push_back(value);
         const Value::Map& map = value->getMap();
-        for (Value::Map::const_iterator it = map.begin(); it != map.end(); it++) {
-            Value::Map::value_type entry = *it;
-            writeValue(out, refs, entry.first);
-            writeValue(out, refs, entry.second);
+        if (context.sortMaps && map.isHashed()) {
+            std::vector<const Value::Map::value_type*> entries;
+            entries.reserve(map.size());
+            for (Value::Map::const_iterator it = map.begin(); it != map.end(); it++)
+                entries.push_back(&*it);
+            std::sort(entries.begin(), entries.end(), EntryKeyLess());
+            for (std::vector<const Value::Map::value_type*>::const_iterator it = entries.begin(); it != entries.end(); it++) {
+                writeValue(out, context, (*it)->first);
+                writeValue(out, context, (*it)->second);
+            }
+        } else {
+            for (Value::Map::const_iterator it = map.begin(); it != map.end(); it++) {
+                writeValue(out, context, it->first);
+                writeValue(out, context, it->second);
+            }
         }
         out << 'z';
     }
@@ -261,7 +341,7 @@ namespace PoHessian {
         writeString(out, 's', 'S', value->getRemoteUrl());
     }
 
-    static void writeFault(std::ostream& out, RefList& refs, const ValuePtr& value) {
+    static void writeFault(std::ostream& out, WriteContext& context, const ValuePtr& value) {
         static const std::string fault_property_code("code");
         static const std::string fault_property_message("message");
         static const std::string fault_property_detail("detail");
@@ -271,11 +351,11 @@ namespace PoHessian {
         writeString(out, 's', 'S', fault_property_message);
         writeString(out, 's', 'S', value->getFaultMessage());
         writeString(out, 's', 'S', fault_property_detail);
-        writeValue(out, refs, value->getFaultDetail());
+        writeValue(out, context, value->getFaultDetail());
         out << 'z';
     }
 
-    static void writeValue(std::ostream& out, RefList& refs, const ValuePtr& value) {
+    static void writeValue(std::ostream& out, WriteContext& context, const ValuePtr& value) {
         if (!value || value->isNull()) {
             writeNull(out);
             return;
@@ -307,27 +387,36 @@ namespace PoHessian {
                 break;
             case Value::TYPE_LIST:
             {
-                Int32 idx = vectorIndexOf(refs, value);
+                Int32 idx = vectorIndexOf(context.refs, value);
                 if (idx != -1)
                     writeRef(out, idx);
                 else
-                    writeList(out, refs, value);
+                    writeList(out, context, value);
                 break;
             }
             case Value::TYPE_MAP:
             {
-                Int32 idx = vectorIndexOf(refs, value);
+                Int32 idx = vectorIndexOf(context.refs, value);
+                if (idx != -1)
+                    writeRef(out, idx);
+                else
+                    writeMap(out, context, value);
+                break;
+            }
+            case Value::TYPE_ARRAY:
+            {
+                Int32 idx = vectorIndexOf(context.refs, value);
                 if (idx != -1)
                     writeRef(out, idx);
                 else
-                    writeMap(out, refs, value);
+                    writeArray(out, context, value);
                 break;
             }
             case Value::TYPE_REMOTE:
                 writeRemote(out, value);
                 break;
             case Value::TYPE_FAULT:
-                writeFault(out, refs, value);
+                writeFault(out, context, value);
                 break;
             default:
                 throw Exception("Unknow type");
@@ -335,29 +424,29 @@ namespace PoHessian {
         }
     }
 
-    static void writeHeader(std::ostream& out, RefList& refs, const HeaderPtr& header) {
+    static void writeHeader(std::ostream& out, WriteContext& context, const HeaderPtr& header) {
         writeString(out, 'H', header->getName());
-        writeValue(out, refs, header->getValue());
+        writeValue(out, context, header->getValue());
     }
 
-    static void writeCall(std::ostream& out, RefList& refs, const CallPtr& call) {
+    static void writeCall(std::ostream& out, WriteContext& context, const CallPtr& call) {
         out << 'c' << (char) 1 << (char) 0;
         const HeaderList& headers = call->getHeaders();
         for (HeaderList::const_iterator it = headers.begin(); it != headers.end(); it++)
-            writeHeader(out, refs, *it);
+            writeHeader(out, context, *it);
         writeString(out, 'm', call->getMethod());
         const ParameterList& parameters = call->getParameters();
         for (ParameterList::const_iterator it = parameters.begin(); it != parameters.end(); it++)
-            writeValue(out, refs, *it);
+            writeValue(out, context, *it);
         out << 'z';
     }
 
-    static void writeReply(std::ostream& out, RefList& refs, const ReplyPtr& reply) {
+    static void writeReply(std::ostream& out, WriteContext& context, const ReplyPtr& reply) {
         out << 'r' << (char) 1 << (char) 0;
         const HeaderList& headers = reply->getHeaders();
         for (HeaderList::const_iterator it = headers.begin(); it != headers.end(); it++)
-            writeHeader(out, refs, *it);
-        writeValue(out, refs, reply->getValue());
+            writeHeader(out, context, *it);
+        writeValue(out, context, reply->getValue());
         out << 'z';
     }
 
@@ -366,15 +455,18 @@ namespace PoHessian {
     }
 
     void Hessian1StreamWriter::writeValue(const ValuePtr& value) {
-        PoHessian::writeValue(_out, _refs, value);
+        WriteContext context = { _refs, _sortMaps };
+        PoHessian::writeValue(_out, context, value);
     }
 
     void Hessian1StreamWriter::writeCall(const CallPtr& call) {
-        PoHessian::writeCall(_out, _refs, call);
+        WriteContext context = { _refs, _sortMaps };
+        PoHessian::writeCall(_out, context, call);
     }
 
     void Hessian1StreamWriter::writeReply(const ReplyPtr& reply) {
-        PoHessian::writeReply(_out, _refs, reply);
+        WriteContext context = { _refs, _sortMaps };
+        PoHessian::writeReply(_out, context, reply);
     }
 
 }
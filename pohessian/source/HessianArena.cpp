@@ -0,0 +1,206 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "pohessian/HessianArena.h"
+
+#include "conf.h"
+
+#include <algorithm>
+#include <new>
+
+#include "pohessian/HessianTypes.h"
+
+#include "Poco/Types.h"
+
+using Poco::Int64;
+
+namespace PoHessian {
+
+    // In front of every block, to chain them; sized and aligned like the
+    // most demanding member of the values
+    union BlockHeader {
+        char* block;
+        Int64 integer;
+        double real;
+    };
+
+    // In front of the values of a block, the first of which is the root
+    // in the first block: from there the root finds its arena
+    struct HessianArena::ValueBlock {
+        ValueBlock* next;
+        HessianArena* arena;
+        std::size_t size;
+        std::size_t used;
+
+        Value* slots() {
+            return static_cast<Value*> (static_cast<void*> (this + 1));
+        }
+    };
+
+    static std::size_t align(const std::size_t size) {
+        return (size + sizeof(BlockHeader) - 1) / sizeof(BlockHeader) * sizeof(BlockHeader);
+    }
+
+    void* arenaAllocate(HessianArena* arena, const std::size_t size) {
+        if (!arena)
+            return ::operator new(size);
+        return arena->allocate(size);
+    }
+
+    static const std::size_t FIRST_BLOCK_SIZE = 512;
+    static const std::size_t FIRST_VALUE_COUNT = 16;
+
+    HessianArena::HessianArena(const std::size_t blockSize)
+    : _blockSize(std::max(align(blockSize), FIRST_BLOCK_SIZE)),
+    _nextBlockSize(FIRST_BLOCK_SIZE),
+    _blocks(NULL),
+    _blockCount(0),
+    _next(NULL),
+    _end(NULL),
+    _bytesAllocated(0),
+    _firstValues(NULL),
+    _values(NULL),
+    _valueCount(0),
+    _rootReserved(false),
+    _rootAllocated(false) {
+    }
+
+    // every value goes before any memory does, as values may still
+    // release each other when destroyed
+    HessianArena::~HessianArena() {
+        if (_rootAllocated)
+            rootSlot()->_root = false;
+        for (ValueBlock* block = _firstValues; block; block = block->next) {
+            Value* slots = block->slots();
+            for (std::size_t i = block == _firstValues && !_rootAllocated ? 1 : 0; i < block->used; i++)
+                slots[i].~Value();
+        }
+        while (_firstValues) {
+            ValueBlock* next = _firstValues->next;
+            ::operator delete(_firstValues);
+            _firstValues = next;
+        }
+        while (_blocks) {
+            char* previous = static_cast<BlockHeader*> (static_cast<void*> (_blocks))->block;
+            delete[] _blocks;
+            _blocks = previous;
+        }
+    }
+
+    // returns the usable part of a new block of size bytes
+    char* HessianArena::newBlock(const std::size_t size) {
+        char* block = new char[sizeof(BlockHeader) + size];
+        static_cast<BlockHeader*> (static_cast<void*> (block))->block = _blocks;
+        _blocks = block;
+        _blockCount++;
+        return block + sizeof(BlockHeader);
+    }
+
+    void* HessianArena::allocate(const std::size_t size) {
+        std::size_t aligned = align(size);
+        _bytesAllocated += aligned;
+        if (aligned <= (std::size_t) (_end - _next)) {
+            void* ptr = _next;
+            _next += aligned;
+            return ptr;
+        }
+        // larger objects get a block of their own, the current one is kept
+        if (aligned > _blockSize / 4)
+            return newBlock(aligned);
+        while (_nextBlockSize < aligned)
+            _nextBlockSize *= 2;
+        _next = newBlock(_nextBlockSize);
+        _end = _next + _nextBlockSize;
+        _nextBlockSize = std::min(_nextBlockSize * 2, _blockSize);
+        void* ptr = _next;
+        _next += aligned;
+        return ptr;
+    }
+
+    void* HessianArena::allocateValue() {
+        if (!_values) {
+            _firstValues = _values = static_cast<ValueBlock*> (::operator new(sizeof(ValueBlock) + FIRST_VALUE_COUNT * sizeof(Value)));
+            _values->next = NULL;
+            _values->arena = this;
+            _values->size = FIRST_VALUE_COUNT;
+            // the root slot
+            _values->used = 1;
+            _blockCount++;
+        }
+        _bytesAllocated += sizeof(Value);
+        _valueCount++;
+        if (_rootReserved) {
+            _rootReserved = false;
+            _rootAllocated = true;
+            return rootSlot();
+        }
+        if (_values->used == _values->size) {
+            std::size_t size = std::min(_values->size * 2, std::max(_blockSize / sizeof(Value), FIRST_VALUE_COUNT));
+            ValueBlock* block = static_cast<ValueBlock*> (::operator new(sizeof(ValueBlock) + size * sizeof(Value)));
+            block->next = NULL;
+            block->arena = this;
+            block->size = size;
+            block->used = 0;
+            _values->next = block;
+            _values = block;
+            _blockCount++;
+        }
+        return _values->slots() + _values->used++;
+    }
+
+    void HessianArena::reserveRoot() {
+        if (!_rootAllocated)
+            _rootReserved = true;
+    }
+
+    bool HessianArena::adoptRoot(Value* value) {
+        if (!_rootAllocated || value != rootSlot())
+            return false;
+        if (!value->_root) {
+            value->_root = true;
+            duplicate();
+        }
+        return true;
+    }
+
+    void HessianArena::releaseRoot(Value* root) {
+        HessianArena* arena = (static_cast<ValueBlock*> (static_cast<void*> (root)) - 1)->arena;
+        if (arena->release() == 0)
+            delete arena;
+    }
+
+    Value* HessianArena::rootSlot() const {
+        return _firstValues->slots();
+    }
+
+    std::size_t HessianArena::getBlockCount() const {
+        return _blockCount;
+    }
+
+    std::size_t HessianArena::getBytesAllocated() const {
+        return _bytesAllocated;
+    }
+
+    std::size_t HessianArena::getValueCount() const {
+        return _valueCount;
+    }
+
+}
@@ -0,0 +1,259 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "pohessian/HessianBalancedClient.h"
+
+#include "conf.h"
+#include "callvalue.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "pohessian/HessianTypes.h"
+#include "pohessian/HessianClient.h"
+#include "pohessian/HessianStatistics.h"
+
+#include "Poco/Exception.h"
+#include "Poco/Types.h"
+#include "Poco/URI.h"
+#include "Poco/Mutex.h"
+#include "Poco/Random.h"
+#include "Poco/Timespan.h"
+#include "Poco/Timestamp.h"
+
+using Poco::Exception;
+using Poco::UInt32;
+using Poco::UInt64;
+using Poco::URI;
+using Poco::FastMutex;
+using Poco::Timespan;
+using Poco::Timestamp;
+
+namespace PoHessian {
+
+    HessianBalancedClient::HessianBalancedClient(const HessianClient::HessianVersion version, const std::vector<URI>& uris)
+    : _mutex(),
+    _endpoints(),
+    _random(),
+    _failureThreshold(5),
+    _ejectionTime(10 * Timespan::SECONDS),
+    _maxEjectionTime(5 * Timespan::MINUTES),
+    _ejectionCount(0),
+    _probeCount(0) {
+        if (uris.empty())
+            throw Exception("At least one endpoint URI is required");
+        for (std::vector<URI>::const_iterator it = uris.begin(); it != uris.end(); it++) {
+            Endpoint endpoint;
+            endpoint.client = new HessianClient(version, *it);
+            endpoint.outstanding = 0;
+            endpoint.failures = 0;
+            endpoint.ejected = false;
+            endpoint.probing = false;
+            endpoint.ejectionTime = _ejectionTime;
+            _endpoints.push_back(endpoint);
+        }
+        _random.seed();
+    }
+
+    HessianBalancedClient::~HessianBalancedClient() {
+    }
+
+    HessianClient& HessianBalancedClient::getEndpoint(const std::vector<URI>::size_type index) {
+        return *_endpoints.at(index).client;
+    }
+
+    std::vector<URI>::size_type HessianBalancedClient::getEndpointCount() const {
+        return _endpoints.size();
+    }
+
+    void HessianBalancedClient::setFailureThreshold(const unsigned int failures) {
+        if (failures == 0)
+            throw Exception("Failure threshold must be at least 1");
+        FastMutex::ScopedLock lock(_mutex);
+        _failureThreshold = failures;
+    }
+
+    unsigned int HessianBalancedClient::getFailureThreshold() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _failureThreshold;
+    }
+
+    void HessianBalancedClient::setEjectionTime(const Timespan& time) {
+        FastMutex::ScopedLock lock(_mutex);
+        _ejectionTime = time;
+    }
+
+    Timespan HessianBalancedClient::getEjectionTime() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _ejectionTime;
+    }
+
+    void HessianBalancedClient::setMaxEjectionTime(const Timespan& time) {
+        FastMutex::ScopedLock lock(_mutex);
+        _maxEjectionTime = time;
+    }
+
+    Timespan HessianBalancedClient::getMaxEjectionTime() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _maxEjectionTime;
+    }
+
+    void HessianBalancedClient::setLatencyWeight(const double weight) {
+        FastMutex::ScopedLock lock(_mutex);
+        for (std::vector<Endpoint>::iterator it = _endpoints.begin(); it != _endpoints.end(); it++)
+            it->latency.setWeight(weight);
+    }
+
+    double HessianBalancedClient::getLatencyWeight() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _endpoints.front().latency.getWeight();
+    }
+
+    unsigned int HessianBalancedClient::getOutstanding(const std::vector<URI>::size_type index) const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _endpoints.at(index).outstanding;
+    }
+
+    Timespan HessianBalancedClient::getLatencyAverage(const std::vector<URI>::size_type index) const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _endpoints.at(index).latency.getAverage();
+    }
+
+    bool HessianBalancedClient::isEjected(const std::vector<URI>::size_type index) const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _endpoints.at(index).ejected;
+    }
+
+    UInt64 HessianBalancedClient::getEjectionCount() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _ejectionCount;
+    }
+
+    UInt64 HessianBalancedClient::getProbeCount() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _probeCount;
+    }
+
+    std::vector<HessianBalancedClient::Endpoint>::size_type HessianBalancedClient::pick() {
+        typedef std::vector<Endpoint>::size_type size_type;
+        FastMutex::ScopedLock lock(_mutex);
+        Timestamp now;
+        std::vector<size_type> healthy;
+        size_type fallback = 0;
+        for (size_type i = 0; i < _endpoints.size(); i++) {
+            Endpoint& endpoint = _endpoints[i];
+            if (!endpoint.ejected) {
+                healthy.push_back(i);
+            } else if (!endpoint.probing && endpoint.ejectedUntil <= now) {
+                // ejection is over, this call is the probe
+                endpoint.probing = true;
+                endpoint.outstanding++;
+                _probeCount++;
+                return i;
+            } else if (!_endpoints[fallback].ejected || endpoint.ejectedUntil < _endpoints[fallback].ejectedUntil) {
+                fallback = i;
+            }
+        }
+        size_type chosen;
+        if (healthy.empty()) {
+            // everything is ejected, trying the one coming back first beats
+            // failing every call
+            chosen = fallback;
+        } else if (healthy.size() == 1) {
+            chosen = healthy[0];
+        } else {
+            size_type a = _random.next((UInt32) healthy.size());
+            size_type b = _random.next((UInt32) healthy.size() - 1);
+            if (b >= a)
+                b++;
+            const Endpoint& first = _endpoints[healthy[a]];
+            const Endpoint& second = _endpoints[healthy[b]];
+            // endpoints without samples yet look free, so they get some
+            double firstCost = (first.latency.getAverage().totalMicroseconds() + 1.0) * (first.outstanding + 1);
+            double secondCost = (second.latency.getAverage().totalMicroseconds() + 1.0) * (second.outstanding + 1);
+            chosen = firstCost <= secondCost ? healthy[a] : healthy[b];
+        }
+        _endpoints[chosen].outstanding++;
+        return chosen;
+    }
+
+    void HessianBalancedClient::succeeded(const std::vector<Endpoint>::size_type index, const Timespan& latency) {
+        FastMutex::ScopedLock lock(_mutex);
+        Endpoint& endpoint = _endpoints[index];
+        endpoint.outstanding--;
+        endpoint.latency.record(latency);
+        endpoint.failures = 0;
+        if (endpoint.ejected) {
+            endpoint.ejected = false;
+            endpoint.probing = false;
+            endpoint.ejectionTime = _ejectionTime;
+        }
+    }
+
+    void HessianBalancedClient::failed(const std::vector<Endpoint>::size_type index) {
+        FastMutex::ScopedLock lock(_mutex);
+        Endpoint& endpoint = _endpoints[index];
+        endpoint.outstanding--;
+        endpoint.failures++;
+        if (endpoint.probing) {
+            endpoint.probing = false;
+            endpoint.ejectionTime = std::min(_maxEjectionTime, endpoint.ejectionTime + endpoint.ejectionTime);
+            endpoint.ejectedUntil = Timestamp() + endpoint.ejectionTime.totalMicroseconds();
+        } else if (!endpoint.ejected && endpoint.failures >= _failureThreshold) {
+            endpoint.ejected = true;
+            endpoint.ejectionTime = _ejectionTime;
+            endpoint.ejectedUntil = Timestamp() + endpoint.ejectionTime.totalMicroseconds();
+            _ejectionCount++;
+        }
+    }
+
+    ValuePtr HessianBalancedClient::call(const std::string& method) {
+        return PoHessian::callValue(*this, method, HeaderList(), ParameterList());
+    }
+
+    ValuePtr HessianBalancedClient::call(const std::string& method, const HeaderList& headers) {
+        return PoHessian::callValue(*this, method, headers, ParameterList());
+    }
+
+    ValuePtr HessianBalancedClient::call(const std::string& method, const ParameterList& parameters) {
+        return PoHessian::callValue(*this, method, HeaderList(), parameters);
+    }
+
+    ValuePtr HessianBalancedClient::call(const std::string& method, const HeaderList& headers, const ParameterList& parameters) {
+        return PoHessian::callValue(*this, method, headers, parameters);
+    }
+
+    ReplyPtr HessianBalancedClient::call(const CallPtr& call) {
+        std::vector<Endpoint>::size_type index = pick();
+        Timestamp start;
+        ReplyPtr reply;
+        try {
+            reply = _endpoints[index].client->call(call);
+        } catch (...) {
+            failed(index);
+            throw;
+        }
+        succeeded(index, Timespan(start.elapsed()));
+        return reply;
+    }
+
+}
@@ -21,20 +21,37 @@
 #include "pohessian/HessianClient.h"
 
 #include "conf.h"
+#include "callvalue.h"
 
 #include <string>
 #include <vector>
+#include <set>
+#include <map>
+#include <exception>
 #include <iostream>
 #include <sstream>
+#include <streambuf>
+#include <algorithm>
+#include <limits>
+#include <utility>
 #include <typeinfo>
 
 #include "pohessian/HessianTypes.h"
+#include "pohessian/HessianReplyCache.h"
+#include "pohessian/HessianShmChannel.h"
 #include "pohessian/Hessian1StreamReader.h"
 #include "pohessian/Hessian1StreamWriter.h"
 
 #include "Poco/Exception.h"
 #include "Poco/String.h"
-#include "Poco/StreamCopier.h"
+#include "Poco/Types.h"
+#include "Poco/Mutex.h"
+#include "Poco/Event.h"
+#include "Poco/SharedPtr.h"
+#include "Poco/Timespan.h"
+#include "Poco/Timestamp.h"
+#include "Poco/InflatingStream.h"
+#include "Poco/DeflatingStream.h"
 #include "Poco/URI.h"
 
 #include "Poco/Net/HTTPClientSession.h"
@@ -42,12 +59,30 @@
 #include "Poco/Net/HTTPMessage.h"
 #include "Poco/Net/HTTPResponse.h"
 #include "Poco/Net/Socket.h"
+#include "Poco/Net/SocketDefs.h"
+#include "Poco/Net/SocketImpl.h"
 #include "Poco/Net/SocketAddress.h"
 #include "Poco/Net/StreamSocket.h"
 #include "Poco/Net/SocketStream.h"
+#ifdef HAVE_POCO_NET_HTTPSCLIENTSESSION_H
+#include "Poco/Net/Context.h"
+#include "Poco/Net/HTTPSClientSession.h"
+#include "Poco/Net/SecureStreamSocket.h"
+#include "Poco/Net/Session.h"
+#include "Poco/Net/SSLManager.h"
+#endif
 
 using Poco::Exception;
-using Poco::StreamCopier;
+using Poco::UInt64;
+using Poco::FastMutex;
+using Poco::Event;
+using Poco::SharedPtr;
+using Poco::Timespan;
+using Poco::Timestamp;
+using Poco::InflatingInputStream;
+using Poco::InflatingStreamBuf;
+using Poco::DeflatingOutputStream;
+using Poco::DeflatingStreamBuf;
 using Poco::URI;
 
 using Poco::Net::HTTPClientSession;
@@ -60,91 +95,1100 @@ using Poco::Net::StreamSocket;
 using Poco::Net::SocketStream;
 using Poco::Net::SocketInputStream;
 using Poco::Net::SocketOutputStream;
+#ifdef HAVE_POCO_NET_HTTPSCLIENTSESSION_H
+using Poco::Net::Context;
+using Poco::Net::HTTPSClientSession;
+using Poco::Net::SecureStreamSocket;
+using Poco::Net::Session;
+using Poco::Net::SSLManager;
+#endif
 
 using Poco::icompare;
 
 namespace PoHessian {
 
-    static void throwHessianExceptionIfFault(const ValuePtr& value) {
-        if (!value || !value->isFault()) return;
-        throw HessianException(value->getFaultCode(), value->getFaultMessage(), value->getFaultDetail());
+    HessianCancellation::HessianCancellation()
+    : _cancelled(false),
+    _socket(NULL) {
     }
 
-    static ReplyPtr callHessian1Http(const URI& uri, const CallPtr& call) {
-        HTTPClientSession session(uri.getHost(), uri.getPort());
-        HTTPRequest request(HTTPRequest::HTTP_POST, uri.getPathEtc(), HTTPMessage::HTTP_1_1);
-        if (false) {
-            request.setChunkedTransferEncoding(true);
-            std::ostream& request_out = session.sendRequest(request);
-            Hessian1StreamWriter hessian_writer(request_out);
-            hessian_writer.writeCall(call);
-            request_out.flush();
+    HessianCancellation::~HessianCancellation() {
+        delete _socket;
+    }
+
+    // The socket is shut down rather than closed: its descriptor stays
+    // valid for the thread blocked on it, which then fails at once. Going
+    // below the socket classes keeps a TLS connection from being written
+    // to by two threads.
+    void HessianCancellation::cancel() {
+        FastMutex::ScopedLock lock(_mutex);
+        _cancelled = true;
+        if (_socket && _socket->impl()->sockfd() != POCO_INVALID_SOCKET)
+            ::shutdown(_socket->impl()->sockfd(), 2);
+    }
+
+    bool HessianCancellation::isCancelled() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _cancelled;
+    }
+
+    void HessianCancellation::attach(const StreamSocket& socket) {
+        FastMutex::ScopedLock lock(_mutex);
+        if (_cancelled) throw Exception("Call cancelled");
+        delete _socket;
+        _socket = NULL;
+        _socket = new StreamSocket(socket);
+    }
+
+    void HessianCancellation::detach() {
+        FastMutex::ScopedLock lock(_mutex);
+        delete _socket;
+        _socket = NULL;
+    }
+
+    // Keeps a connection attached to the cancellation of its call, if any,
+    // while the call waits on it
+    class CancellationScope {
+    public:
+
+        CancellationScope(HessianCancellation* cancellation, const StreamSocket& socket)
+        : _cancellation(cancellation) {
+            if (_cancellation)
+                _cancellation->attach(socket);
+        }
+
+        ~CancellationScope() {
+            if (_cancellation)
+                _cancellation->detach();
+        }
+
+    private:
+
+        HessianCancellation* _cancellation;
+    };
+
+    static bool isCancelled(const HessianCancellation* cancellation) {
+        return cancellation && cancellation->isCancelled();
+    }
+
+    // A connection the server closed while it sat idle reads as readable
+    static bool isStale(StreamSocket& socket) {
+        try {
+            return socket.poll(Timespan(0), Socket::SELECT_READ);
+        } catch (Exception&) {
+            return true;
+        }
+    }
+
+    static bool isStale(HTTPClientSession& session) {
+        return !session.connected() || isStale(session.socket());
+    }
+
+    // Idle connections of one kind, most recently used last so the ones
+    // that timed out are pruned from the front. Callers lock around it.
+    template <class C>
+    class IdleConnections {
+    public:
+
+        IdleConnections()
+        : _idle() {
+        }
+
+        ~IdleConnections() {
+            clear();
+        }
+
+        C* take(const Timespan& idleTimeout) {
+            prune(idleTimeout);
+            while (!_idle.empty()) {
+                C* connection = _idle.back().first;
+                _idle.pop_back();
+                if (!isStale(*connection))
+                    return connection;
+                delete connection;
+            }
+            return NULL;
+        }
+
+        void put(C* connection, const std::size_t max) {
+            if (_idle.size() >= max) {
+                delete connection;
+                return;
+            }
+            _idle.push_back(std::make_pair(connection, Timestamp()));
+        }
+
+        void clear() {
+            for (typename std::vector<Entry>::iterator it = _idle.begin(); it != _idle.end(); it++)
+                delete it->first;
+            _idle.clear();
+        }
+
+    private:
+
+        typedef std::pair<C*, Timestamp> Entry;
+
+        IdleConnections(const IdleConnections&);
+        IdleConnections& operator=(const IdleConnections&);
+
+        void prune(const Timespan& idleTimeout) {
+            typename std::vector<Entry>::iterator it = _idle.begin();
+            while (it != _idle.end() && it->second.isElapsed(idleTimeout.totalMicroseconds())) {
+                delete it->first;
+                it++;
+            }
+            _idle.erase(_idle.begin(), it);
+        }
+
+        std::vector<Entry> _idle;
+    };
+
+    // One call on the wire with the callers waiting for its outcome.
+    class InFlightCall {
+    public:
+
+        InFlightCall(const CallPtr& call)
+        : _call(call),
+        _event(false),
+        _reply(),
+        _error() {
+        }
+
+        const CallPtr& getCall() const {
+            return _call;
+        }
+
+        void succeeded(const ReplyPtr& reply) {
+            _reply = reply;
+            _event.set();
+        }
+
+        void failed(const Exception& e) {
+            _error = e.clone();
+            _event.set();
+        }
+
+        ReplyPtr wait() {
+            _event.wait();
+            if (!_error.isNull())
+                _error->rethrow();
+            return _reply;
+        }
+
+    private:
+        CallPtr _call;
+        Event _event;
+        ReplyPtr _reply;
+        SharedPtr<Exception> _error;
+    };
+
+    class HessianClientImpl {
+    public:
+
+        HessianClientImpl()
+        : _mutex(),
+        _bytesSent(0),
+        _bytesReceived(0),
+        _connectionsOpened(0),
+        _idleSessions(),
+        _idleSockets(),
+        _inFlight(),
+        _coalescedCount(0),
+        _shmChannel(),
+#ifdef HAVE_POCO_NET_HTTPSCLIENTSESSION_H
+        _tlsContext(),
+        _tlsSession(),
+#endif
+        _tlsHandshakes(0),
+        _tlsResumedHandshakes(0) {
+        }
+
+        void addTraffic(const UInt64 sent, const UInt64 received) {
+            FastMutex::ScopedLock lock(_mutex);
+            _bytesSent += sent;
+            _bytesReceived += received;
+        }
+
+        UInt64 getBytesSent() const {
+            FastMutex::ScopedLock lock(_mutex);
+            return _bytesSent;
+        }
+
+        UInt64 getBytesReceived() const {
+            FastMutex::ScopedLock lock(_mutex);
+            return _bytesReceived;
+        }
+
+        void connectionOpened() {
+            FastMutex::ScopedLock lock(_mutex);
+            _connectionsOpened++;
+        }
+
+        UInt64 getConnectionsOpened() const {
+            FastMutex::ScopedLock lock(_mutex);
+            return _connectionsOpened;
+        }
+
+        HTTPClientSession* takeSession(const Timespan& idleTimeout) {
+            FastMutex::ScopedLock lock(_mutex);
+            return _idleSessions.take(idleTimeout);
+        }
+
+        void putSession(HTTPClientSession* session, const std::size_t max) {
+            FastMutex::ScopedLock lock(_mutex);
+            _idleSessions.put(session, max);
+        }
+
+        StreamSocket* takeSocket(const Timespan& idleTimeout) {
+            FastMutex::ScopedLock lock(_mutex);
+            return _idleSockets.take(idleTimeout);
+        }
+
+        void putSocket(StreamSocket* socket, const std::size_t max) {
+            FastMutex::ScopedLock lock(_mutex);
+            _idleSockets.put(socket, max);
+        }
+
+        // when one idle connection turns out dead the server most likely
+        // dropped them all, e.g. it restarted
+        void clearIdle() {
+            FastMutex::ScopedLock lock(_mutex);
+            _idleSessions.clear();
+            _idleSockets.clear();
+        }
+
+        // Returns true when the caller must send the call itself and land
+        // it afterwards, false when an identical call already is on the wire
+        bool takeOff(const CallPtr& call, const std::size_t hash, SharedPtr<InFlightCall>& flight) {
+            FastMutex::ScopedLock lock(_mutex);
+            std::pair<InFlightMap::iterator, InFlightMap::iterator> range = _inFlight.equal_range(hash);
+            for (InFlightMap::iterator it = range.first; it != range.second; it++) {
+                if (it->second->getCall()->equals(*call)) {
+                    flight = it->second;
+                    _coalescedCount++;
+                    return false;
+                }
+            }
+            flight = new InFlightCall(call);
+            _inFlight.insert(std::make_pair(hash, flight));
+            return true;
+        }
+
+        // later identical calls go on the wire again
+        void land(const std::size_t hash, const SharedPtr<InFlightCall>& flight) {
+            FastMutex::ScopedLock lock(_mutex);
+            std::pair<InFlightMap::iterator, InFlightMap::iterator> range = _inFlight.equal_range(hash);
+            for (InFlightMap::iterator it = range.first; it != range.second; it++) {
+                if (it->second.get() == flight.get()) {
+                    _inFlight.erase(it);
+                    return;
+                }
+            }
+        }
+
+        UInt64 getCoalescedCount() const {
+            FastMutex::ScopedLock lock(_mutex);
+            return _coalescedCount;
+        }
+
+        // the channel serializes calls itself, every thread shares it
+        SharedPtr<HessianShmChannel> getShmChannel(const std::string& name) {
+            FastMutex::ScopedLock lock(_mutex);
+            if (_shmChannel.isNull()) {
+                _shmChannel = new HessianShmChannel(name, HessianShmChannel::SIDE_CLIENT);
+                _connectionsOpened++;
+            }
+            return _shmChannel;
+        }
+
+#ifdef HAVE_POCO_NET_HTTPSCLIENTSESSION_H
+        const Context::Ptr& getTLSContext() const {
+            return _tlsContext;
+        }
+
+        // https:// clients only, set once by the constructor
+        void setTLSContext(const Context::Ptr& context) {
+            _tlsContext = context;
+        }
+
+        // the TLS session of the last connection, offered to resume on the
+        // next one so it skips the full handshake
+        Session::Ptr getTLSSession() const {
+            FastMutex::ScopedLock lock(_mutex);
+            return _tlsSession;
+        }
+
+        void setTLSSession(const Session::Ptr& session) {
+            FastMutex::ScopedLock lock(_mutex);
+            _tlsSession = session;
+        }
+#endif
+
+        void tlsHandshake(const bool resumed) {
+            FastMutex::ScopedLock lock(_mutex);
+            _tlsHandshakes++;
+            if (resumed)
+                _tlsResumedHandshakes++;
+        }
+
+        UInt64 getTLSHandshakes() const {
+            FastMutex::ScopedLock lock(_mutex);
+            return _tlsHandshakes;
+        }
+
+        UInt64 getTLSResumedHandshakes() const {
+            FastMutex::ScopedLock lock(_mutex);
+            return _tlsResumedHandshakes;
+        }
+
+        void dropShmChannel(const SharedPtr<HessianShmChannel>& channel) {
+            FastMutex::ScopedLock lock(_mutex);
+            if (_shmChannel.get() == channel.get())
+                _shmChannel = NULL;
+        }
+
+    private:
+
+        typedef std::multimap<std::size_t, SharedPtr<InFlightCall> > InFlightMap;
+
+        mutable FastMutex _mutex;
+        UInt64 _bytesSent;
+        UInt64 _bytesReceived;
+        UInt64 _connectionsOpened;
+        IdleConnections<HTTPClientSession> _idleSessions;
+        IdleConnections<StreamSocket> _idleSockets;
+        InFlightMap _inFlight;
+        UInt64 _coalescedCount;
+        SharedPtr<HessianShmChannel> _shmChannel;
+#ifdef HAVE_POCO_NET_HTTPSCLIENTSESSION_H
+        Context::Ptr _tlsContext;
+        Session::Ptr _tlsSession;
+#endif
+        UInt64 _tlsHandshakes;
+        UInt64 _tlsResumedHandshakes;
+    };
+
+    // Forwards everything written to it to another stream, counting the
+    // bytes on the way.
+    class CountingOutputStreamBuf : public std::streambuf {
+    public:
+
+        CountingOutputStreamBuf()
+        : _out(NULL),
+        _count(0) {
+        }
+
+        void setTarget(std::ostream& out) {
+            _out = &out;
+        }
+
+        std::streamsize getCount() const {
+            return _count;
+        }
+
+    protected:
+
+        int overflow(int c) {
+            if (c == traits_type::eof())
+                return traits_type::not_eof(c);
+            char ch = traits_type::to_char_type(c);
+            return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+        }
+
+        std::streamsize xsputn(const char* s, std::streamsize n) {
+            if (!_out || !_out->write(s, n))
+                throw Exception("Request write error");
+            _count += n;
+            return n;
+        }
+
+        int sync() {
+            if (_out)
+                _out->flush();
+            return 0;
+        }
+
+    private:
+        std::ostream* _out;
+        std::streamsize _count;
+    };
+
+    // Reads from another stream, counting the bytes on the way. Only what is
+    // already buffered upstream is taken at once so the reader never waits
+    // for bytes the reply does not need yet.
+    class CountingInputStreamBuf : public std::streambuf {
+    public:
+
+        CountingInputStreamBuf(std::istream& in)
+        : _in(in),
+        _count(0) {
+            setg(_buffer, _buffer, _buffer);
+        }
+
+        std::streamsize getCount() const {
+            return _count;
+        }
+
+    protected:
+
+        int underflow() {
+            std::streamsize n = _in.readsome(_buffer, sizeof (_buffer));
+            if (n <= 0) {
+                int c = _in.get();
+                if (c == traits_type::eof())
+                    return traits_type::eof();
+                _buffer[0] = traits_type::to_char_type(c);
+                n = 1;
+            }
+            _count += n;
+            setg(_buffer, _buffer, _buffer + n);
+            return traits_type::to_int_type(_buffer[0]);
+        }
+
+    private:
+        std::istream& _in;
+        std::streamsize _count;
+        char _buffer[4096];
+    };
+
+    // Stages an HTTP request body in memory until it grows past the chunked
+    // threshold, then switches the request to chunked transfer encoding and
+    // streams the rest straight into the session while the call is still
+    // being encoded. Bodies past the compression threshold are gzipped.
+    class HTTPRequestBodyStreamBuf : public std::streambuf {
+    public:
+
+        HTTPRequestBodyStreamBuf(HTTPClientSession& session, HTTPRequest& request,
+                const std::streamsize chunkedThreshold,
+                const std::streamsize compressionThreshold,
+                const int compressionLevel)
+        : _session(session),
+        _request(request),
+        _chunkedThreshold(chunkedThreshold),
+        _compressionThreshold(compressionThreshold),
+        _compressionLevel(compressionLevel),
+        _memory(),
+        _wireBuf(),
+        _wire(&_wireBuf),
+        _deflater(NULL),
+        _sink(NULL) {
+            setp(_buffer, _buffer + sizeof (_buffer));
+        }
+
+        ~HTTPRequestBodyStreamBuf() {
+            delete _deflater;
+        }
+
+        // Returns the number of body bytes that went on the wire
+        std::streamsize send() {
+            drain();
+            if (_sink) {
+                if (_deflater)
+                    _deflater->close();
+                _wire.flush();
+            } else {
+                if (mustCompress(_memory.length())) {
+                    std::ostringstream compressed;
+                    DeflatingOutputStream deflater(compressed, DeflatingStreamBuf::STREAM_GZIP, _compressionLevel);
+                    deflater.write(_memory.data(), _memory.length());
+                    deflater.close();
+                    _memory = compressed.str();
+                    _request.set("Content-Encoding", "gzip");
+                }
+                _request.setContentLength(_memory.length());
+                _wireBuf.setTarget(_session.sendRequest(_request));
+                _wire.write(_memory.data(), _memory.length());
+                _wire.flush();
+            }
+            return _wireBuf.getCount();
+        }
+
+    protected:
+
+        int overflow(int c) {
+            drain();
+            if (c != traits_type::eof()) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() {
+            drain();
+            return 0;
+        }
+
+    private:
+
+        bool mustCompress(const std::streamsize length) const {
+            return _compressionThreshold > 0 && length > _compressionThreshold;
+        }
+
+        void drain() {
+            std::streamsize n = pptr() - pbase();
+            if (n == 0)
+                return;
+            // with both thresholds set, stage until both decisions are known
+            std::streamsize stageLimit = _chunkedThreshold > 0 ? std::max(_chunkedThreshold, _compressionThreshold) : 0;
+            if (!_sink && stageLimit > 0 && (std::streamsize) _memory.length() + n > stageLimit) {
+                _request.setChunkedTransferEncoding(true);
+                if (mustCompress(_memory.length() + n))
+                    _request.set("Content-Encoding", "gzip");
+                _wireBuf.setTarget(_session.sendRequest(_request));
+                if (mustCompress(_memory.length() + n)) {
+                    _deflater = new DeflatingOutputStream(_wire, DeflatingStreamBuf::STREAM_GZIP, _compressionLevel);
+                    _sink = _deflater;
+                } else {
+                    _sink = &_wire;
+                }
+                _sink->write(_memory.data(), _memory.length());
+                std::string().swap(_memory);
+            }
+            if (_sink)
+                _sink->write(pbase(), n);
+            else
+                _memory.append(pbase(), n);
+            setp(_buffer, _buffer + sizeof (_buffer));
+        }
+
+        HTTPClientSession& _session;
+        HTTPRequest& _request;
+        const std::streamsize _chunkedThreshold;
+        const std::streamsize _compressionThreshold;
+        const int _compressionLevel;
+        std::string _memory;
+        CountingOutputStreamBuf _wireBuf;
+        std::ostream _wire;
+        DeflatingOutputStream* _deflater;
+        std::ostream* _sink;
+        char _buffer[4096];
+    };
+
+    static bool isUnixURI(const URI& uri) {
+        return icompare(uri.getScheme(), "UNIX") == 0;
+    }
+
+    static std::string queryParameter(const URI& uri, const std::string& name, const std::string& defaultValue) {
+        const std::string query = uri.getRawQuery();
+        std::string::size_type start = 0;
+        while (start < query.length()) {
+            std::string::size_type end = query.find('&', start);
+            if (end == std::string::npos)
+                end = query.length();
+            std::string parameter = query.substr(start, end - start);
+            std::string::size_type equal = parameter.find('=');
+            std::string key;
+            URI::decode(parameter.substr(0, equal), key);
+            if (key == name) {
+                std::string value;
+                if (equal != std::string::npos)
+                    URI::decode(parameter.substr(equal + 1), value);
+                return value;
+            }
+            start = end + 1;
+        }
+        return defaultValue;
+    }
+
+    // unix:///path/to/socket carries raw Hessian framing like tcp://, add
+    // ?transport=http&path=/service to speak HTTP over the socket instead
+    static bool isHttpURI(const URI& uri) {
+        if (isUnixURI(uri)) {
+            std::string transport = queryParameter(uri, "transport", "raw");
+            if (icompare(transport, "http") == 0)
+                return true;
+            if (icompare(transport, "raw") != 0)
+                throw Exception("Invalid unix transport: " + transport);
+            return false;
+        }
+        return icompare(uri.getScheme(), "HTTP") == 0 || icompare(uri.getScheme(), "HTTPS") == 0;
+    }
+
+    static SocketAddress socketAddress(const URI& uri) {
+        if (isUnixURI(uri)) {
+#ifdef HAVE_POCO_UNIX_LOCAL
+            return SocketAddress(SocketAddress::UNIX_LOCAL, uri.getPath());
+#else
+            throw Exception("Unix domain sockets are not supported by this Poco");
+#endif
+        }
+        return SocketAddress(uri.getHost(), uri.getPort());
+    }
+
+    static ReplyPtr readHessian1HttpReply(const HessianClient& client, HTTPResponse& response, std::istream& response_in) {
+        std::string encoding = response.get("Content-Encoding", "");
+        if (encoding.empty() || icompare(encoding, "identity") == 0) {
+            Hessian1StreamReader hessian_reader(response_in);
+            hessian_reader.setUseArena(client.getUseArena());
+            hessian_reader.setUseArrays(client.getUseArrays());
+            hessian_reader.setInternTable(client.getInternTable());
+            return hessian_reader.readReply();
+        } else if (icompare(encoding, "gzip") == 0 || icompare(encoding, "x-gzip") == 0) {
+            InflatingInputStream inflater(response_in, InflatingStreamBuf::STREAM_GZIP);
+            Hessian1StreamReader hessian_reader(inflater);
+            hessian_reader.setUseArena(client.getUseArena());
+            hessian_reader.setUseArrays(client.getUseArrays());
+            hessian_reader.setInternTable(client.getInternTable());
+            return hessian_reader.readReply();
+        } else if (icompare(encoding, "deflate") == 0) {
+            InflatingInputStream inflater(response_in, InflatingStreamBuf::STREAM_ZLIB);
+            Hessian1StreamReader hessian_reader(inflater);
+            hessian_reader.setUseArena(client.getUseArena());
+            hessian_reader.setUseArrays(client.getUseArrays());
+            hessian_reader.setInternTable(client.getInternTable());
+            return hessian_reader.readReply();
         } else {
-            std::stringstream memory_stream;
-            Hessian1StreamWriter hessian_writer(memory_stream);
+            throw Exception("Unsupported Content-Encoding: " + encoding);
+        }
+    }
+
+    static ReplyPtr callHessian1Http(const HessianClient& client, HessianClientImpl& impl,
+            HTTPClientSession& session, const CallPtr& call, HessianCancellation* cancellation, bool& answered) {
+        const URI& uri = client.getURI();
+        HTTPRequest request(HTTPRequest::HTTP_POST, isUnixURI(uri) ? queryParameter(uri, "path", "/") : uri.getPathEtc(), HTTPMessage::HTTP_1_1);
+        if (isUnixURI(uri))
+            request.setHost("localhost");
+        if (client.getAcceptCompression())
+            request.set("Accept-Encoding", "gzip, deflate");
+        std::streamsize sent;
+        {
+            HTTPRequestBodyStreamBuf body_buf(session, request,
+                    client.getChunkedThreshold(),
+                    client.getCompressionThreshold(),
+                    client.getCompressionLevel());
+            std::ostream body_out(&body_buf);
+            body_out.exceptions(std::ios::badbit);
+            Hessian1StreamWriter hessian_writer(body_out);
             hessian_writer.writeCall(call);
-            request.setContentLength(memory_stream.str().length());
-            std::ostream& request_out = session.sendRequest(request);
-            StreamCopier::copyStream(memory_stream, request_out);
-            request_out.flush();
+            sent = body_buf.send();
         }
+        CancellationScope scope(cancellation, session.socket());
+        // the reply is decoded straight from the response stream, chunked,
+        // compressed or not, so decoding starts before the last byte arrived
         HTTPResponse response;
         std::istream& response_in = session.receiveResponse(response);
+        answered = true;
         if (response.getStatus() != HTTPResponse::HTTP_OK) throw Exception(std::string("HTTP error: ") + response.getReason());
-        Hessian1StreamReader hessian_reader(response_in);
-        ReplyPtr reply = hessian_reader.readReply();
+        CountingInputStreamBuf counting_buf(response_in);
+        std::istream counting_in(&counting_buf);
+        ReplyPtr reply = readHessian1HttpReply(client, response, counting_in);
+        // whatever follows the reply, down to the last chunk, must be off
+        // the wire before the session can carry another request
+        counting_in.ignore(std::numeric_limits<std::streamsize>::max());
+        impl.addTraffic(sent, counting_buf.getCount());
+        if (!response.getKeepAlive())
+            session.setKeepAlive(false);
         return reply;
     }
 
-    static ReplyPtr callHessian1Tcp(const URI& uri, const CallPtr& call) {
-        SocketAddress address(uri.getHost(), uri.getPort());
-        StreamSocket socket(address);
+#ifdef HAVE_POCO_NET_HTTPSCLIENTSESSION_H
+    // Picks the TLS context of an https:// client, once; resuming sessions
+    // needs its session cache on
+    static void setUpTLS(const URI& uri, const Context::Ptr& context, HessianClientImpl& impl) {
+        if (icompare(uri.getScheme(), "HTTPS") != 0)
+            return;
+        Context::Ptr tls = context.isNull() ? SSLManager::instance().defaultClientContext() : context;
+        if (!tls->sessionCacheEnabled())
+            tls->enableSessionCache(true);
+        impl.setTLSContext(tls);
+    }
+#endif
+
+    static HTTPClientSession* newHTTPClientSession(const URI& uri, HessianClientImpl& impl) {
+        if (isUnixURI(uri))
+            return new HTTPClientSession(StreamSocket(socketAddress(uri)));
+        if (icompare(uri.getScheme(), "HTTPS") == 0) {
+#ifdef HAVE_POCO_NET_HTTPSCLIENTSESSION_H
+            return new HTTPSClientSession(uri.getHost(), uri.getPort(), impl.getTLSContext(), impl.getTLSSession());
+#else
+            throw Exception("HTTPS support was not built in");
+#endif
+        }
+        return new HTTPClientSession(uri.getHost(), uri.getPort());
+    }
+
+    // Called once per connection, after its first call
+    static void connectionEstablished(const URI& uri, HessianClientImpl& impl, HTTPClientSession& session) {
+#ifdef HAVE_POCO_NET_HTTPSCLIENTSESSION_H
+        if (icompare(uri.getScheme(), "HTTPS") != 0)
+            return;
+        HTTPSClientSession& secure = static_cast<HTTPSClientSession&> (session);
+        impl.tlsHandshake(SecureStreamSocket(secure.socket()).sessionWasReused());
+        impl.setTLSSession(secure.sslSession());
+#endif
+    }
+
+    static ReplyPtr callHessian1Http(const HessianClient& client, HessianClientImpl& impl,
+            const CallPtr& call, HessianCancellation* cancellation) {
+        const URI& uri = client.getURI();
+        bool retried = false;
+        for (;;) {
+            // the retry always opens a fresh connection, so it is the last
+            HTTPClientSession* session = retried ? NULL : impl.takeSession(client.getIdleTimeout());
+            bool reused = session != NULL;
+            bool answered = false;
+            if (!session) {
+                session = newHTTPClientSession(uri, impl);
+                session->setKeepAlive(client.getMaxIdleConnections() > 0);
+                impl.connectionOpened();
+            }
+            try {
+                ReplyPtr reply = callHessian1Http(client, impl, *session, call, cancellation, answered);
+                if (!reused)
+                    connectionEstablished(uri, impl, *session);
+                // a connection shut down by a late cancel is no use any more
+                if (session->getKeepAlive() && !isCancelled(cancellation))
+                    impl.putSession(session, client.getMaxIdleConnections());
+                else
+                    delete session;
+                return reply;
+            } catch (...) {
+                delete session;
+                if (isCancelled(cancellation))
+                    throw Exception("Call cancelled");
+                // a kept-alive connection the server closed in the meantime
+                // fails before any answer, try once more on a fresh one
+                if (!reused || answered)
+                    throw;
+                impl.clearIdle();
+                retried = true;
+            }
+        }
+    }
+
+    static ReplyPtr callHessian1Raw(const HessianClient& client, HessianClientImpl& impl,
+            StreamSocket& socket, const CallPtr& call, HessianCancellation* cancellation, bool& answered) {
+        CancellationScope scope(cancellation, socket);
         SocketOutputStream out(socket);
-        Hessian1StreamWriter hessian_writer(out);
+        CountingOutputStreamBuf counting_out_buf;
+        counting_out_buf.setTarget(out);
+        std::ostream counting_out(&counting_out_buf);
+        Hessian1StreamWriter hessian_writer(counting_out);
         hessian_writer.writeCall(call);
-        out.flush();
+        counting_out.flush();
         SocketInputStream in(socket);
-        Hessian1StreamReader hessian_reader(in);
+        if (in.peek() == std::char_traits<char>::eof())
+            throw Exception("Connection closed by peer");
+        answered = true;
+        CountingInputStreamBuf counting_in_buf(in);
+        std::istream counting_in(&counting_in_buf);
+        Hessian1StreamReader hessian_reader(counting_in);
+        hessian_reader.setUseArena(client.getUseArena());
+        hessian_reader.setUseArrays(client.getUseArrays());
+        hessian_reader.setInternTable(client.getInternTable());
         ReplyPtr reply = hessian_reader.readReply();
+        impl.addTraffic(counting_out_buf.getCount(), counting_in_buf.getCount());
         return reply;
     }
 
+    static ReplyPtr callHessian1Raw(const HessianClient& client, HessianClientImpl& impl,
+            const CallPtr& call, HessianCancellation* cancellation) {
+        const URI& uri = client.getURI();
+        bool retried = false;
+        for (;;) {
+            // as for HTTP, one retry at most and on a fresh connection
+            StreamSocket* socket = retried ? NULL : impl.takeSocket(client.getIdleTimeout());
+            bool reused = socket != NULL;
+            bool answered = false;
+            try {
+                if (!socket) {
+                    socket = new StreamSocket(socketAddress(uri));
+                    if (!isUnixURI(uri))
+                        socket->setNoDelay(true);
+                    impl.connectionOpened();
+                }
+                ReplyPtr reply = callHessian1Raw(client, impl, *socket, call, cancellation, answered);
+                if (isCancelled(cancellation))
+                    delete socket;
+                else
+                    impl.putSocket(socket, client.getMaxIdleConnections());
+                return reply;
+            } catch (...) {
+                delete socket;
+                if (isCancelled(cancellation))
+                    throw Exception("Call cancelled");
+                if (!reused || answered)
+                    throw;
+                impl.clearIdle();
+                retried = true;
+            }
+        }
+    }
+
     HessianClient::HessianClient(const HessianVersion version, const URI& uri)
     : _version(version),
-    _uri(uri) {
+    _uri(uri),
+    _chunkedThreshold(0),
+    _acceptCompression(true),
+    _compressionThreshold(0),
+    _compressionLevel(-1),
+    _useArena(false),
+    _useArrays(false),
+    _internTable(),
+    _maxIdleConnections(8),
+    _idleTimeout(5 * Timespan::SECONDS),
+    _replyCache(),
+    _coalesced(),
+    _impl(new HessianClientImpl) {
+#ifdef HAVE_POCO_NET_HTTPSCLIENTSESSION_H
+        PoHessian::setUpTLS(_uri, Context::Ptr(), *_impl);
+#endif
+    }
+
+    HessianClient::HessianClient(const HessianVersion version, const URI& uri, const Poco::AutoPtr<Poco::Net::Context>& context)
+    : _version(version),
+    _uri(uri),
+    _chunkedThreshold(0),
+    _acceptCompression(true),
+    _compressionThreshold(0),
+    _compressionLevel(-1),
+    _useArena(false),
+    _useArrays(false),
+    _internTable(),
+    _maxIdleConnections(8),
+    _idleTimeout(5 * Timespan::SECONDS),
+    _replyCache(),
+    _coalesced(),
+    _impl(new HessianClientImpl) {
+#ifdef HAVE_POCO_NET_HTTPSCLIENTSESSION_H
+        PoHessian::setUpTLS(_uri, context, *_impl);
+#else
+        if (!context.isNull())
+            throw Exception("HTTPS support was not built in");
+#endif
+    }
+
+    HessianClient::~HessianClient() {
+    }
+
+    HessianClient::HessianVersion HessianClient::getVersion() const {
+        return _version;
+    }
+
+    const URI& HessianClient::getURI() const {
+        return _uri;
+    }
+
+    void HessianClient::setChunkedThreshold(const std::streamsize threshold) {
+        _chunkedThreshold = threshold;
+    }
+
+    std::streamsize HessianClient::getChunkedThreshold() const {
+        return _chunkedThreshold;
+    }
+
+    void HessianClient::setAcceptCompression(const bool accept) {
+        _acceptCompression = accept;
+    }
+
+    bool HessianClient::getAcceptCompression() const {
+        return _acceptCompression;
+    }
+
+    void HessianClient::setCompressionThreshold(const std::streamsize threshold) {
+        _compressionThreshold = threshold;
+    }
+
+    std::streamsize HessianClient::getCompressionThreshold() const {
+        return _compressionThreshold;
+    }
+
+    void HessianClient::setCompressionLevel(const int level) {
+        if (level < -1 || level > 9)
+            throw Exception("Compression level must be between -1 and 9");
+        _compressionLevel = level;
+    }
+
+    int HessianClient::getCompressionLevel() const {
+        return _compressionLevel;
+    }
+
+    void HessianClient::setUseArena(const bool useArena) {
+        _useArena = useArena;
+    }
+
+    bool HessianClient::getUseArena() const {
+        return _useArena;
+    }
+
+    void HessianClient::setUseArrays(const bool useArrays) {
+        _useArrays = useArrays;
+    }
+
+    bool HessianClient::getUseArrays() const {
+        return _useArrays;
+    }
+
+    void HessianClient::setInternTable(const SharedPtr<HessianInternTable>& table) {
+        _internTable = table;
+    }
+
+    const SharedPtr<HessianInternTable>& HessianClient::getInternTable() const {
+        return _internTable;
+    }
+
+    UInt64 HessianClient::getBytesSent() const {
+        return _impl->getBytesSent();
+    }
+
+    UInt64 HessianClient::getBytesReceived() const {
+        return _impl->getBytesReceived();
+    }
+
+    void HessianClient::setMaxIdleConnections(const std::size_t max) {
+        _maxIdleConnections = max;
+        if (max == 0)
+            _impl->clearIdle();
+    }
+
+    std::size_t HessianClient::getMaxIdleConnections() const {
+        return _maxIdleConnections;
+    }
+
+    void HessianClient::setIdleTimeout(const Timespan& timeout) {
+        _idleTimeout = timeout;
+    }
+
+    Timespan HessianClient::getIdleTimeout() const {
+        return _idleTimeout;
+    }
+
+    UInt64 HessianClient::getConnectionsOpened() const {
+        return _impl->getConnectionsOpened();
+    }
+
+    UInt64 HessianClient::getTLSHandshakes() const {
+        return _impl->getTLSHandshakes();
+    }
+
+    UInt64 HessianClient::getTLSResumedHandshakes() const {
+        return _impl->getTLSResumedHandshakes();
+    }
+
+    void HessianClient::setReplyCache(const SharedPtr<HessianReplyCache>& cache) {
+        _replyCache = cache;
+    }
+
+    const SharedPtr<HessianReplyCache>& HessianClient::getReplyCache() const {
+        return _replyCache;
+    }
+
+    void HessianClient::setCoalesced(const std::string& method, const bool coalesced) {
+        if (coalesced)
+            _coalesced.insert(method);
+        else
+            _coalesced.erase(method);
+    }
+
+    bool HessianClient::isCoalesced(const std::string& method) const {
+        return _coalesced.find(method) != _coalesced.end();
+    }
+
+    UInt64 HessianClient::getCoalescedCount() const {
+        return _impl->getCoalescedCount();
     }
 
     ValuePtr HessianClient::call(const std::string& method) {
-        const HeaderList headers;
-        const ParameterList parameters;
-        return call(method, headers, parameters);
+        return PoHessian::callValue(*this, method, HeaderList(), ParameterList());
     }
 
     ValuePtr HessianClient::call(const std::string& method, const HeaderList& headers) {
-        const ParameterList parameters;
-        return call(method, headers, parameters);
+        return PoHessian::callValue(*this, method, headers, ParameterList());
     }
 
     ValuePtr HessianClient::call(const std::string& method, const ParameterList& parameters) {
-        const HeaderList headers;
-        return call(method, headers, parameters);
+        return PoHessian::callValue(*this, method, HeaderList(), parameters);
     }
 
     ValuePtr HessianClient::call(const std::string& method, const HeaderList& headers, const ParameterList& parameters) {
-        CallPtr call = new Call(method, headers, parameters);
-        ReplyPtr reply = this->call(call);
-        PoHessian::throwHessianExceptionIfFault(reply->getValue());
-        return reply->getValue();
+        return PoHessian::callValue(*this, method, headers, parameters);
     }
 
-    ReplyPtr HessianClient::call(const CallPtr& call) {
-        if (icompare(_uri.getScheme(), "HTTP") == 0) {
-            return PoHessian::callHessian1Http(_uri, call);
-        } else if (icompare(_uri.getScheme(), "TCP") == 0) {
-            return PoHessian::callHessian1Tcp(_uri, call);
+    // shm://name attaches to the shared memory channel "/name"
+    static ReplyPtr callHessian1Shm(const HessianClient& client, HessianClientImpl& impl, const CallPtr& call) {
+        SharedPtr<HessianShmChannel> channel = impl.getShmChannel("/" + client.getURI().getHost());
+        try {
+            UInt64 sent = 0;
+            UInt64 received = 0;
+            ReplyPtr reply = channel->call(call, sent, received);
+            impl.addTraffic(sent, received);
+            return reply;
+        } catch (...) {
+            // a broken channel is attached again on the next call
+            impl.dropShmChannel(channel);
+            throw;
+        }
+    }
+
+    static ReplyPtr callHessian1(const HessianClient& client, HessianClientImpl& impl,
+            const CallPtr& call, HessianCancellation* cancellation) {
+        const URI& uri = client.getURI();
+        ReplyPtr reply;
+        if (isHttpURI(uri)) {
+            reply = PoHessian::callHessian1Http(client, impl, call, cancellation);
+        } else if (icompare(uri.getScheme(), "TCP") == 0 || isUnixURI(uri)) {
+            reply = PoHessian::callHessian1Raw(client, impl, call, cancellation);
+        } else if (icompare(uri.getScheme(), "SHM") == 0) {
+            reply = PoHessian::callHessian1Shm(client, impl, call);
         } else {
-            throw Exception("Invalid scheme: " + _uri.getScheme());
+            throw Exception("Invalid scheme: " + uri.getScheme());
+        }
+        SharedPtr<HessianReplyCache> cache = client.getReplyCache();
+        if (!cache.isNull())
+            cache->store(call, reply);
+        return reply;
+    }
+
+    static ReplyPtr callHessian1Coalesced(const HessianClient& client, HessianClientImpl& impl, const CallPtr& call) {
+        std::size_t hash = call->hash();
+        SharedPtr<InFlightCall> flight;
+        if (!impl.takeOff(call, hash, flight))
+            return flight->wait();
+        ReplyPtr reply;
+        try {
+            reply = PoHessian::callHessian1(client, impl, call, NULL);
+        } catch (Exception& e) {
+            impl.land(hash, flight);
+            flight->failed(e);
+            throw;
+        } catch (std::exception& e) {
+            impl.land(hash, flight);
+            flight->failed(Exception(e.what()));
+            throw;
+        } catch (...) {
+            impl.land(hash, flight);
+            flight->failed(Exception("Unknown error"));
+            throw;
+        }
+        impl.land(hash, flight);
+        // every waiter gets this very reply, on its own thread
+        reply->share();
+        flight->succeeded(reply);
+        return reply;
+    }
+
+    static ReplyPtr callHessian1Client(const HessianClient& client, HessianClientImpl& impl,
+            const CallPtr& call, HessianCancellation* cancellation) {
+        ReplyPtr reply;
+        SharedPtr<HessianReplyCache> cache = client.getReplyCache();
+        if (!cache.isNull())
+            reply = cache->lookup(call);
+        if (!reply) {
+            if (client.isCoalesced(call->getMethod()))
+                reply = PoHessian::callHessian1Coalesced(client, impl, call);
+            else
+                reply = PoHessian::callHessian1(client, impl, call, cancellation);
         }
+        return reply;
+    }
+
+    ReplyPtr HessianClient::call(const CallPtr& call) {
+        return PoHessian::callHessian1Client(*this, *_impl, call, NULL);
+    }
+
+    ReplyPtr HessianClient::call(const CallPtr& call, HessianCancellation& cancellation) {
+        return PoHessian::callHessian1Client(*this, *_impl, call, &cancellation);
     }
 
 }
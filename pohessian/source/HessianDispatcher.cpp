@@ -0,0 +1,151 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "pohessian/HessianDispatcher.h"
+
+#include "conf.h"
+
+#include <string>
+#include <map>
+#include <exception>
+
+#include "pohessian/HessianTypes.h"
+#include "pohessian/HessianPipeline.h"
+
+#include "Poco/Exception.h"
+#include "Poco/Mutex.h"
+
+using Poco::Mutex;
+
+namespace PoHessian {
+
+    class FunctionHandler : public HessianHandler {
+    public:
+
+        FunctionHandler(const HessianDispatcher::Function function)
+        : _function(function) {
+        }
+
+        ValuePtr handle(const CallPtr& call) {
+            return _function(call);
+        }
+
+    private:
+        const HessianDispatcher::Function _function;
+    };
+
+    HessianHandler::~HessianHandler() {
+    }
+
+    HessianDispatcher::HessianDispatcher()
+    : _mutex(),
+    _handlers(),
+    _callCount(),
+    _faultCount() {
+    }
+
+    void HessianDispatcher::registerHandler(const std::string& method, const HandlerPtr& handler) {
+        if (handler.isNull())
+            throw Poco::Exception("Null handler for method: " + method);
+        Mutex::ScopedLock lock(_mutex);
+        _handlers[method] = handler;
+    }
+
+    void HessianDispatcher::registerFunction(const std::string& method, const Function function) {
+        if (!function)
+            throw Poco::Exception("Null function for method: " + method);
+        registerHandler(method, new FunctionHandler(function));
+    }
+
+    void HessianDispatcher::unregister(const std::string& method) {
+        Mutex::ScopedLock lock(_mutex);
+        _handlers.erase(method);
+    }
+
+    bool HessianDispatcher::isRegistered(const std::string& method) const {
+        Mutex::ScopedLock lock(_mutex);
+        return _handlers.find(method) != _handlers.end();
+    }
+
+    HessianDispatcher::HandlerPtr HessianDispatcher::findHandler(const std::string& method) const {
+        Mutex::ScopedLock lock(_mutex);
+        std::map<std::string, HandlerPtr>::const_iterator it = _handlers.find(method);
+        if (it == _handlers.end())
+            return HandlerPtr();
+        return it->second;
+    }
+
+    ReplyPtr HessianDispatcher::fault(const std::string& code, const std::string& message, const ValuePtr& detail) {
+        _faultCount++;
+        return new Reply(new Value(code, message, detail));
+    }
+
+    ReplyPtr HessianDispatcher::protocolFault(const std::string& message) {
+        return fault("ProtocolException", message, new Value());
+    }
+
+    // the correlation id a pipelined call carries goes back with its reply,
+    // see HessianPipeline::MATCHING_CORRELATION_ID
+    static HeaderList correlationHeaders(const CallPtr& call) {
+        HeaderList headers;
+        const HeaderList& callHeaders = call->getHeaders();
+        for (HeaderList::const_iterator it = callHeaders.begin(); it != callHeaders.end(); it++)
+            if ((*it)->getName() == HessianPipeline::CORRELATION_ID_HEADER)
+                headers.push_back(*it);
+        return headers;
+    }
+
+    ReplyPtr HessianDispatcher::dispatch(const CallPtr& call) {
+        ReplyPtr reply = invoke(call);
+        HeaderList headers = correlationHeaders(call);
+        if (headers.empty())
+            return reply;
+        return new Reply(PoHessian_MOVE(headers), reply->getValue());
+    }
+
+    ReplyPtr HessianDispatcher::invoke(const CallPtr& call) {
+        _callCount++;
+        // the handler is held by copy so unregister() cannot pull it from under a running call
+        HandlerPtr handler = findHandler(call->getMethod());
+        if (handler.isNull())
+            return fault("NoSuchMethodException", "No such method: " + call->getMethod(), new Value());
+        try {
+            return new Reply(handler->handle(call));
+        } catch (HessianException& e) {
+            return fault(e.getCode(), e.getMessage(), e.getDetail());
+        } catch (Poco::Exception& e) {
+            return fault("ServiceException", e.displayText(), new Value());
+        } catch (std::exception& e) {
+            return fault("ServiceException", e.what(), new Value());
+        } catch (...) {
+            return fault("ServiceException", "Unknown exception", new Value());
+        }
+    }
+
+    int HessianDispatcher::getCallCount() const {
+        return _callCount.value();
+    }
+
+    int HessianDispatcher::getFaultCount() const {
+        return _faultCount.value();
+    }
+
+}
@@ -0,0 +1,377 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "pohessian/HessianHedgedClient.h"
+
+#include "conf.h"
+#include "callvalue.h"
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <exception>
+
+#include "pohessian/HessianTypes.h"
+#include "pohessian/HessianClient.h"
+#include "pohessian/HessianStatistics.h"
+
+#include "Poco/Exception.h"
+#include "Poco/Types.h"
+#include "Poco/URI.h"
+#include "Poco/Mutex.h"
+#include "Poco/Event.h"
+#include "Poco/Runnable.h"
+#include "Poco/SharedPtr.h"
+#include "Poco/Timespan.h"
+#include "Poco/Timestamp.h"
+#include "Poco/ThreadPool.h"
+
+using Poco::Exception;
+using Poco::NoThreadAvailableException;
+using Poco::UInt64;
+using Poco::URI;
+using Poco::FastMutex;
+using Poco::Event;
+using Poco::Runnable;
+using Poco::SharedPtr;
+using Poco::Timespan;
+using Poco::Timestamp;
+using Poco::ThreadPool;
+
+namespace PoHessian {
+
+    // Outcome of one hedged call, shared by the caller and its attempts.
+    class HedgedCall {
+    public:
+
+        HedgedCall()
+        : _mutex(),
+        _event(),
+        _launched(0),
+        _failed(0),
+        _winner(-1),
+        _reply(),
+        _error() {
+        }
+
+        void launched() {
+            FastMutex::ScopedLock lock(_mutex);
+            _launched++;
+        }
+
+        // the first reply cancels the other attempt, whose connection is
+        // then dropped instead of waiting on a reply nobody reads
+        void succeeded(const int attempt, const ReplyPtr& reply) {
+            bool won = false;
+            {
+                FastMutex::ScopedLock lock(_mutex);
+                if (_winner == -1) {
+                    _winner = attempt;
+                    _reply = reply;
+                    won = true;
+                }
+            }
+            if (won)
+                _cancellations[1 - attempt].cancel();
+            _event.set();
+        }
+
+        void failed(const Exception& e) {
+            {
+                FastMutex::ScopedLock lock(_mutex);
+                _failed++;
+                if (!_error)
+                    _error = e.clone();
+            }
+            _event.set();
+        }
+
+        // Waits until a reply arrived or every launched attempt failed, at
+        // most the given number of microseconds when it is not negative;
+        // Event only waits in milliseconds, so a sub-millisecond delay is
+        // rounded up rather than down to no wait at all
+        bool wait(const Timespan::TimeDiff microseconds) {
+            Timestamp start;
+            for (;;) {
+                {
+                    FastMutex::ScopedLock lock(_mutex);
+                    if (_winner != -1 || _failed == _launched)
+                        return true;
+                }
+                if (microseconds < 0) {
+                    _event.wait();
+                } else {
+                    Timespan::TimeDiff remaining = microseconds - start.elapsed();
+                    if (remaining <= 0 || !_event.tryWait((long) ((remaining + 999) / 1000))) {
+                        FastMutex::ScopedLock lock(_mutex);
+                        return _winner != -1 || _failed == _launched;
+                    }
+                }
+            }
+        }
+
+        bool hasReply() const {
+            FastMutex::ScopedLock lock(_mutex);
+            return _winner != -1;
+        }
+
+        HessianCancellation& getCancellation(const int attempt) {
+            return _cancellations[attempt];
+        }
+
+        ReplyPtr getReply(int& winner) const {
+            FastMutex::ScopedLock lock(_mutex);
+            if (_winner == -1)
+                _error->rethrow();
+            winner = _winner;
+            return _reply;
+        }
+
+    private:
+        mutable FastMutex _mutex;
+        Event _event;
+        int _launched;
+        int _failed;
+        int _winner;
+        ReplyPtr _reply;
+        SharedPtr<Exception> _error;
+        HessianCancellation _cancellations[2];
+    };
+
+    // Runs one attempt of a hedged call on a pool thread and deletes itself.
+    class HedgedAttempt : public Runnable {
+    public:
+
+        HedgedAttempt(HessianHedgedClient& owner, HessianClient& replica, const SharedPtr<HedgedCall>& state, const CallPtr& call, const int attempt)
+        : _owner(owner),
+        _replica(replica),
+        _state(state),
+        _call(call),
+        _attempt(attempt) {
+        }
+
+        void run() {
+            Timestamp start;
+            try {
+                ReplyPtr reply = _replica.call(_call, _state->getCancellation(_attempt));
+                // released by this thread and the caller alike from here
+                reply->share();
+                _owner.recordLatency(_call->getMethod(), Timespan(start.elapsed()));
+                _state->succeeded(_attempt, reply);
+            } catch (Exception& e) {
+                _state->failed(e);
+            } catch (std::exception& e) {
+                _state->failed(Exception(e.what()));
+            } catch (...) {
+                _state->failed(Exception("Unknown error"));
+            }
+            delete this;
+        }
+
+    private:
+        HessianHedgedClient& _owner;
+        HessianClient& _replica;
+        SharedPtr<HedgedCall> _state;
+        CallPtr _call;
+        int _attempt;
+    };
+
+    HessianHedgedClient::HessianHedgedClient(const HessianClient::HessianVersion version, const std::vector<URI>& uris)
+    : _replicas(),
+    _next(0),
+    _pool(2, 16 * (int) std::max((std::vector<URI>::size_type) 1, uris.size())),
+    _mutex(),
+    _idempotent(),
+    _histograms(),
+    _hedgePercentile(95.0),
+    _defaultHedgeDelay(50 * Timespan::MILLISECONDS),
+    _minimumHedgeDelay(1 * Timespan::MILLISECONDS),
+    _minimumSamples(100),
+    _hedgeCount(0),
+    _hedgeWinCount(0) {
+        if (uris.empty())
+            throw Exception("At least one replica URI is required");
+        for (std::vector<URI>::const_iterator it = uris.begin(); it != uris.end(); it++)
+            _replicas.push_back(new HessianClient(version, *it));
+    }
+
+    HessianHedgedClient::~HessianHedgedClient() {
+        // losing attempts still reference this client until their cancelled
+        // calls have failed
+        _pool.joinAll();
+    }
+
+    HessianClient& HessianHedgedClient::getReplica(const std::vector<URI>::size_type index) {
+        return *_replicas.at(index);
+    }
+
+    std::vector<URI>::size_type HessianHedgedClient::getReplicaCount() const {
+        return _replicas.size();
+    }
+
+    void HessianHedgedClient::setIdempotent(const std::string& method, const bool idempotent) {
+        FastMutex::ScopedLock lock(_mutex);
+        if (idempotent)
+            _idempotent.insert(method);
+        else
+            _idempotent.erase(method);
+    }
+
+    bool HessianHedgedClient::isIdempotent(const std::string& method) const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _idempotent.find(method) != _idempotent.end();
+    }
+
+    void HessianHedgedClient::setHedgePercentile(const double percentile) {
+        if (percentile <= 0.0 || percentile >= 100.0)
+            throw Exception("Hedge percentile must be between 0 and 100");
+        FastMutex::ScopedLock lock(_mutex);
+        _hedgePercentile = percentile;
+    }
+
+    double HessianHedgedClient::getHedgePercentile() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _hedgePercentile;
+    }
+
+    void HessianHedgedClient::setDefaultHedgeDelay(const Timespan& delay) {
+        FastMutex::ScopedLock lock(_mutex);
+        _defaultHedgeDelay = delay;
+    }
+
+    Timespan HessianHedgedClient::getDefaultHedgeDelay() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _defaultHedgeDelay;
+    }
+
+    void HessianHedgedClient::setMinimumHedgeDelay(const Timespan& delay) {
+        FastMutex::ScopedLock lock(_mutex);
+        _minimumHedgeDelay = delay;
+    }
+
+    Timespan HessianHedgedClient::getMinimumHedgeDelay() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _minimumHedgeDelay;
+    }
+
+    void HessianHedgedClient::setMinimumSamples(const UInt64 samples) {
+        FastMutex::ScopedLock lock(_mutex);
+        _minimumSamples = samples;
+    }
+
+    UInt64 HessianHedgedClient::getMinimumSamples() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _minimumSamples;
+    }
+
+    Timespan HessianHedgedClient::getHedgeDelay(const std::string& method) const {
+        FastMutex::ScopedLock lock(_mutex);
+        std::map<std::string, LatencyHistogram>::const_iterator it = _histograms.find(method);
+        if (it == _histograms.end() || it->second.getCount() < _minimumSamples)
+            return _defaultHedgeDelay;
+        return std::max(_minimumHedgeDelay, it->second.getPercentile(_hedgePercentile));
+    }
+
+    LatencyHistogram HessianHedgedClient::getLatencyHistogram(const std::string& method) const {
+        FastMutex::ScopedLock lock(_mutex);
+        std::map<std::string, LatencyHistogram>::const_iterator it = _histograms.find(method);
+        if (it == _histograms.end())
+            return LatencyHistogram();
+        return it->second;
+    }
+
+    UInt64 HessianHedgedClient::getHedgeCount() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _hedgeCount;
+    }
+
+    UInt64 HessianHedgedClient::getHedgeWinCount() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _hedgeWinCount;
+    }
+
+    void HessianHedgedClient::recordLatency(const std::string& method, const Timespan& latency) {
+        FastMutex::ScopedLock lock(_mutex);
+        _histograms[method].record(latency);
+    }
+
+    ValuePtr HessianHedgedClient::call(const std::string& method) {
+        return PoHessian::callValue(*this, method, HeaderList(), ParameterList());
+    }
+
+    ValuePtr HessianHedgedClient::call(const std::string& method, const HeaderList& headers) {
+        return PoHessian::callValue(*this, method, headers, ParameterList());
+    }
+
+    ValuePtr HessianHedgedClient::call(const std::string& method, const ParameterList& parameters) {
+        return PoHessian::callValue(*this, method, HeaderList(), parameters);
+    }
+
+    ValuePtr HessianHedgedClient::call(const std::string& method, const HeaderList& headers, const ParameterList& parameters) {
+        return PoHessian::callValue(*this, method, headers, parameters);
+    }
+
+    ReplyPtr HessianHedgedClient::call(const CallPtr& call) {
+        std::vector<URI>::size_type primary = (std::vector<URI>::size_type) (_next++) % _replicas.size();
+        if (_replicas.size() < 2 || !isIdempotent(call->getMethod())) {
+            Timestamp start;
+            ReplyPtr reply = _replicas[primary]->call(call);
+            recordLatency(call->getMethod(), Timespan(start.elapsed()));
+            return reply;
+        }
+        // every attempt holds the call, each on its own thread
+        call->share();
+        SharedPtr<HedgedCall> state = new HedgedCall;
+        state->launched();
+        HedgedAttempt* attempt = new HedgedAttempt(*this, *_replicas[primary], state, call, 0);
+        try {
+            _pool.start(*attempt);
+        } catch (NoThreadAvailableException&) {
+            // no thread left to hedge with, fall back to a plain call
+            attempt->run();
+            int winner;
+            return state->getReply(winner);
+        }
+        if (!state->wait(getHedgeDelay(call->getMethod()).totalMicroseconds()) || !state->hasReply()) {
+            std::vector<URI>::size_type secondary = (primary + 1) % _replicas.size();
+            state->launched();
+            attempt = new HedgedAttempt(*this, *_replicas[secondary], state, call, 1);
+            try {
+                _pool.start(*attempt);
+                FastMutex::ScopedLock lock(_mutex);
+                _hedgeCount++;
+            } catch (NoThreadAvailableException&) {
+                delete attempt;
+                state->failed(NoThreadAvailableException("No thread available to hedge"));
+            }
+            state->wait(-1);
+        }
+        int winner;
+        ReplyPtr reply = state->getReply(winner);
+        if (winner == 1) {
+            FastMutex::ScopedLock lock(_mutex);
+            _hedgeWinCount++;
+        }
+        return reply;
+    }
+
+}
@@ -0,0 +1,86 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "pohessian/HessianInternTable.h"
+
+#include "conf.h"
+
+#include <string>
+#include <map>
+
+#include "pohessian/HessianTypes.h"
+
+#include "Poco/Types.h"
+#include "Poco/Mutex.h"
+
+using Poco::FastMutex;
+using Poco::UInt64;
+
+namespace PoHessian {
+
+    HessianInternTable::HessianInternTable(const std::size_t maxEntries)
+    : _mutex(),
+    _maxEntries(maxEntries),
+    _values(),
+    _hitCount(0),
+    _missCount(0) {
+    }
+
+    ValuePtr HessianInternTable::intern(const std::string& value) {
+        FastMutex::ScopedLock lock(_mutex);
+        std::map<std::string, ValuePtr>::iterator it = _values.lower_bound(value);
+        if (it != _values.end() && it->first == value) {
+            _hitCount++;
+            return it->second;
+        }
+        _missCount++;
+        ValuePtr interned = new Value(value);
+        interned->freeze();
+        if (_values.size() < _maxEntries)
+            _values.insert(it, std::make_pair(value, interned));
+        return interned;
+    }
+
+    void HessianInternTable::clear() {
+        FastMutex::ScopedLock lock(_mutex);
+        _values.clear();
+    }
+
+    std::size_t HessianInternTable::getSize() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _values.size();
+    }
+
+    std::size_t HessianInternTable::getMaxEntries() const {
+        return _maxEntries;
+    }
+
+    UInt64 HessianInternTable::getHitCount() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _hitCount;
+    }
+
+    UInt64 HessianInternTable::getMissCount() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _missCount;
+    }
+
+}
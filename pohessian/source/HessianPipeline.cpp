@@ -0,0 +1,289 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "pohessian/HessianPipeline.h"
+
+#include "conf.h"
+
+#include <string>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <utility>
+
+#include "pohessian/HessianTypes.h"
+#include "pohessian/HessianClient.h"
+#include "pohessian/Hessian1StreamReader.h"
+#include "pohessian/Hessian1StreamWriter.h"
+
+#include "Poco/Exception.h"
+#include "Poco/String.h"
+#include "Poco/Types.h"
+#include "Poco/URI.h"
+
+#include "Poco/Net/SocketAddress.h"
+#include "Poco/Net/StreamSocket.h"
+#include "Poco/Net/SocketStream.h"
+
+using Poco::Exception;
+using Poco::Int64;
+using Poco::UInt64;
+using Poco::URI;
+
+using Poco::Net::SocketAddress;
+using Poco::Net::StreamSocket;
+using Poco::Net::SocketInputStream;
+using Poco::Net::SocketOutputStream;
+
+using Poco::icompare;
+
+namespace PoHessian {
+
+    const std::string HessianPipeline::CORRELATION_ID_HEADER("correlationId");
+
+    static CallPtr withCorrelationId(const CallPtr& call, HessianPipeline::Ticket ticket) {
+        HeaderList headers(call->getHeaders());
+        headers.push_back(new Header(HessianPipeline::CORRELATION_ID_HEADER, new Value((Int64) ticket)));
+        return new Call(call->getMethod(), PoHessian_MOVE(headers), call->getParameters());
+    }
+
+    static bool findCorrelationId(const ReplyPtr& reply, HessianPipeline::Ticket& ticket) {
+        const HeaderList& headers = reply->getHeaders();
+        for (HeaderList::const_iterator it = headers.begin(); it != headers.end(); it++) {
+            if ((*it)->getName() != HessianPipeline::CORRELATION_ID_HEADER)
+                continue;
+            const ValuePtr& value = (*it)->getValue();
+            if (!value || !value->isLong())
+                return false;
+            ticket = (HessianPipeline::Ticket) value->getLong();
+            return true;
+        }
+        return false;
+    }
+
+    HessianPipeline::HessianPipeline(const HessianClient::HessianVersion version, const URI& uri,
+            const std::size_t maxDepth, const MatchingMode matchingMode, const FullPolicy fullPolicy)
+    : _version(version),
+    _uri(uri),
+    _maxDepth(maxDepth),
+    _matchingMode(matchingMode),
+    _fullPolicy(fullPolicy),
+    _socket(),
+    _out(NULL),
+    _in(NULL),
+    _nextTicket(0),
+    _pending(),
+    _buffered(),
+    _maxObservedDepth(0),
+    _sentCount(0),
+    _receivedCount(0),
+    _headOfLineStallCount(0),
+    _fullStallCount(0) {
+        if (icompare(_uri.getScheme(), "TCP") != 0)
+            throw Exception("Invalid scheme: " + _uri.getScheme());
+        if (_maxDepth == 0)
+            throw Exception("Pipeline max depth must be at least 1");
+    }
+
+    HessianPipeline::~HessianPipeline() {
+        try {
+            close();
+        } catch (...) {
+        }
+    }
+
+    HessianClient::HessianVersion HessianPipeline::getVersion() const {
+        return _version;
+    }
+
+    const URI& HessianPipeline::getURI() const {
+        return _uri;
+    }
+
+    void HessianPipeline::setMaxDepth(const std::size_t maxDepth) {
+        if (maxDepth == 0)
+            throw Exception("Pipeline max depth must be at least 1");
+        _maxDepth = maxDepth;
+    }
+
+    std::size_t HessianPipeline::getMaxDepth() const {
+        return _maxDepth;
+    }
+
+    void HessianPipeline::setMatchingMode(const MatchingMode matchingMode) {
+        if (!_pending.empty())
+            throw Exception("Cannot change pipeline matching mode with calls in flight");
+        _matchingMode = matchingMode;
+    }
+
+    HessianPipeline::MatchingMode HessianPipeline::getMatchingMode() const {
+        return _matchingMode;
+    }
+
+    void HessianPipeline::setFullPolicy(const FullPolicy fullPolicy) {
+        _fullPolicy = fullPolicy;
+    }
+
+    HessianPipeline::FullPolicy HessianPipeline::getFullPolicy() const {
+        return _fullPolicy;
+    }
+
+    void HessianPipeline::connect() {
+        if (_out)
+            return;
+        _socket.connect(SocketAddress(_uri.getHost(), _uri.getPort()));
+        _out = new SocketOutputStream(_socket);
+        _in = new SocketInputStream(_socket);
+    }
+
+    void HessianPipeline::close() {
+        disconnect();
+        _buffered.clear();
+    }
+
+    void HessianPipeline::disconnect() {
+        delete _out;
+        _out = NULL;
+        delete _in;
+        _in = NULL;
+        _socket.close();
+        _pending.clear();
+    }
+
+    void HessianPipeline::readOne() {
+        if (_pending.empty())
+            throw Exception("No call in flight");
+        ReplyPtr reply;
+        try {
+            Hessian1StreamReader hessian_reader(*_in);
+            reply = hessian_reader.readReply();
+        } catch (...) {
+            // the stream is out of sync, every call still in flight is lost;
+            // the replies already read can still be received
+            disconnect();
+            throw;
+        }
+        Ticket ticket = _pending.front();
+        if (_matchingMode == MATCHING_CORRELATION_ID) {
+            Ticket correlated;
+            if (findCorrelationId(reply, correlated)) {
+                std::deque<Ticket>::iterator it = std::find(_pending.begin(), _pending.end(), correlated);
+                if (it == _pending.end()) {
+                    disconnect();
+                    throw Exception("Unexpected reply correlation id");
+                }
+                ticket = correlated;
+                _pending.erase(it);
+            } else {
+                _pending.pop_front();
+            }
+        } else {
+            _pending.pop_front();
+        }
+        _buffered.insert(std::make_pair(ticket, reply));
+        _receivedCount++;
+    }
+
+    HessianPipeline::Ticket HessianPipeline::send(const CallPtr& call) {
+        connect();
+        if (_pending.size() >= _maxDepth) {
+            if (_fullPolicy == FULL_POLICY_THROW)
+                throw Exception("Pipeline full");
+            while (_pending.size() >= _maxDepth) {
+                readOne();
+                _fullStallCount++;
+            }
+        }
+        Ticket ticket = _nextTicket++;
+        try {
+            Hessian1StreamWriter hessian_writer(*_out);
+            if (_matchingMode == MATCHING_CORRELATION_ID)
+                hessian_writer.writeCall(withCorrelationId(call, ticket));
+            else
+                hessian_writer.writeCall(call);
+            _out->flush();
+            if (!_out->good())
+                throw Exception("Pipeline write failed");
+        } catch (...) {
+            // part of the call may be on the wire, the connection is unusable
+            disconnect();
+            throw;
+        }
+        _pending.push_back(ticket);
+        _sentCount++;
+        _maxObservedDepth = std::max(_maxObservedDepth, _pending.size());
+        return ticket;
+    }
+
+    ReplyPtr HessianPipeline::receive(const Ticket ticket) {
+        std::map<Ticket, ReplyPtr>::iterator it = _buffered.find(ticket);
+        while (it == _buffered.end()) {
+            if (std::find(_pending.begin(), _pending.end(), ticket) == _pending.end())
+                throw Exception("Unknown pipeline ticket");
+            readOne();
+            it = _buffered.find(ticket);
+            if (it == _buffered.end())
+                _headOfLineStallCount++;
+        }
+        ReplyPtr reply = it->second;
+        _buffered.erase(it);
+        return reply;
+    }
+
+    ReplyPtr HessianPipeline::receive() {
+        Ticket oldest;
+        if (!_buffered.empty() && (_pending.empty() || _buffered.begin()->first < _pending.front()))
+            oldest = _buffered.begin()->first;
+        else if (!_pending.empty())
+            oldest = _pending.front();
+        else
+            throw Exception("No call in flight");
+        return receive(oldest);
+    }
+
+    std::size_t HessianPipeline::getDepth() const {
+        return _pending.size();
+    }
+
+    std::size_t HessianPipeline::getBufferedCount() const {
+        return _buffered.size();
+    }
+
+    std::size_t HessianPipeline::getMaxObservedDepth() const {
+        return _maxObservedDepth;
+    }
+
+    UInt64 HessianPipeline::getSentCount() const {
+        return _sentCount;
+    }
+
+    UInt64 HessianPipeline::getReceivedCount() const {
+        return _receivedCount;
+    }
+
+    UInt64 HessianPipeline::getHeadOfLineStallCount() const {
+        return _headOfLineStallCount;
+    }
+
+    UInt64 HessianPipeline::getFullStallCount() const {
+        return _fullStallCount;
+    }
+
+}
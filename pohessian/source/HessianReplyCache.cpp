@@ -0,0 +1,238 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "pohessian/HessianReplyCache.h"
+
+#include "conf.h"
+
+#include <string>
+#include <sstream>
+#include <list>
+#include <map>
+
+#include "pohessian/HessianTypes.h"
+#include "pohessian/Hessian1StreamWriter.h"
+
+#include "Poco/Types.h"
+#include "Poco/Mutex.h"
+#include "Poco/Timespan.h"
+#include "Poco/Timestamp.h"
+
+using Poco::UInt64;
+using Poco::FastMutex;
+using Poco::Timespan;
+using Poco::Timestamp;
+
+namespace PoHessian {
+
+    // The Hessian 1 encoding of the method and parameters; maps are written
+    // in key order so equal calls always encode the same
+    static std::string cacheKey(const CallPtr& call) {
+        std::ostringstream out;
+        Hessian1StreamWriter hessian_writer(out);
+        hessian_writer.setSortMaps(true);
+        hessian_writer.writeCall(new Call(call->getMethod(), HeaderList(), call->getParameters()));
+        return out.str();
+    }
+
+    // 64 bit FNV-1a
+    static UInt64 cacheHash(const std::string& key) {
+        UInt64 hash = 14695981039346656037ULL;
+        for (std::string::const_iterator it = key.begin(); it != key.end(); it++) {
+            hash ^= (unsigned char) *it;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    static bool isFaultReply(const ReplyPtr& reply) {
+        const ValuePtr& value = reply->getValue();
+        if (!value) return false;
+        return value->isFault();
+    }
+
+    static void freeze(const ReplyPtr& reply) {
+        reply->share();
+        const HeaderList& headers = reply->getHeaders();
+        for (HeaderList::const_iterator it = headers.begin(); it != headers.end(); it++)
+            if (!!(*it)->getValue())
+                (*it)->getValue()->freeze();
+        if (!!reply->getValue())
+            reply->getValue()->freeze();
+    }
+
+    HessianReplyCache::HessianReplyCache(const std::size_t maxEntries)
+    : _mutex(),
+    _maxEntries(maxEntries),
+    _timeToLive(),
+    _entries(),
+    _index(),
+    _hitCount(0),
+    _missCount(0),
+    _evictionCount(0),
+    _expirationCount(0) {
+    }
+
+    void HessianReplyCache::setMaxEntries(const std::size_t maxEntries) {
+        FastMutex::ScopedLock lock(_mutex);
+        _maxEntries = maxEntries;
+        while (_entries.size() > _maxEntries) {
+            erase(_index.find(_entries.back().hash));
+            _evictionCount++;
+        }
+    }
+
+    std::size_t HessianReplyCache::getMaxEntries() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _maxEntries;
+    }
+
+    void HessianReplyCache::setTimeToLive(const std::string& method, const Timespan& ttl) {
+        {
+            FastMutex::ScopedLock lock(_mutex);
+            if (ttl.totalMicroseconds() > 0) {
+                _timeToLive[method] = ttl;
+                return;
+            }
+            _timeToLive.erase(method);
+        }
+        invalidate(method);
+    }
+
+    Timespan HessianReplyCache::getTimeToLive(const std::string& method) const {
+        FastMutex::ScopedLock lock(_mutex);
+        std::map<std::string, Timespan>::const_iterator it = _timeToLive.find(method);
+        return it == _timeToLive.end() ? Timespan(0) : it->second;
+    }
+
+    bool HessianReplyCache::isCached(const std::string& method) const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _timeToLive.find(method) != _timeToLive.end();
+    }
+
+    void HessianReplyCache::erase(const EntryIndex::iterator it) {
+        _entries.erase(it->second);
+        _index.erase(it);
+    }
+
+    ReplyPtr HessianReplyCache::lookup(const CallPtr& call) {
+        if (!isCached(call->getMethod()))
+            return ReplyPtr();
+        std::string key = cacheKey(call);
+        UInt64 hash = cacheHash(key);
+        FastMutex::ScopedLock lock(_mutex);
+        EntryIndex::iterator it = _index.find(hash);
+        if (it == _index.end() || it->second->key != key) {
+            _missCount++;
+            return ReplyPtr();
+        }
+        if (it->second->expires <= Timestamp()) {
+            erase(it);
+            _expirationCount++;
+            _missCount++;
+            return ReplyPtr();
+        }
+        _entries.splice(_entries.begin(), _entries, it->second);
+        _hitCount++;
+        return it->second->reply;
+    }
+
+    void HessianReplyCache::store(const CallPtr& call, const ReplyPtr& reply) {
+        if (!reply || isFaultReply(reply))
+            return;
+        Timespan ttl = getTimeToLive(call->getMethod());
+        if (ttl.totalMicroseconds() <= 0)
+            return;
+        freeze(reply);
+        Entry entry;
+        entry.key = cacheKey(call);
+        entry.hash = cacheHash(entry.key);
+        entry.method = call->getMethod();
+        entry.reply = reply;
+        entry.expires = Timestamp() + ttl.totalMicroseconds();
+        FastMutex::ScopedLock lock(_mutex);
+        if (_maxEntries == 0)
+            return;
+        // a colliding call simply takes the slot over
+        EntryIndex::iterator it = _index.find(entry.hash);
+        if (it != _index.end())
+            erase(it);
+        while (_entries.size() >= _maxEntries) {
+            erase(_index.find(_entries.back().hash));
+            _evictionCount++;
+        }
+        _entries.push_front(entry);
+        _index.insert(std::make_pair(entry.hash, _entries.begin()));
+    }
+
+    void HessianReplyCache::invalidate(const CallPtr& call) {
+        std::string key = cacheKey(call);
+        UInt64 hash = cacheHash(key);
+        FastMutex::ScopedLock lock(_mutex);
+        EntryIndex::iterator it = _index.find(hash);
+        if (it != _index.end() && it->second->key == key)
+            erase(it);
+    }
+
+    void HessianReplyCache::invalidate(const std::string& method) {
+        FastMutex::ScopedLock lock(_mutex);
+        EntryList::iterator it = _entries.begin();
+        while (it != _entries.end()) {
+            EntryList::iterator next = it;
+            next++;
+            if (it->method == method)
+                erase(_index.find(it->hash));
+            it = next;
+        }
+    }
+
+    void HessianReplyCache::clear() {
+        FastMutex::ScopedLock lock(_mutex);
+        _entries.clear();
+        _index.clear();
+    }
+
+    std::size_t HessianReplyCache::getSize() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _entries.size();
+    }
+
+    UInt64 HessianReplyCache::getHitCount() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _hitCount;
+    }
+
+    UInt64 HessianReplyCache::getMissCount() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _missCount;
+    }
+
+    UInt64 HessianReplyCache::getEvictionCount() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _evictionCount;
+    }
+
+    UInt64 HessianReplyCache::getExpirationCount() const {
+        FastMutex::ScopedLock lock(_mutex);
+        return _expirationCount;
+    }
+
+}
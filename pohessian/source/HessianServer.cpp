@@ -0,0 +1,210 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "pohessian/HessianServer.h"
+
+#include "conf.h"
+
+#include <string>
+#include <limits>
+#include <istream>
+#include <ostream>
+
+#include "pohessian/HessianTypes.h"
+#include "pohessian/HessianDispatcher.h"
+#include "pohessian/Hessian1StreamReader.h"
+#include "pohessian/Hessian1StreamWriter.h"
+
+#include "Poco/Exception.h"
+#include "Poco/InflatingStream.h"
+#include "Poco/SharedPtr.h"
+#include "Poco/String.h"
+
+#include "Poco/Net/HTTPRequest.h"
+#include "Poco/Net/HTTPResponse.h"
+#include "Poco/Net/HTTPRequestHandler.h"
+#include "Poco/Net/HTTPRequestHandlerFactory.h"
+#include "Poco/Net/HTTPServer.h"
+#include "Poco/Net/HTTPServerParams.h"
+#include "Poco/Net/HTTPServerRequest.h"
+#include "Poco/Net/HTTPServerResponse.h"
+#include "Poco/Net/ServerSocket.h"
+
+using Poco::Exception;
+using Poco::SharedPtr;
+using Poco::InflatingInputStream;
+using Poco::InflatingStreamBuf;
+
+using Poco::Net::HTTPRequest;
+using Poco::Net::HTTPResponse;
+using Poco::Net::HTTPRequestHandler;
+using Poco::Net::HTTPRequestHandlerFactory;
+using Poco::Net::HTTPServer;
+using Poco::Net::HTTPServerParams;
+using Poco::Net::HTTPServerRequest;
+using Poco::Net::HTTPServerResponse;
+using Poco::Net::ServerSocket;
+
+using Poco::icompare;
+
+namespace PoHessian {
+
+    static CallPtr readHessian1HttpCall(HTTPServerRequest& request) {
+        std::string encoding = request.get("Content-Encoding", "");
+        if (encoding.empty() || icompare(encoding, "identity") == 0) {
+            Hessian1StreamReader hessian_reader(request.stream());
+            return hessian_reader.readCall();
+        } else if (icompare(encoding, "gzip") == 0 || icompare(encoding, "x-gzip") == 0) {
+            InflatingInputStream inflater(request.stream(), InflatingStreamBuf::STREAM_GZIP);
+            Hessian1StreamReader hessian_reader(inflater);
+            return hessian_reader.readCall();
+        } else if (icompare(encoding, "deflate") == 0) {
+            InflatingInputStream inflater(request.stream(), InflatingStreamBuf::STREAM_ZLIB);
+            Hessian1StreamReader hessian_reader(inflater);
+            return hessian_reader.readCall();
+        } else {
+            throw Exception("Unsupported Content-Encoding: " + encoding);
+        }
+    }
+
+    class HessianRequestHandler : public HTTPRequestHandler {
+    public:
+
+        HessianRequestHandler(const SharedPtr<HessianDispatcher>& dispatcher)
+        : _dispatcher(dispatcher) {
+        }
+
+        void handleRequest(HTTPServerRequest& request, HTTPServerResponse& response) {
+            if (request.getMethod() != HTTPRequest::HTTP_POST) {
+                response.set("Allow", HTTPRequest::HTTP_POST);
+                response.setStatusAndReason(HTTPResponse::HTTP_METHOD_NOT_ALLOWED);
+                response.setContentLength(0);
+                response.send();
+                return;
+            }
+            ReplyPtr reply;
+            try {
+                CallPtr call = readHessian1HttpCall(request);
+                // whatever follows the call, down to the last chunk or the
+                // gzip trailer, must be off the wire before the connection
+                // can carry another request
+                request.stream().ignore(std::numeric_limits<std::streamsize>::max());
+                reply = _dispatcher->dispatch(call);
+            } catch (Exception& e) {
+                // the request body cannot be trusted any more, neither can the connection
+                response.setKeepAlive(false);
+                reply = _dispatcher->protocolFault(e.displayText());
+            }
+            response.setContentType("application/x-hessian");
+            response.setChunkedTransferEncoding(true);
+            Hessian1StreamWriter hessian_writer(response.send());
+            hessian_writer.writeReply(reply);
+        }
+
+    private:
+        SharedPtr<HessianDispatcher> _dispatcher;
+    };
+
+    class HessianRequestHandlerFactory : public HTTPRequestHandlerFactory {
+    public:
+
+        HessianRequestHandlerFactory(const SharedPtr<HessianDispatcher>& dispatcher)
+        : _dispatcher(dispatcher) {
+        }
+
+        HTTPRequestHandler* createRequestHandler(const HTTPServerRequest&) {
+            return new HessianRequestHandler(_dispatcher);
+        }
+
+    private:
+        SharedPtr<HessianDispatcher> _dispatcher;
+    };
+
+    HessianServer::HessianServer(const SharedPtr<HessianDispatcher>& dispatcher,
+            const ServerSocket& socket, const int maxThreads, const int maxQueued)
+    : _dispatcher(dispatcher),
+    _maxThreads(maxThreads),
+    _maxQueued(maxQueued),
+    _threadPool("HessianServer", 1, maxThreads),
+    _server(NULL) {
+        if (_dispatcher.isNull())
+            throw Exception("Null dispatcher");
+        if (_maxThreads < 1)
+            throw Exception("Server needs at least 1 thread");
+        if (_maxQueued < 0)
+            throw Exception("Server max queued connections cannot be negative");
+        HTTPServerParams* params = new HTTPServerParams;
+        params->setMaxThreads(_maxThreads);
+        params->setMaxQueued(_maxQueued);
+        params->setKeepAlive(true);
+        _server = new HTTPServer(new HessianRequestHandlerFactory(_dispatcher), _threadPool, socket, params);
+    }
+
+    HessianServer::~HessianServer() {
+        try {
+            stop();
+        } catch (...) {
+        }
+        delete _server;
+        _threadPool.joinAll();
+    }
+
+    const SharedPtr<HessianDispatcher>& HessianServer::getDispatcher() const {
+        return _dispatcher;
+    }
+
+    int HessianServer::getMaxThreads() const {
+        return _maxThreads;
+    }
+
+    int HessianServer::getMaxQueued() const {
+        return _maxQueued;
+    }
+
+    void HessianServer::start() {
+        _server->start();
+    }
+
+    void HessianServer::stop() {
+        _server->stop();
+    }
+
+    Poco::UInt16 HessianServer::getPort() const {
+        return _server->port();
+    }
+
+    int HessianServer::getCurrentThreads() const {
+        return _server->currentThreads();
+    }
+
+    int HessianServer::getCurrentConnections() const {
+        return _server->currentConnections();
+    }
+
+    int HessianServer::getQueuedConnections() const {
+        return _server->queuedConnections();
+    }
+
+    int HessianServer::getRefusedConnections() const {
+        return _server->refusedConnections();
+    }
+
+}
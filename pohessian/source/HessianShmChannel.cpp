@@ -0,0 +1,642 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "pohessian/HessianShmChannel.h"
+
+#include "conf.h"
+
+#include <string>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <algorithm>
+
+#if defined(HAVE_LINUX_FUTEX_H) && defined(HAVE_SYS_MMAN_H)
+#define POHESSIAN_HAVE_SHM 1
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include "pohessian/HessianTypes.h"
+#include "pohessian/Hessian1StreamReader.h"
+#include "pohessian/Hessian1StreamWriter.h"
+
+#include "Poco/Exception.h"
+#include "Poco/Types.h"
+#include "Poco/Mutex.h"
+
+using Poco::Exception;
+using Poco::IOException;
+using Poco::SystemException;
+using Poco::NotImplementedException;
+using Poco::Int32;
+using Poco::UInt32;
+using Poco::UInt64;
+using Poco::Mutex;
+
+namespace PoHessian {
+
+    const std::size_t HessianShmChannel::DEFAULT_CAPACITY = 1 << 20;
+
+#ifdef POHESSIAN_HAVE_SHM
+
+    static const UInt32 shm_magic = 0x50484d31;
+
+    // Every reset of the rings starts their positions over at the next
+    // multiple of this, a capacity never being larger
+    static const UInt64 shm_epoch_size = (UInt64) 1 << 40;
+
+    // Positions only ever grow, the byte at position p lives at p modulo
+    // the capacity. Each side writes its own cache line.
+    struct ShmRing {
+        UInt64 head;
+        char headPadding[56];
+        UInt64 tail;
+        char tailPadding[56];
+        UInt32 dataSeq;
+        UInt32 consumerWaiting;
+        UInt32 spaceSeq;
+        UInt32 producerWaiting;
+        char seqPadding[48];
+    };
+
+    // A client pid of 0 means no client, -1 a client that left in the
+    // middle of a call. The epoch counts the resets of the rings.
+    struct ShmHeader {
+        UInt32 magic;
+        UInt32 epoch;
+        UInt64 capacity;
+        Int32 serverPid;
+        Int32 clientPid;
+        char padding[40];
+        ShmRing calls;
+        ShmRing replies;
+    };
+
+    static void futexWait(UInt32* word, const UInt32 expected, const long milliseconds) {
+        struct timespec timeout;
+        timeout.tv_sec = milliseconds / 1000;
+        timeout.tv_nsec = (milliseconds % 1000) * 1000000;
+        syscall(SYS_futex, word, FUTEX_WAIT, expected, &timeout, NULL, 0);
+    }
+
+    static void futexWake(UInt32* word) {
+        syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+
+    static bool isProcessAlive(const Int32 pid) {
+        return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+    }
+
+    // What both ends of a ring share: the ring, waiting on the other end
+    // and noticing when it is gone.
+    class ShmRingEnd : public std::streambuf {
+    public:
+
+        ShmRingEnd(ShmRing* ring, char* data, const UInt64 capacity, Int32* peerPid, const bool peerRequired, Int32* clientPid)
+        : _ring(ring),
+        _data(data),
+        _capacity(capacity),
+        _peerPid(peerPid),
+        _peerRequired(peerRequired),
+        _clientPid(clientPid),
+        _self(getpid()),
+        _peerGone(false),
+        _spinCount(1000),
+        _position(0) {
+        }
+
+        void setSpinCount(const unsigned int spinCount) {
+            _spinCount = spinCount;
+        }
+
+        bool isPeerGone() const {
+            return _peerGone;
+        }
+
+        // ring position up to which this end released or published
+        UInt64 getPosition() const {
+            return _position;
+        }
+
+    protected:
+
+        // Bytes this end can read or write without waiting
+        virtual UInt64 ready() const = 0;
+
+        void wait(UInt32* seq, UInt32* waiting) {
+            for (unsigned int i = 0; i < _spinCount; i++)
+                if (ready() > 0)
+                    return;
+            for (;;) {
+                UInt32 expected = __atomic_load_n(seq, __ATOMIC_SEQ_CST);
+                __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+                if (ready() == 0)
+                    futexWait(seq, expected, 10);
+                __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+                if (ready() > 0)
+                    return;
+                checkPeer();
+            }
+        }
+
+        void wake(UInt32* seq, UInt32* waiting) {
+            if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+                __atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+                futexWake(seq);
+            }
+        }
+
+        void checkPeer() {
+            Int32 pid = __atomic_load_n(_peerPid, __ATOMIC_SEQ_CST);
+            if (pid == 0 ? _peerRequired : !isProcessAlive(pid)) {
+                _peerGone = true;
+                throw IOException("Shared memory channel peer is gone");
+            }
+            checkEvicted();
+        }
+
+        // a client whose calls the server could not make sense of is
+        // evicted and must not touch the rings anymore
+        void checkEvicted() {
+            if (_clientPid && __atomic_load_n(_clientPid, __ATOMIC_SEQ_CST) != _self) {
+                _peerGone = true;
+                throw IOException("Evicted from the shared memory channel");
+            }
+        }
+
+        // Moves the ring position this end owns from _position on. Once the
+        // server reset the rings it is somewhere else, in a later epoch, and
+        // an evicted client must not store its stale one over it
+        void advance(UInt64* owned, const UInt64 position) {
+            UInt64 expected = _position;
+            if (!__atomic_compare_exchange_n(owned, &expected, position, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+                _peerGone = true;
+                throw IOException("Evicted from the shared memory channel");
+            }
+            _position = position;
+        }
+
+        char* at(const UInt64 position) const {
+            return _data + (position & (_capacity - 1));
+        }
+
+        UInt64 contiguous(const UInt64 position, const UInt64 n) const {
+            return std::min(n, _capacity - (position & (_capacity - 1)));
+        }
+
+        ShmRing* _ring;
+        char* _data;
+        const UInt64 _capacity;
+        Int32* _peerPid;
+        const bool _peerRequired;
+        Int32* _clientPid;
+        const Int32 _self;
+        bool _peerGone;
+        unsigned int _spinCount;
+        // ring position of the start of the get or put area
+        UInt64 _position;
+    };
+
+    // The get area is the readable part of the ring itself.
+    class ShmRingReader : public ShmRingEnd {
+    public:
+
+        ShmRingReader(ShmRing* ring, char* data, const UInt64 capacity, Int32* peerPid, const bool peerRequired, Int32* clientPid)
+        : ShmRingEnd(ring, data, capacity, peerPid, peerRequired, clientPid) {
+            setg(NULL, NULL, NULL);
+        }
+
+        // Hands the bytes read so far back to the producer
+        void release() {
+            advance(&_ring->tail, _position + (gptr() - eback()));
+            setg(gptr(), gptr(), egptr());
+            wake(&_ring->spaceSeq, &_ring->producerWaiting);
+        }
+
+        void reset(const UInt64 position) {
+            _position = position;
+            _peerGone = false;
+            setg(NULL, NULL, NULL);
+        }
+
+    protected:
+
+        UInt64 ready() const {
+            return __atomic_load_n(&_ring->head, __ATOMIC_SEQ_CST) - _position;
+        }
+
+        int underflow() {
+            release();
+            if (ready() == 0)
+                wait(&_ring->dataSeq, &_ring->consumerWaiting);
+            char* begin = at(_position);
+            setg(begin, begin, begin + contiguous(_position, ready()));
+            return traits_type::to_int_type(*begin);
+        }
+    };
+
+    // The put area is the free part of the ring itself.
+    class ShmRingWriter : public ShmRingEnd {
+    public:
+
+        ShmRingWriter(ShmRing* ring, char* data, const UInt64 capacity, Int32* peerPid, const bool peerRequired, Int32* clientPid)
+        : ShmRingEnd(ring, data, capacity, peerPid, peerRequired, clientPid) {
+            setp(NULL, NULL);
+        }
+
+        // Makes the bytes written so far visible to the consumer
+        void publish() {
+            checkEvicted();
+            advance(&_ring->head, _position + (pptr() - pbase()));
+            setp(pptr(), epptr());
+            wake(&_ring->dataSeq, &_ring->consumerWaiting);
+        }
+
+        void reset(const UInt64 position) {
+            _position = position;
+            _peerGone = false;
+            setp(NULL, NULL);
+        }
+
+    protected:
+
+        UInt64 ready() const {
+            return _capacity - (_position - __atomic_load_n(&_ring->tail, __ATOMIC_SEQ_CST));
+        }
+
+        int overflow(int c) {
+            publish();
+            if (ready() == 0)
+                wait(&_ring->spaceSeq, &_ring->producerWaiting);
+            char* begin = at(_position);
+            setp(begin, begin + contiguous(_position, ready()));
+            if (c != traits_type::eof()) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() {
+            publish();
+            return 0;
+        }
+    };
+
+    class ShmChannelImpl {
+    public:
+
+        ShmChannelImpl(const std::string& name, const HessianShmChannel::Side side, const std::size_t capacity)
+        : _name(name),
+        _side(side),
+        _fd(-1),
+        _size(0),
+        _header(NULL),
+        _reader(NULL),
+        _writer(NULL),
+        _in(NULL),
+        _out(NULL),
+        _mutex(),
+        _broken(false),
+        _spinCount(1000) {
+            if (side == HessianShmChannel::SIDE_SERVER)
+                create(capacity);
+            else
+                attach();
+            char* calls = reinterpret_cast<char*> (_header + 1);
+            char* replies = calls + _header->capacity;
+            if (side == HessianShmChannel::SIDE_SERVER) {
+                _reader = new ShmRingReader(&_header->calls, calls, _header->capacity, &_header->clientPid, false, NULL);
+                _writer = new ShmRingWriter(&_header->replies, replies, _header->capacity, &_header->clientPid, true, NULL);
+            } else {
+                _reader = new ShmRingReader(&_header->replies, replies, _header->capacity, &_header->serverPid, true, &_header->clientPid);
+                _writer = new ShmRingWriter(&_header->calls, calls, _header->capacity, &_header->serverPid, true, &_header->clientPid);
+                // pick up where the previous client left the rings
+                _reader->reset(__atomic_load_n(&_header->replies.tail, __ATOMIC_SEQ_CST));
+                _writer->reset(__atomic_load_n(&_header->calls.head, __ATOMIC_SEQ_CST));
+            }
+            _in.rdbuf(_reader);
+            _in.exceptions(std::ios::badbit);
+            _out.rdbuf(_writer);
+            _out.exceptions(std::ios::badbit);
+        }
+
+        ~ShmChannelImpl() {
+            if (_side == HessianShmChannel::SIDE_SERVER) {
+                __atomic_store_n(&_header->serverPid, 0, __ATOMIC_SEQ_CST);
+                shm_unlink(_name.c_str());
+            } else {
+                Int32 self = getpid();
+                __atomic_compare_exchange_n(&_header->clientPid, &self, _broken ? -1 : 0, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+            }
+            delete _reader;
+            delete _writer;
+            munmap(_header, _size);
+            close(_fd);
+        }
+
+        const std::string& getName() const {
+            return _name;
+        }
+
+        HessianShmChannel::Side getSide() const {
+            return _side;
+        }
+
+        std::size_t getCapacity() const {
+            return (std::size_t) _header->capacity;
+        }
+
+        void setSpinCount(const unsigned int spinCount) {
+            _reader->setSpinCount(spinCount);
+            _writer->setSpinCount(spinCount);
+            _spinCount = spinCount;
+        }
+
+        unsigned int getSpinCount() const {
+            return _spinCount;
+        }
+
+        ReplyPtr call(const CallPtr& call, UInt64& sent, UInt64& received) {
+            Mutex::ScopedLock lock(_mutex);
+            if (_broken)
+                throw IOException("Shared memory channel " + _name + " is broken");
+            try {
+                UInt64 written = _writer->getPosition();
+                Hessian1StreamWriter hessian_writer(_out);
+                hessian_writer.writeCall(call);
+                _out.flush();
+                sent += _writer->getPosition() - written;
+                UInt64 read = _reader->getPosition();
+                Hessian1StreamReader hessian_reader(_in);
+                ReplyPtr reply = hessian_reader.readReply();
+                _reader->release();
+                received += _reader->getPosition() - read;
+                return reply;
+            } catch (...) {
+                // the rings are out of sync, the server forgets this client
+                // once it is detached as broken
+                _broken = true;
+                throw;
+            }
+        }
+
+        CallPtr readCall() {
+            Mutex::ScopedLock lock(_mutex);
+            for (;;) {
+                if (_broken || _reader->isPeerGone() || _writer->isPeerGone())
+                    reset();
+                try {
+                    Hessian1StreamReader hessian_reader(_in);
+                    CallPtr call = hessian_reader.readCall();
+                    _reader->release();
+                    return call;
+                } catch (...) {
+                    // a client gone in the middle of a call is forgotten,
+                    // the next one is waited for
+                    _broken = true;
+                    if (!_reader->isPeerGone())
+                        throw;
+                }
+            }
+        }
+
+        void writeReply(const ReplyPtr& reply) {
+            Mutex::ScopedLock lock(_mutex);
+            try {
+                Hessian1StreamWriter hessian_writer(_out);
+                hessian_writer.writeReply(reply);
+                _out.flush();
+            } catch (...) {
+                _broken = true;
+                throw;
+            }
+        }
+
+    private:
+
+        void create(const std::size_t capacity) {
+            if (capacity > shm_epoch_size)
+                throw Exception("Shared memory channel capacity too large");
+            UInt64 rounded = 4096;
+            while (rounded < capacity)
+                rounded <<= 1;
+            // left over by a server that did not exit cleanly
+            shm_unlink(_name.c_str());
+            _fd = shm_open(_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (_fd < 0)
+                throw SystemException("Cannot create shared memory channel " + _name);
+            _size = sizeof (ShmHeader) + 2 * rounded;
+            if (ftruncate(_fd, _size) != 0) {
+                close(_fd);
+                shm_unlink(_name.c_str());
+                throw SystemException("Cannot size shared memory channel " + _name);
+            }
+            map();
+            _header->capacity = rounded;
+            _header->serverPid = getpid();
+            __atomic_store_n(&_header->magic, shm_magic, __ATOMIC_SEQ_CST);
+        }
+
+        void attach() {
+            _fd = shm_open(_name.c_str(), O_RDWR, 0);
+            if (_fd < 0)
+                throw IOException("No shared memory channel " + _name);
+            struct stat st;
+            if (fstat(_fd, &st) != 0 || (std::size_t) st.st_size < sizeof (ShmHeader)) {
+                close(_fd);
+                throw IOException("Invalid shared memory channel " + _name);
+            }
+            _size = st.st_size;
+            map();
+            if (__atomic_load_n(&_header->magic, __ATOMIC_SEQ_CST) != shm_magic
+                    || _size != sizeof (ShmHeader) + 2 * _header->capacity
+                    || !isProcessAlive(_header->serverPid)) {
+                munmap(_header, _size);
+                close(_fd);
+                throw IOException("Invalid shared memory channel " + _name);
+            }
+            // a dead client is forgotten by the server within milliseconds
+            for (int attempt = 0;; attempt++) {
+                Int32 expected = 0;
+                if (__atomic_compare_exchange_n(&_header->clientPid, &expected, (Int32) getpid(), false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+                    break;
+                if (isProcessAlive(expected) || attempt == 100) {
+                    munmap(_header, _size);
+                    close(_fd);
+                    throw IOException("Shared memory channel " + _name + " is busy");
+                }
+                usleep(10000);
+            }
+        }
+
+        void map() {
+            void* memory = mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+            if (memory == MAP_FAILED) {
+                close(_fd);
+                if (_side == HessianShmChannel::SIDE_SERVER)
+                    shm_unlink(_name.c_str());
+                throw SystemException("Cannot map shared memory channel " + _name);
+            }
+            _header = static_cast<ShmHeader*> (memory);
+        }
+
+        // Server side only: with the client gone or evicted, the rings start
+        // over empty for the next one, in a new epoch. An evicted client
+        // still running only ever compares and exchanges its positions from
+        // the previous epoch, so it cannot move them anymore.
+        void reset() {
+            Int32 pid = __atomic_load_n(&_header->clientPid, __ATOMIC_SEQ_CST);
+            if (isProcessAlive(pid))
+                __atomic_compare_exchange_n(&_header->clientPid, &pid, -1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+            UInt64 start = (UInt64) __atomic_add_fetch(&_header->epoch, 1, __ATOMIC_SEQ_CST) * shm_epoch_size;
+            __atomic_store_n(&_header->calls.head, start, __ATOMIC_SEQ_CST);
+            __atomic_store_n(&_header->calls.tail, start, __ATOMIC_SEQ_CST);
+            __atomic_store_n(&_header->replies.head, start, __ATOMIC_SEQ_CST);
+            __atomic_store_n(&_header->replies.tail, start, __ATOMIC_SEQ_CST);
+            _reader->reset(start);
+            _writer->reset(start);
+            _in.clear();
+            _out.clear();
+            _broken = false;
+            pid = __atomic_load_n(&_header->clientPid, __ATOMIC_SEQ_CST);
+            if (!isProcessAlive(pid))
+                __atomic_compare_exchange_n(&_header->clientPid, &pid, 0, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+        }
+
+        const std::string _name;
+        const HessianShmChannel::Side _side;
+        int _fd;
+        std::size_t _size;
+        ShmHeader* _header;
+        ShmRingReader* _reader;
+        ShmRingWriter* _writer;
+        std::istream _in;
+        std::ostream _out;
+        Mutex _mutex;
+        bool _broken;
+        unsigned int _spinCount;
+    };
+
+#else
+
+    class ShmChannelImpl {
+    public:
+
+        ShmChannelImpl(const std::string&, const HessianShmChannel::Side, const std::size_t) {
+            throw NotImplementedException("Shared memory channels need Linux");
+        }
+
+        const std::string& getName() const {
+            throw NotImplementedException();
+        }
+
+        HessianShmChannel::Side getSide() const {
+            throw NotImplementedException();
+        }
+
+        std::size_t getCapacity() const {
+            throw NotImplementedException();
+        }
+
+        void setSpinCount(const unsigned int) {
+        }
+
+        unsigned int getSpinCount() const {
+            return 0;
+        }
+
+        ReplyPtr call(const CallPtr&, UInt64&, UInt64&) {
+            throw NotImplementedException();
+        }
+
+        CallPtr readCall() {
+            throw NotImplementedException();
+        }
+
+        void writeReply(const ReplyPtr&) {
+            throw NotImplementedException();
+        }
+    };
+
+#endif
+
+    HessianShmChannel::HessianShmChannel(const std::string& name, const Side side, const std::size_t capacity)
+    : _impl(new ShmChannelImpl(name, side, capacity)) {
+    }
+
+    HessianShmChannel::~HessianShmChannel() {
+        delete _impl;
+    }
+
+    const std::string& HessianShmChannel::getName() const {
+        return _impl->getName();
+    }
+
+    HessianShmChannel::Side HessianShmChannel::getSide() const {
+        return _impl->getSide();
+    }
+
+    std::size_t HessianShmChannel::getCapacity() const {
+        return _impl->getCapacity();
+    }
+
+    void HessianShmChannel::setSpinCount(const unsigned int spinCount) {
+        _impl->setSpinCount(spinCount);
+    }
+
+    unsigned int HessianShmChannel::getSpinCount() const {
+        return _impl->getSpinCount();
+    }
+
+    ReplyPtr HessianShmChannel::call(const CallPtr& call) {
+        UInt64 sent = 0;
+        UInt64 received = 0;
+        return this->call(call, sent, received);
+    }
+
+    ReplyPtr HessianShmChannel::call(const CallPtr& call, UInt64& sent, UInt64& received) {
+        if (getSide() != SIDE_CLIENT)
+            throw Exception("Only the client side of a shared memory channel sends calls");
+        return _impl->call(call, sent, received);
+    }
+
+    CallPtr HessianShmChannel::readCall() {
+        if (getSide() != SIDE_SERVER)
+            throw Exception("Only the server side of a shared memory channel reads calls");
+        return _impl->readCall();
+    }
+
+    void HessianShmChannel::writeReply(const ReplyPtr& reply) {
+        if (getSide() != SIDE_SERVER)
+            throw Exception("Only the server side of a shared memory channel writes replies");
+        _impl->writeReply(reply);
+    }
+
+}
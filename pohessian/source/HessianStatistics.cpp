@@ -0,0 +1,177 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "pohessian/HessianStatistics.h"
+
+#include "conf.h"
+
+#include <vector>
+#include <algorithm>
+
+#include "Poco/Exception.h"
+#include "Poco/Types.h"
+#include "Poco/Timespan.h"
+
+using Poco::Int64;
+using Poco::UInt64;
+using Poco::Timespan;
+using Poco::Exception;
+
+namespace PoHessian {
+
+    static const int sub_bucket_bits = 3;
+    static const int sub_bucket_count = 1 << sub_bucket_bits;
+    static const std::vector<UInt64>::size_type bucket_count = sub_bucket_count + (63 - sub_bucket_bits) * sub_bucket_count;
+
+    static std::vector<UInt64>::size_type bucketIndex(Int64 value) {
+        if (value < sub_bucket_count)
+            return value < 0 ? 0 : (std::vector<UInt64>::size_type) value;
+        int exponent = 0;
+        for (UInt64 tmp = (UInt64) value; tmp > 1; tmp >>= 1)
+            exponent++;
+        int shift = exponent - sub_bucket_bits;
+        int mantissa = (int) ((value >> shift) & (sub_bucket_count - 1));
+        return sub_bucket_count + shift * sub_bucket_count + mantissa;
+    }
+
+    static Int64 bucketUpperBound(std::vector<UInt64>::size_type index) {
+        if (index < (std::vector<UInt64>::size_type) sub_bucket_count)
+            return (Int64) index;
+        int shift = (int) ((index - sub_bucket_count) / sub_bucket_count);
+        Int64 mantissa = (Int64) ((index - sub_bucket_count) % sub_bucket_count);
+        return ((sub_bucket_count + mantissa + 1) << shift) - 1;
+    }
+
+    LatencyHistogram::LatencyHistogram()
+    : _buckets(bucket_count, 0),
+    _count(0),
+    _min(0),
+    _max(0),
+    _total(0) {
+    }
+
+    void LatencyHistogram::record(const Timespan& latency) {
+        Int64 value = std::max((Int64) 0, (Int64) latency.totalMicroseconds());
+        _buckets[bucketIndex(value)]++;
+        if (_count == 0 || value < _min)
+            _min = value;
+        if (_count == 0 || value > _max)
+            _max = value;
+        _total += value;
+        _count++;
+    }
+
+    void LatencyHistogram::merge(const LatencyHistogram& histogram) {
+        if (histogram._count == 0)
+            return;
+        for (std::vector<UInt64>::size_type i = 0; i < bucket_count; i++)
+            _buckets[i] += histogram._buckets[i];
+        if (_count == 0 || histogram._min < _min)
+            _min = histogram._min;
+        if (_count == 0 || histogram._max > _max)
+            _max = histogram._max;
+        _total += histogram._total;
+        _count += histogram._count;
+    }
+
+    void LatencyHistogram::reset() {
+        std::fill(_buckets.begin(), _buckets.end(), 0);
+        _count = 0;
+        _min = 0;
+        _max = 0;
+        _total = 0;
+    }
+
+    UInt64 LatencyHistogram::getCount() const {
+        return _count;
+    }
+
+    Timespan LatencyHistogram::getMin() const {
+        return Timespan(_min);
+    }
+
+    Timespan LatencyHistogram::getMax() const {
+        return Timespan(_max);
+    }
+
+    Timespan LatencyHistogram::getMean() const {
+        if (_count == 0)
+            return Timespan(0);
+        return Timespan(_total / (Int64) _count);
+    }
+
+    Timespan LatencyHistogram::getPercentile(const double percentile) const {
+        if (percentile < 0.0 || percentile > 100.0)
+            throw Exception("Percentile must be between 0 and 100");
+        if (_count == 0)
+            return Timespan(0);
+        UInt64 rank = (UInt64) (percentile / 100.0 * _count + 0.5);
+        if (rank < 1)
+            rank = 1;
+        UInt64 seen = 0;
+        for (std::vector<UInt64>::size_type i = 0; i < bucket_count; i++) {
+            seen += _buckets[i];
+            if (seen >= rank)
+                return Timespan(std::min(bucketUpperBound(i), _max));
+        }
+        return Timespan(_max);
+    }
+
+    MovingAverage::MovingAverage(const double weight)
+    : _weight(0.3),
+    _count(0),
+    _average(0.0) {
+        setWeight(weight);
+    }
+
+    void MovingAverage::setWeight(const double weight) {
+        if (weight <= 0.0 || weight > 1.0)
+            throw Exception("Moving average weight must be greater than 0 and at most 1");
+        _weight = weight;
+    }
+
+    double MovingAverage::getWeight() const {
+        return _weight;
+    }
+
+    void MovingAverage::record(const Timespan& latency) {
+        double value = (double) std::max((Int64) 0, (Int64) latency.totalMicroseconds());
+        if (_count == 0)
+            _average = value;
+        else
+            _average += _weight * (value - _average);
+        _count++;
+    }
+
+    void MovingAverage::reset() {
+        _count = 0;
+        _average = 0.0;
+    }
+
+    UInt64 MovingAverage::getCount() const {
+        return _count;
+    }
+
+    Timespan MovingAverage::getAverage() const {
+        return Timespan((Int64) (_average + 0.5));
+    }
+
+}
@@ -25,12 +25,44 @@
 #include <istream>
 
 #include "pohessian/HessianTypes.h"
+#include "pohessian/HessianInternTable.h"
+
+#include "Poco/SharedPtr.h"
+
+using Poco::SharedPtr;
 
 namespace PoHessian {
 
     HessianStreamReader::HessianStreamReader(std::istream& in)
     : _in(in),
-    _refs() {
+    _refs(),
+    _useArena(false),
+    _useArrays(false),
+    _internTable() {
+    }
+
+    void HessianStreamReader::setUseArena(const bool useArena) {
+        _useArena = useArena;
+    }
+
+    bool HessianStreamReader::getUseArena() const {
+        return _useArena;
+    }
+
+    void HessianStreamReader::setUseArrays(const bool useArrays) {
+        _useArrays = useArrays;
+    }
+
+    bool HessianStreamReader::getUseArrays() const {
+        return _useArrays;
+    }
+
+    void HessianStreamReader::setInternTable(const SharedPtr<HessianInternTable>& table) {
+        _internTable = table;
+    }
+
+    const SharedPtr<HessianInternTable>& HessianStreamReader::getInternTable() const {
+        return _internTable;
     }
 
 }
@@ -30,7 +30,16 @@ namespace PoHessian {
 
     HessianStreamWriter::HessianStreamWriter(std::ostream& out)
     : _out(out),
-    _refs() {
+    _refs(),
+    _sortMaps(false) {
+    }
+
+    void HessianStreamWriter::setSortMaps(const bool sortMaps) {
+        _sortMaps = sortMaps;
+    }
+
+    bool HessianStreamWriter::getSortMaps() const {
+        return _sortMaps;
     }
 
 }
@@ -0,0 +1,896 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "pohessian/HessianTcpServer.h"
+
+#include "conf.h"
+
+#include <string>
+#include <deque>
+#include <map>
+#include <vector>
+#include <istream>
+#include <streambuf>
+#include <limits>
+
+#include "pohessian/HessianTypes.h"
+#include "pohessian/HessianDispatcher.h"
+#include "pohessian/Hessian1StreamReader.h"
+#include "pohessian/Hessian1StreamWriter.h"
+
+#include "Poco/AtomicCounter.h"
+#include "Poco/AutoPtr.h"
+#include "Poco/Exception.h"
+#include "Poco/Mutex.h"
+#include "Poco/NObserver.h"
+#include "Poco/RefCountedObject.h"
+#include "Poco/Runnable.h"
+#include "Poco/Semaphore.h"
+#include "Poco/SharedPtr.h"
+#include "Poco/Thread.h"
+
+#include "Poco/Net/ServerSocket.h"
+#include "Poco/Net/SocketAddress.h"
+#include "Poco/Net/SocketNotification.h"
+#include "Poco/Net/SocketReactor.h"
+#include "Poco/Net/SocketStream.h"
+#include "Poco/Net/StreamSocket.h"
+
+using Poco::AtomicCounter;
+using Poco::AutoPtr;
+using Poco::Exception;
+using Poco::Mutex;
+using Poco::NObserver;
+using Poco::RefCountedObject;
+using Poco::Runnable;
+using Poco::Semaphore;
+using Poco::SharedPtr;
+using Poco::Thread;
+using Poco::UInt32;
+using Poco::UInt64;
+
+using Poco::Net::ReadableNotification;
+using Poco::Net::ServerSocket;
+using Poco::Net::SocketAddress;
+using Poco::Net::SocketOutputStream;
+using Poco::Net::SocketReactor;
+using Poco::Net::StreamSocket;
+
+namespace PoHessian {
+
+    // Reads straight out of the connection buffer, remembering how far a
+    // decode went
+    class MemoryStreamBuf : public std::streambuf {
+    public:
+
+        MemoryStreamBuf(const char* data, const std::size_t size) {
+            char* begin = const_cast<char*> (data);
+            setg(begin, begin, begin + size);
+        }
+
+        std::size_t consumed() const {
+            return gptr() - eback();
+        }
+    };
+
+    // Finds where a Hessian 1 call ends without decoding it, following the
+    // grammar Hessian1StreamReader reads. Fed the bytes of a call as they
+    // come in, it only scans the new ones, so a call trickling in over many
+    // reads is scanned once and decoded once.
+    class CallFramer {
+    public:
+
+        enum Result {
+            FRAMER_INCOMPLETE,
+            FRAMER_COMPLETE,
+            FRAMER_MALFORMED
+        };
+
+        CallFramer()
+        : _stack(),
+        _length(0) {
+            reset();
+        }
+
+        // forgets the call scanned so far, the next byte starts another
+        void reset() {
+            _stack.clear();
+            _stack.push_back(Frame(CALL_START));
+            _length = 0;
+        }
+
+        // Scans on from where the last scan stopped; data holds the whole
+        // call received so far, from its first byte
+        Result scan(const char* data, const std::size_t size) {
+            while (_length < size) {
+                Result result = step((unsigned char) data[_length]);
+                if (result == FRAMER_MALFORMED)
+                    return result;
+                _length++;
+                if (_stack.empty())
+                    return FRAMER_COMPLETE;
+            }
+            return FRAMER_INCOMPLETE;
+        }
+
+        // bytes of the call scanned so far, all of it once complete
+        std::size_t getLength() const {
+            return _length;
+        }
+
+    private:
+
+        enum State {
+            CALL_START,
+            CALL_HEADERS,
+            CALL_PARAMETERS,
+            VALUE,
+            // chunks of a string or binary, count is the final chunk tag
+            CHUNKS,
+            LIST_TYPE,
+            LIST_LENGTH,
+            LIST_ELEMENTS,
+            MAP_TYPE,
+            MAP_ENTRIES,
+            FAULT_ENTRIES,
+            TYPE_NAME,
+            // a 16 bit length of characters (count 1) or bytes (count 0)
+            LENGTH,
+            CHARACTERS,
+            BYTES
+        };
+
+        struct Frame {
+
+            Frame(const State state, const UInt32 count = 0)
+            : state(state),
+            count(count),
+            length(0) {
+            }
+
+            State state;
+            UInt32 count;
+            // the first length byte read so far, plus one
+            UInt32 length;
+        };
+
+        void replace(const State state, const UInt32 count = 0) {
+            _stack.back() = Frame(state, count);
+        }
+
+        void push(const State state, const UInt32 count = 0) {
+            _stack.push_back(Frame(state, count));
+        }
+
+        // Consumes one byte, or leaves it to the frame it pushes instead
+        Result step(const unsigned char c) {
+            for (;;) {
+                Frame& top = _stack.back();
+                switch (top.state) {
+                    case CALL_START:
+                        // 'c', then the two version bytes the reader checks
+                        if (c != 'c')
+                            return FRAMER_MALFORMED;
+                        replace(CALL_HEADERS);
+                        push(BYTES, 2);
+                        return FRAMER_INCOMPLETE;
+                    case CALL_HEADERS:
+                        if (c == 'H') {
+                            push(VALUE);
+                            push(LENGTH, 1);
+                        } else if (c == 'm') {
+                            replace(CALL_PARAMETERS);
+                            push(LENGTH, 1);
+                        } else {
+                            return FRAMER_MALFORMED;
+                        }
+                        return FRAMER_INCOMPLETE;
+                    case CALL_PARAMETERS:
+                    case LIST_ELEMENTS:
+                    case MAP_ENTRIES:
+                    case FAULT_ENTRIES:
+                        if (c == 'z') {
+                            _stack.pop_back();
+                            return FRAMER_INCOMPLETE;
+                        }
+                        // a map entry is a key and a value, a fault one a
+                        // property name and a value
+                        if (top.state == MAP_ENTRIES || top.state == FAULT_ENTRIES)
+                            push(VALUE);
+                        push(VALUE);
+                        continue;
+                    case VALUE:
+                        return value(c);
+                    case CHUNKS:
+                    {
+                        // lower case tags for the chunks before the final one
+                        const UInt32 unit = top.count == 'B' ? 0 : 1;
+                        if (c == top.count)
+                            _stack.pop_back();
+                        else if (c != top.count - 'A' + 'a')
+                            return FRAMER_MALFORMED;
+                        push(LENGTH, unit);
+                        return FRAMER_INCOMPLETE;
+                    }
+                    case LIST_TYPE:
+                        replace(LIST_LENGTH);
+                        if (c == 't') {
+                            push(LENGTH, 1);
+                            return FRAMER_INCOMPLETE;
+                        }
+                        continue;
+                    case LIST_LENGTH:
+                        replace(LIST_ELEMENTS);
+                        if (c == 'l') {
+                            push(BYTES, 4);
+                            return FRAMER_INCOMPLETE;
+                        }
+                        continue;
+                    case MAP_TYPE:
+                        replace(MAP_ENTRIES);
+                        if (c == 't') {
+                            push(LENGTH, 1);
+                            return FRAMER_INCOMPLETE;
+                        }
+                        continue;
+                    case TYPE_NAME:
+                        if (c != 't')
+                            return FRAMER_MALFORMED;
+                        replace(LENGTH, 1);
+                        return FRAMER_INCOMPLETE;
+                    case LENGTH:
+                        if (top.length == 0) {
+                            top.length = c + 1;
+                            return FRAMER_INCOMPLETE;
+                        }
+                        {
+                            UInt32 length = ((top.length - 1) << 8) | c;
+                            if (length == 0)
+                                _stack.pop_back();
+                            else
+                                replace(top.count ? CHARACTERS : BYTES, length);
+                        }
+                        return FRAMER_INCOMPLETE;
+                    case CHARACTERS:
+                    {
+                        // a character takes one to four bytes, after its
+                        // first one they are skipped as BYTES
+                        UInt32 more = c <= 0x7F ? 0 : c <= 0xDF ? 1 : c <= 0xEF ? 2 : c <= 0xF4 ? 3 : 0;
+                        if (--top.count == 0)
+                            _stack.pop_back();
+                        if (more > 0)
+                            push(BYTES, more);
+                        return FRAMER_INCOMPLETE;
+                    }
+                    case BYTES:
+                        if (--top.count == 0)
+                            _stack.pop_back();
+                        return FRAMER_INCOMPLETE;
+                }
+                return FRAMER_MALFORMED;
+            }
+        }
+
+        // the tag of a value, the frame it pushes reads the rest
+        Result value(const unsigned char c) {
+            switch (c) {
+                case 'N':
+                case 'T':
+                case 'F':
+                    _stack.pop_back();
+                    break;
+                case 'I':
+                case 'R':
+                    replace(BYTES, 4);
+                    break;
+                case 'L':
+                case 'D':
+                case 'd':
+                    replace(BYTES, 8);
+                    break;
+                case 's':
+                case 'x':
+                case 'b':
+                    replace(CHUNKS, c - 'a' + 'A');
+                    push(LENGTH, c == 'b' ? 0 : 1);
+                    break;
+                case 'S':
+                case 'X':
+                case 'B':
+                    replace(LENGTH, c == 'B' ? 0 : 1);
+                    break;
+                case 'V':
+                    replace(LIST_TYPE);
+                    break;
+                case 'M':
+                    replace(MAP_TYPE);
+                    break;
+                case 'r':
+                    // a type name, then the url as a string value
+                    replace(VALUE);
+                    push(TYPE_NAME);
+                    break;
+                case 'f':
+                    replace(FAULT_ENTRIES);
+                    break;
+                default:
+                    return FRAMER_MALFORMED;
+            }
+            return FRAMER_INCOMPLETE;
+        }
+
+        std::vector<Frame> _stack;
+        std::size_t _length;
+    };
+
+    // Each worker owns a queue it takes from the front of; a worker with
+    // an empty queue takes from the back of another one. A job is deleted
+    // once run.
+    class WorkStealingPool {
+    public:
+
+        WorkStealingPool(const int workers)
+        : _workers(),
+        _queued(0, std::numeric_limits<int>::max()),
+        _stopped(false),
+        _stolenCount() {
+            if (workers < 1)
+                throw Exception("Server needs at least 1 worker");
+            for (int i = 0; i < workers; i++)
+                _workers.push_back(new Worker(*this, i));
+        }
+
+        ~WorkStealingPool() {
+            stop();
+            for (std::vector<Worker*>::iterator it = _workers.begin(); it != _workers.end(); it++)
+                delete *it;
+        }
+
+        int getSize() const {
+            return (int) _workers.size();
+        }
+
+        void start() {
+            for (std::vector<Worker*>::iterator it = _workers.begin(); it != _workers.end(); it++)
+                (*it)->thread.start(**it);
+        }
+
+        // queues the job on the given worker, another one may still run it
+        void submit(Runnable* job, const int worker) {
+            Worker& owner = *_workers[worker % _workers.size()];
+            {
+                Mutex::ScopedLock lock(owner.mutex);
+                owner.jobs.push_back(job);
+            }
+            _queued.set();
+        }
+
+        void stop() {
+            {
+                Mutex::ScopedLock lock(_mutex);
+                if (_stopped)
+                    return;
+                _stopped = true;
+            }
+            for (std::size_t i = 0; i < _workers.size(); i++)
+                _queued.set();
+            for (std::vector<Worker*>::iterator it = _workers.begin(); it != _workers.end(); it++) {
+                Worker& worker = **it;
+                if (worker.thread.isRunning())
+                    worker.thread.join();
+                Mutex::ScopedLock lock(worker.mutex);
+                for (std::deque<Runnable*>::iterator job = worker.jobs.begin(); job != worker.jobs.end(); job++)
+                    delete *job;
+                worker.jobs.clear();
+            }
+        }
+
+        int getStolenCount() const {
+            return _stolenCount.value();
+        }
+
+    private:
+
+        class Worker : public Runnable {
+        public:
+
+            Worker(WorkStealingPool& pool, const int index)
+            : mutex(),
+            jobs(),
+            thread("HessianTcpServer"),
+            _pool(pool),
+            _index(index) {
+            }
+
+            void run() {
+                _pool.work(_index);
+            }
+
+            Mutex mutex;
+            std::deque<Runnable*> jobs;
+            Thread thread;
+
+        private:
+            WorkStealingPool& _pool;
+            const int _index;
+        };
+
+        bool isStopped() {
+            Mutex::ScopedLock lock(_mutex);
+            return _stopped;
+        }
+
+        Runnable* take(const int index) {
+            const std::size_t size = _workers.size();
+            for (std::size_t i = 0; i < size; i++) {
+                Worker& worker = *_workers[(index + i) % size];
+                Mutex::ScopedLock lock(worker.mutex);
+                if (worker.jobs.empty())
+                    continue;
+                Runnable* job;
+                if (i == 0) {
+                    job = worker.jobs.front();
+                    worker.jobs.pop_front();
+                } else {
+                    job = worker.jobs.back();
+                    worker.jobs.pop_back();
+                    _stolenCount++;
+                }
+                return job;
+            }
+            return NULL;
+        }
+
+        void work(const int index) {
+            for (;;) {
+                // one semaphore count per queued job, so a job is always
+                // found somewhere after a successful wait
+                _queued.wait();
+                if (isStopped())
+                    return;
+                Runnable* job = take(index);
+                if (!job)
+                    continue;
+                try {
+                    job->run();
+                } catch (...) {
+                }
+                delete job;
+            }
+        }
+
+        std::vector<Worker*> _workers;
+        Semaphore _queued;
+        Mutex _mutex;
+        bool _stopped;
+        AtomicCounter _stolenCount;
+    };
+
+    class TcpConnection;
+
+    class TcpServerImpl {
+    public:
+
+        TcpServerImpl(const SharedPtr<HessianDispatcher>& dispatcher, const ServerSocket& socket,
+                const int workers, const int maxPending);
+
+        ~TcpServerImpl();
+
+        void start();
+        void stop();
+
+        void onAcceptable(const AutoPtr<ReadableNotification>& notification);
+        void forget(TcpConnection* connection);
+        int getCurrentConnections();
+
+        SharedPtr<HessianDispatcher> dispatcher;
+        ServerSocket socket;
+        SocketReactor reactor;
+        WorkStealingPool pool;
+        const int maxPending;
+
+    private:
+
+        Thread _reactorThread;
+        Mutex _mutex;
+        std::map<TcpConnection*, AutoPtr<TcpConnection> > _connections;
+        int _nextWorker;
+        bool _started;
+        bool _stopped;
+    };
+
+    // Lives as long as the server knows it or one of its calls is queued
+    // or running; the socket closes with the last of them. Reactor
+    // registration is only changed under _interestMutex and never with
+    // _mutex held by a worker, since the reactor thread may be waiting on
+    // _mutex from inside a notification.
+    class TcpConnection : public RefCountedObject {
+    public:
+
+        TcpConnection(TcpServerImpl& server, const StreamSocket& socket, const int worker)
+        : _server(server),
+        _socket(socket),
+        _worker(worker),
+        _pending(),
+        _mutex(),
+        _buffer(),
+        _framer(),
+        _nextCall(0),
+        _stalled(false),
+        _malformed(false),
+        _interestMutex(),
+        _reading(false),
+        _closed(false),
+        _writeMutex(),
+        _done(),
+        _nextReply(0),
+        _out(_socket),
+        _broken(false) {
+        }
+
+        void open() {
+            reconcile();
+        }
+
+        void close() {
+            {
+                Mutex::ScopedLock lock(_interestMutex);
+                _closed = true;
+                if (_reading)
+                    _server.reactor.removeEventHandler(_socket, observer());
+                _reading = false;
+            }
+            _server.forget(this);
+        }
+
+        void onReadable(const AutoPtr<ReadableNotification>&) {
+            // close() may drop the server's reference
+            AutoPtr<TcpConnection> self(this, true);
+            char buffer[8192];
+            int n;
+            try {
+                n = _socket.receiveBytes(buffer, sizeof (buffer));
+            } catch (Exception&) {
+                n = 0;
+            }
+            if (n <= 0) {
+                close();
+                return;
+            }
+            bool ok;
+            {
+                Mutex::ScopedLock lock(_mutex);
+                _buffer.append(buffer, n);
+                ok = decodeCalls();
+            }
+            if (ok)
+                reconcile();
+            else
+                close();
+        }
+
+        // called by workers in any order, writes every reply whose turn came
+        void complete(const UInt64 call, const ReplyPtr& reply) {
+            {
+                Mutex::ScopedLock lock(_writeMutex);
+                _done.insert(std::make_pair(call, reply));
+                int written = 0;
+                for (std::map<UInt64, ReplyPtr>::iterator it = _done.find(_nextReply); it != _done.end(); it = _done.find(_nextReply)) {
+                    if (!_broken) {
+                        try {
+                            Hessian1StreamWriter hessian_writer(_out);
+                            hessian_writer.writeReply(it->second);
+                        } catch (...) {
+                            _broken = true;
+                        }
+                    }
+                    _done.erase(it);
+                    _nextReply++;
+                    written++;
+                }
+                if (written == 0)
+                    return;
+                if (!_broken) {
+                    try {
+                        _out.flush();
+                    } catch (...) {
+                        _broken = true;
+                    }
+                }
+                for (int i = 0; i < written; i++)
+                    _pending--;
+            }
+            resume();
+        }
+
+    private:
+
+        TcpConnection(const TcpConnection&);
+        TcpConnection& operator=(const TcpConnection&);
+
+        NObserver<TcpConnection, ReadableNotification> observer() {
+            return NObserver<TcpConnection, ReadableNotification>(*this, &TcpConnection::onReadable);
+        }
+
+        // Calls already buffered when reading stopped would not come back
+        // with the next readable event, they are decoded here
+        void resume() {
+            bool ok = true;
+            {
+                Mutex::ScopedLock lock(_mutex);
+                if (_stalled)
+                    ok = decodeCalls();
+            }
+            if (ok)
+                reconcile();
+            else
+                close();
+        }
+
+        // Reads while fewer than maxPending calls are unanswered; called
+        // after every change of that count so the last call always wins
+        void reconcile() {
+            Mutex::ScopedLock lock(_interestMutex);
+            bool wanted = !_closed && _pending.value() < _server.maxPending;
+            if (wanted && !_reading)
+                _server.reactor.addEventHandler(_socket, observer());
+            else if (!wanted && _reading)
+                _server.reactor.removeEventHandler(_socket, observer());
+            _reading = wanted;
+        }
+
+        // _mutex held. A partial call is only scanned on from where the
+        // last read left it, and decoded once whole. Returns false on a
+        // malformed call, after queuing a fault for it.
+        bool decodeCalls() {
+            if (_malformed)
+                return false;
+            std::size_t offset = 0;
+            while (offset < _buffer.size() && _pending.value() < _server.maxPending) {
+                CallFramer::Result framed = _framer.scan(_buffer.data() + offset, _buffer.size() - offset);
+                if (framed == CallFramer::FRAMER_INCOMPLETE)
+                    break;
+                const std::size_t length = _framer.getLength();
+                _framer.reset();
+                // a malformed call is decoded as far as it goes, for the
+                // reader to say what is wrong with it
+                MemoryStreamBuf buffer(_buffer.data() + offset, framed == CallFramer::FRAMER_COMPLETE ? length : _buffer.size() - offset);
+                std::istream in(&buffer);
+                CallPtr call;
+                std::string message;
+                try {
+                    Hessian1StreamReader hessian_reader(in);
+                    call = hessian_reader.readCall();
+                } catch (Exception& e) {
+                    message = in.eof() ? std::string("Malformed call") : e.displayText();
+                }
+                if (framed != CallFramer::FRAMER_COMPLETE || buffer.consumed() != length) {
+                    if (message.empty())
+                        message = "Malformed call";
+                    call = NULL;
+                }
+                // nothing after a malformed call can be framed
+                if (!call)
+                    _malformed = true;
+                offset += length;
+                // handed over to a worker, but released here too
+                if (!!call)
+                    call->share();
+                _pending++;
+                _server.pool.submit(new CallJob(AutoPtr<TcpConnection>(this, true), _nextCall++, call, message), _worker);
+                if (_malformed) {
+                    _buffer.clear();
+                    return false;
+                }
+            }
+            _buffer.erase(0, offset);
+            _stalled = !_buffer.empty() && _pending.value() >= _server.maxPending;
+            return true;
+        }
+
+        class CallJob : public Runnable {
+        public:
+
+            CallJob(const AutoPtr<TcpConnection>& connection, const UInt64 call,
+                    const CallPtr& decoded, const std::string& message)
+            : _connection(connection),
+            _call(call),
+            _decoded(decoded),
+            _message(message) {
+            }
+
+            void run() {
+                SharedPtr<HessianDispatcher> dispatcher = _connection->_server.dispatcher;
+                ReplyPtr reply;
+                if (!_decoded)
+                    reply = dispatcher->protocolFault(_message);
+                else
+                    reply = dispatcher->dispatch(_decoded);
+                // written and released by whichever worker completes it
+                reply->share();
+                _connection->complete(_call, reply);
+            }
+
+        private:
+            AutoPtr<TcpConnection> _connection;
+            const UInt64 _call;
+            const CallPtr _decoded;
+            const std::string _message;
+        };
+
+        TcpServerImpl& _server;
+        StreamSocket _socket;
+        const int _worker;
+        AtomicCounter _pending;
+
+        // read side
+        Mutex _mutex;
+        std::string _buffer;
+        CallFramer _framer;
+        UInt64 _nextCall;
+        bool _stalled;
+        bool _malformed;
+
+        // reactor registration
+        Mutex _interestMutex;
+        bool _reading;
+        bool _closed;
+
+        // write side
+        Mutex _writeMutex;
+        std::map<UInt64, ReplyPtr> _done;
+        UInt64 _nextReply;
+        SocketOutputStream _out;
+        bool _broken;
+    };
+
+    TcpServerImpl::TcpServerImpl(const SharedPtr<HessianDispatcher>& dispatcher, const ServerSocket& socket,
+            const int workers, const int maxPending)
+    : dispatcher(dispatcher),
+    socket(socket),
+    reactor(),
+    pool(workers),
+    maxPending(maxPending),
+    _reactorThread("HessianTcpServerReactor"),
+    _mutex(),
+    _connections(),
+    _nextWorker(0),
+    _started(false),
+    _stopped(false) {
+        if (dispatcher.isNull())
+            throw Exception("Null dispatcher");
+        if (maxPending < 1)
+            throw Exception("Server max pending calls must be at least 1");
+    }
+
+    TcpServerImpl::~TcpServerImpl() {
+        try {
+            stop();
+        } catch (...) {
+        }
+    }
+
+    void TcpServerImpl::start() {
+        Mutex::ScopedLock lock(_mutex);
+        if (_started)
+            throw Exception("Server already started");
+        _started = true;
+        pool.start();
+        reactor.addEventHandler(socket, NObserver<TcpServerImpl, ReadableNotification>(*this, &TcpServerImpl::onAcceptable));
+        _reactorThread.start(reactor);
+    }
+
+    void TcpServerImpl::stop() {
+        {
+            Mutex::ScopedLock lock(_mutex);
+            if (!_started || _stopped)
+                return;
+            _stopped = true;
+        }
+        reactor.stop();
+        _reactorThread.join();
+        reactor.removeEventHandler(socket, NObserver<TcpServerImpl, ReadableNotification>(*this, &TcpServerImpl::onAcceptable));
+        socket.close();
+        std::vector<AutoPtr<TcpConnection> > connections;
+        {
+            Mutex::ScopedLock lock(_mutex);
+            for (std::map<TcpConnection*, AutoPtr<TcpConnection> >::iterator it = _connections.begin(); it != _connections.end(); it++)
+                connections.push_back(it->second);
+        }
+        for (std::vector<AutoPtr<TcpConnection> >::iterator it = connections.begin(); it != connections.end(); it++)
+            (*it)->close();
+        pool.stop();
+    }
+
+    void TcpServerImpl::onAcceptable(const AutoPtr<ReadableNotification>&) {
+        StreamSocket accepted;
+        try {
+            accepted = socket.acceptConnection();
+        } catch (Exception&) {
+            return;
+        }
+#ifdef HAVE_POCO_UNIX_LOCAL
+        // unix domain sockets have no Nagle algorithm to turn off
+        if (socket.address().family() != SocketAddress::UNIX_LOCAL)
+#endif
+            accepted.setNoDelay(true);
+        AutoPtr<TcpConnection> connection;
+        {
+            Mutex::ScopedLock lock(_mutex);
+            connection = new TcpConnection(*this, accepted, _nextWorker++);
+            _connections[connection.get()] = connection;
+        }
+        connection->open();
+    }
+
+    void TcpServerImpl::forget(TcpConnection* connection) {
+        // the caller still holds a reference
+        Mutex::ScopedLock lock(_mutex);
+        _connections.erase(connection);
+    }
+
+    int TcpServerImpl::getCurrentConnections() {
+        Mutex::ScopedLock lock(_mutex);
+        return (int) _connections.size();
+    }
+
+    HessianTcpServer::HessianTcpServer(const SharedPtr<HessianDispatcher>& dispatcher,
+            const ServerSocket& socket, const int workers, const int maxPending)
+    : _impl(new TcpServerImpl(dispatcher, socket, workers, maxPending)) {
+    }
+
+    HessianTcpServer::~HessianTcpServer() {
+        delete _impl;
+    }
+
+    const SharedPtr<HessianDispatcher>& HessianTcpServer::getDispatcher() const {
+        return _impl->dispatcher;
+    }
+
+    int HessianTcpServer::getWorkers() const {
+        return _impl->pool.getSize();
+    }
+
+    int HessianTcpServer::getMaxPending() const {
+        return _impl->maxPending;
+    }
+
+    void HessianTcpServer::start() {
+        _impl->start();
+    }
+
+    void HessianTcpServer::stop() {
+        _impl->stop();
+    }
+
+    Poco::UInt16 HessianTcpServer::getPort() const {
+        return _impl->socket.address().port();
+    }
+
+    int HessianTcpServer::getCurrentConnections() const {
+        return _impl->getCurrentConnections();
+    }
+
+    int HessianTcpServer::getStolenCount() const {
+        return _impl->pool.getStolenCount();
+    }
+
+}
@@ -24,6 +24,12 @@
 
 #include <iostream>
 #include <typeinfo>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include "pohessian/HessianArena.h"
 
 #include "Poco/Types.h"
 #include "Poco/Timestamp.h"
@@ -31,138 +37,1299 @@
 
 using Poco::Int32;
 using Poco::Int64;
+using Poco::UInt32;
+using Poco::UInt64;
 using Poco::Timestamp;
 using Poco::Exception;
 
 namespace PoHessian {
 
+    /////////////////
+    // Structural hash and equality
+
+    // Values being walked from the root, to recognise cycles
+    typedef std::vector<const Value*> ValuePath;
+
+    class ValuePathGuard {
+    public:
+
+        ValuePathGuard(ValuePath& path, const Value* value)
+        : _path(path) {
+            _path.push_back(value);
+        }
+
+        ~ValuePathGuard() {
+            _path.pop_back();
+        }
+
+    private:
+        ValuePath& _path;
+    };
+
+    static std::size_t hashCombine(const std::size_t seed, const std::size_t value) {
+        return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+    }
+
+    static std::size_t hashInt64(const Int64 value) {
+        return (std::size_t) ((UInt64) value ^ ((UInt64) value >> 32));
+    }
+
+    static std::size_t hashBytes(std::size_t hash, const char* data, const std::size_t size) {
+        for (std::size_t i = 0; i < size; i++)
+            hash = (hash ^ (unsigned char) data[i]) * 16777619u;
+        return hash;
+    }
+
+    static std::size_t hashString(const std::string& value) {
+        return hashBytes(2166136261u, value.data(), value.size());
+    }
+
+    static std::size_t hashDouble(const double value) {
+        Int64 bits;
+        std::memcpy(&bits, &value, sizeof (bits));
+        return hashInt64(bits);
+    }
+
+    static std::size_t hashValue(const ValuePtr& value, ValuePath& path);
+
+    static std::size_t hashValue(const Value& value, ValuePath& path) {
+        ValuePath::const_iterator cycle = std::find(path.begin(), path.end(), &value);
+        if (cycle != path.end())
+            return hashCombine(0x5eed, cycle - path.begin());
+        ValuePathGuard guard(path, &value);
+        std::size_t hash = hashCombine(0, value.getType());
+        switch (value.getType()) {
+            case Value::TYPE_NULL:
+                break;
+            case Value::TYPE_BOOLEAN:
+                hash = hashCombine(hash, value.getBoolean());
+                break;
+            case Value::TYPE_INTEGER:
+                hash = hashCombine(hash, hashInt64(value.getInteger()));
+                break;
+            case Value::TYPE_LONG:
+                hash = hashCombine(hash, hashInt64(value.getLong()));
+                break;
+            case Value::TYPE_DATE:
+                hash = hashCombine(hash, hashInt64(value.getDateAsLong()));
+                break;
+            case Value::TYPE_DOUBLE:
+                hash = hashCombine(hash, hashDouble(value.getDouble()));
+                break;
+            case Value::TYPE_STRING:
+                hash = hashCombine(hash, hashString(value.getString()));
+                break;
+            case Value::TYPE_XML:
+                hash = hashCombine(hash, hashString(value.getXml()));
+                break;
+            case Value::TYPE_BINARY:
+                hash = hashCombine(hash, hashString(value.getBinary()));
+                break;
+            case Value::TYPE_LIST:
+            {
+                hash = hashCombine(hash, hashString(value.getListType()));
+                const Value::List& list = value.getList();
+                for (Value::List::const_iterator it = list.begin(); it != list.end(); it++)
+                    hash = hashCombine(hash, hashValue(*it, path));
+                break;
+            }
+            case Value::TYPE_MAP:
+            {
+                // entries are summed, equal maps may iterate in another order
+                // when their keys are lists or maps
+                hash = hashCombine(hash, hashString(value.getMapType()));
+                std::size_t entries = 0;
+                const Value::Map& map = value.getMap();
+                for (Value::Map::const_iterator it = map.begin(); it != map.end(); it++)
+                    entries += hashCombine(hashValue(it->first, path), hashValue(it->second, path));
+                hash = hashCombine(hash, entries);
+                break;
+            }
+            case Value::TYPE_REMOTE:
+                hash = hashCombine(hash, hashString(value.getRemoteType()));
+                hash = hashCombine(hash, hashString(value.getRemoteUrl()));
+                break;
+            case Value::TYPE_FAULT:
+                hash = hashCombine(hash, hashString(value.getFaultCode()));
+                hash = hashCombine(hash, hashString(value.getFaultMessage()));
+                hash = hashCombine(hash, hashValue(value.getFaultDetail(), path));
+                break;
+            case Value::TYPE_ARRAY:
+                hash = hashCombine(hash, hashString(value.getArrayType()));
+                hash = hashCombine(hash, value.getArrayElementType());
+                switch (value.getArrayElementType()) {
+                    case Value::TYPE_BOOLEAN:
+                    {
+                        const Value::BooleanArray& array = value.getBooleanArray();
+                        for (Value::BooleanArray::const_iterator it = array.begin(); it != array.end(); it++)
+                            hash = hashCombine(hash, *it);
+                        break;
+                    }
+                    case Value::TYPE_INTEGER:
+                    {
+                        const Value::IntArray& array = value.getIntArray();
+                        for (Value::IntArray::const_iterator it = array.begin(); it != array.end(); it++)
+                            hash = hashCombine(hash, hashInt64(*it));
+                        break;
+                    }
+                    case Value::TYPE_LONG:
+                    {
+                        const Value::LongArray& array = value.getLongArray();
+                        for (Value::LongArray::const_iterator it = array.begin(); it != array.end(); it++)
+                            hash = hashCombine(hash, hashInt64(*it));
+                        break;
+                    }
+                    default:
+                    {
+                        const Value::DoubleArray& array = value.getDoubleArray();
+                        for (Value::DoubleArray::const_iterator it = array.begin(); it != array.end(); it++)
+                            hash = hashCombine(hash, hashDouble(*it));
+                        break;
+                    }
+                }
+                break;
+        }
+        return hash;
+    }
+
+    static std::size_t hashValue(const ValuePtr& value, ValuePath& path) {
+        if (!value)
+            return 0;
+        return hashValue(*value, path);
+    }
+
+    static bool equalValues(const ValuePtr& v1, const ValuePtr& v2, ValuePath& path1, ValuePath& path2);
+
+    static bool equalMaps(const Value::Map& m1, const Value::Map& m2, ValuePath& path1, ValuePath& path2) {
+        if (m1.size() != m2.size())
+            return false;
+        Value::Map::const_iterator it1 = m1.begin();
+        Value::Map::const_iterator it2 = m2.begin();
+        for (; it1 != m1.end(); it1++, it2++)
+            if (!equalValues(it1->first, it2->first, path1, path2) || !equalValues(it1->second, it2->second, path1, path2))
+                break;
+        if (it1 == m1.end())
+            return true;
+        // the entries may come in another order; scalar keys are looked up,
+        // keys that are lists, maps or arrays are told apart by address or
+        // not bitwise there and need a slower matching
+        std::vector<bool> matched(m2.size(), false);
+        for (it1 = m1.begin(); it1 != m1.end(); it1++) {
+            if (!!it1->first && !it1->first->isList() && !it1->first->isMap() && !it1->first->isArray()) {
+                it2 = m2.find(it1->first);
+                if (it2 == m2.end() || !equalValues(it1->first, it2->first, path1, path2) || !equalValues(it1->second, it2->second, path1, path2))
+                    return false;
+                matched[it2 - m2.begin()] = true;
+                continue;
+            }
+            std::vector<bool>::size_type i = 0;
+            for (it2 = m2.begin(); it2 != m2.end(); it2++, i++)
+                if (!matched[i] && equalValues(it1->first, it2->first, path1, path2) && equalValues(it1->second, it2->second, path1, path2))
+                    break;
+            if (it2 == m2.end())
+                return false;
+            matched[i] = true;
+        }
+        return true;
+    }
+
+    static bool equalValues(const Value& v1, const Value& v2, ValuePath& path1, ValuePath& path2) {
+        ValuePath::const_iterator cycle1 = std::find(path1.begin(), path1.end(), &v1);
+        ValuePath::const_iterator cycle2 = std::find(path2.begin(), path2.end(), &v2);
+        if (cycle1 != path1.end() || cycle2 != path2.end())
+            return cycle1 - path1.begin() == cycle2 - path2.begin();
+        if (v1.getType() != v2.getType())
+            return false;
+        ValuePathGuard guard1(path1, &v1);
+        ValuePathGuard guard2(path2, &v2);
+        switch (v1.getType()) {
+            case Value::TYPE_NULL:
+                return true;
+            case Value::TYPE_BOOLEAN:
+                return v1.getBoolean() == v2.getBoolean();
+            case Value::TYPE_INTEGER:
+                return v1.getInteger() == v2.getInteger();
+            case Value::TYPE_LONG:
+                return v1.getLong() == v2.getLong();
+            case Value::TYPE_DATE:
+                return v1.getDateAsLong() == v2.getDateAsLong();
+            case Value::TYPE_DOUBLE:
+            {
+                // bitwise, like the hash
+                double d1 = v1.getDouble();
+                double d2 = v2.getDouble();
+                return std::memcmp(&d1, &d2, sizeof (d1)) == 0;
+            }
+            case Value::TYPE_STRING:
+                // interned strings are shared
+                return &v1 == &v2 || v1.getString() == v2.getString();
+            case Value::TYPE_XML:
+                return v1.getXml() == v2.getXml();
+            case Value::TYPE_BINARY:
+                return v1.getBinary() == v2.getBinary();
+            case Value::TYPE_LIST:
+            {
+                if (v1.getListType() != v2.getListType() || v1.getListSize() != v2.getListSize())
+                    return false;
+                const Value::List& l1 = v1.getList();
+                const Value::List& l2 = v2.getList();
+                for (Value::List::size_type i = 0; i < l1.size(); i++)
+                    if (!equalValues(l1[i], l2[i], path1, path2))
+                        return false;
+                return true;
+            }
+            case Value::TYPE_MAP:
+                return v1.getMapType() == v2.getMapType() && equalMaps(v1.getMap(), v2.getMap(), path1, path2);
+            case Value::TYPE_REMOTE:
+                return v1.getRemoteType() == v2.getRemoteType() && v1.getRemoteUrl() == v2.getRemoteUrl();
+            case Value::TYPE_FAULT:
+                return v1.getFaultCode() == v2.getFaultCode()
+                        && v1.getFaultMessage() == v2.getFaultMessage()
+                        && equalValues(v1.getFaultDetail(), v2.getFaultDetail(), path1, path2);
+            case Value::TYPE_ARRAY:
+            {
+                if (v1.getArrayType() != v2.getArrayType() || v1.getArrayElementType() != v2.getArrayElementType())
+                    return false;
+                switch (v1.getArrayElementType()) {
+                    case Value::TYPE_BOOLEAN:
+                        return v1.getBooleanArray() == v2.getBooleanArray();
+                    case Value::TYPE_INTEGER:
+                        return v1.getIntArray() == v2.getIntArray();
+                    case Value::TYPE_LONG:
+                        return v1.getLongArray() == v2.getLongArray();
+                    default:
+                    {
+                        // bitwise, like DOUBLE values
+                        const Value::DoubleArray& a1 = v1.getDoubleArray();
+                        const Value::DoubleArray& a2 = v2.getDoubleArray();
+                        return a1.size() == a2.size()
+                                && (a1.empty() || std::memcmp(&a1[0], &a2[0], a1.size() * sizeof (double)) == 0);
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    static bool equalValues(const ValuePtr& v1, const ValuePtr& v2, ValuePath& path1, ValuePath& path2) {
+        if (!v1 || !v2)
+            return !v1 && !v2;
+        return equalValues(*v1, *v2, path1, path2);
+    }
+
+    static std::size_t hashValues(std::size_t hash, const std::vector<ValuePtr>& values) {
+        for (std::vector<ValuePtr>::const_iterator it = values.begin(); it != values.end(); it++) {
+            ValuePath path;
+            hash = hashCombine(hash, hashValue(*it, path));
+        }
+        return hash;
+    }
+
+    static bool equalValues(const std::vector<ValuePtr>& values1, const std::vector<ValuePtr>& values2) {
+        if (values1.size() != values2.size())
+            return false;
+        for (std::vector<ValuePtr>::size_type i = 0; i < values1.size(); i++) {
+            ValuePath path1;
+            ValuePath path2;
+            if (!equalValues(values1[i], values2[i], path1, path2))
+                return false;
+        }
+        return true;
+    }
+
+    /////////////////
+    // ValueMap
+
+    // keys Value::operator< cannot tell apart hash alike; lists and maps,
+    // which it compares by address, all hash alike
+    static std::size_t keyHash(const Value& key) {
+        std::size_t hash = hashCombine(0, key.getType());
+        switch (key.getType()) {
+            case Value::TYPE_BOOLEAN:
+                return hashCombine(hash, key.getBoolean());
+            case Value::TYPE_INTEGER:
+                return hashCombine(hash, hashInt64(key.getInteger()));
+            case Value::TYPE_LONG:
+                return hashCombine(hash, hashInt64(key.getLong()));
+            case Value::TYPE_DATE:
+                return hashCombine(hash, hashInt64(key.getDateAsLong()));
+            case Value::TYPE_DOUBLE:
+                // 0.0 and -0.0 are the same key
+                return hashCombine(hash, key.getDouble() == 0 ? 0 : hashDouble(key.getDouble()));
+            case Value::TYPE_STRING:
+                return hashCombine(hash, hashString(key.getString()));
+            case Value::TYPE_XML:
+                return hashCombine(hash, hashString(key.getXml()));
+            case Value::TYPE_BINARY:
+                return hashCombine(hash, hashString(key.getBinary()));
+            case Value::TYPE_REMOTE:
+            {
+                // compared by type and url put together
+                const std::string& type = key.getRemoteType();
+                const std::string& url = key.getRemoteUrl();
+                return hashCombine(hash, hashBytes(hashBytes(2166136261u, type.data(), type.size()), url.data(), url.size()));
+            }
+            case Value::TYPE_FAULT:
+            {
+                const std::string& code = key.getFaultCode();
+                const std::string& message = key.getFaultMessage();
+                return hashCombine(hash, hashBytes(hashBytes(2166136261u, code.data(), code.size()), message.data(), message.size()));
+            }
+            default:
+                return hash;
+        }
+    }
+
+    static std::size_t keyHash(const char* key, const std::size_t size) {
+        return hashCombine(hashCombine(0, Value::TYPE_STRING), hashBytes(2166136261u, key, size));
+    }
+
+    static bool sameKey(const Value& key1, const Value& key2) {
+        return &key1 == &key2 || (!(key1 < key2) && !(key2 < key1));
+    }
+
+    static bool sameKey(const Value& key1, const char* key2, const std::size_t size) {
+        return key1.isString() && key1.getString().size() == size && std::memcmp(key1.getString().data(), key2, size) == 0;
+    }
+
+    // whether key1 comes before the STRING key2, like Value::operator<
+    static bool lessKey(const Value& key1, const char* key2, const std::size_t size) {
+        if (!key1.isString())
+            return key1.getType() < Value::TYPE_STRING;
+        return key1.getString().compare(0, std::string::npos, key2, size) < 0;
+    }
+
+    const ValueMap::size_type ValueMap::FLAT_MAX_SIZE;
+
+    ValueMap::ValueMap(const Representation representation, HessianArena* arena)
+    : _representation(representation),
+    _hashed(representation == REPRESENTATION_HASH),
+    _entries(ArenaAllocator<value_type>(arena)),
+    _slots(ArenaAllocator<UInt32>(arena)) {
+    }
+
+    ValueMap::Representation ValueMap::getRepresentation() const {
+        return _representation;
+    }
+
+    bool ValueMap::isHashed() const {
+        return _hashed;
+    }
+
+    ValueMap::iterator ValueMap::begin() {
+        return _entries.begin();
+    }
+
+    ValueMap::iterator ValueMap::end() {
+        return _entries.end();
+    }
+
+    ValueMap::const_iterator ValueMap::begin() const {
+        return _entries.begin();
+    }
+
+    ValueMap::const_iterator ValueMap::end() const {
+        return _entries.end();
+    }
+
+    ValueMap::size_type ValueMap::size() const {
+        return _entries.size();
+    }
+
+    bool ValueMap::empty() const {
+        return _entries.empty();
+    }
+
+    void ValueMap::reserve(const size_type n) {
+        _entries.reserve(n);
+        bool hashed = _hashed
+                || _representation == REPRESENTATION_HASH
+                || (_representation == REPRESENTATION_AUTO && n > FLAT_MAX_SIZE);
+        if (hashed && n * 2 > _slots.size())
+            hash(n);
+    }
+
+    void ValueMap::clear() {
+        _entries.clear();
+        _slots.clear();
+        _hashed = _representation == REPRESENTATION_HASH;
+    }
+
+    void ValueMap::swap(ValueMap& map) {
+        std::swap(_representation, map._representation);
+        std::swap(_hashed, map._hashed);
+        _entries.swap(map._entries);
+        _slots.swap(map._slots);
+    }
+
+    std::pair<ValueMap::iterator, bool> ValueMap::insert(const value_type& entry) {
+        bool found;
+        size_type pos = insertPosition(*entry.first, found);
+        if (found)
+            return std::make_pair(begin() + pos, false);
+        _entries.insert(_entries.begin() + pos, entry);
+        if (_hashed)
+            indexEntry(pos);
+        return std::make_pair(begin() + pos, true);
+    }
+
+#ifdef PoHessian_HAVE_MOVE
+    std::pair<ValueMap::iterator, bool> ValueMap::insert(value_type&& entry) {
+        bool found;
+        size_type pos = insertPosition(*entry.first, found);
+        if (found)
+            return std::make_pair(begin() + pos, false);
+        _entries.insert(_entries.begin() + pos, std::move(entry));
+        if (_hashed)
+            indexEntry(pos);
+        return std::make_pair(begin() + pos, true);
+    }
+#endif
+
+    ValueMap::mapped_type& ValueMap::operator[](const key_type& key) {
+        return insert(value_type(key, ValuePtr())).first->second;
+    }
+
+    ValueMap::iterator ValueMap::find(const key_type& key) {
+        return begin() + position(*key);
+    }
+
+    ValueMap::const_iterator ValueMap::find(const key_type& key) const {
+        return begin() + position(*key);
+    }
+
+    ValueMap::const_iterator ValueMap::find(const Value& key) const {
+        return begin() + position(key);
+    }
+
+    ValueMap::const_iterator ValueMap::find(const std::string& key) const {
+        return begin() + position(key.data(), key.size());
+    }
+
+    ValueMap::const_iterator ValueMap::find(const char* key) const {
+        return begin() + position(key, std::strlen(key));
+    }
+
+    ValueMap::size_type ValueMap::count(const key_type& key) const {
+        return position(*key) < _entries.size() ? 1 : 0;
+    }
+
+    bool ValueMap::operator<(const ValueMap& map) const {
+        return std::lexicographical_compare(_entries.begin(), _entries.end(), map._entries.begin(), map._entries.end());
+    }
+
+    // position of key when found, else where to insert it; switches to
+    // hashed lookups or grows the index as needed first
+    ValueMap::size_type ValueMap::insertPosition(const Value& key, bool& found) {
+        if (!_hashed) {
+            size_type pos = lowerBound(key);
+            found = pos < _entries.size() && !(key < *_entries[pos].first);
+            if (found || _representation != REPRESENTATION_AUTO || _entries.size() < FLAT_MAX_SIZE)
+                return pos;
+            hash(_entries.size() + 1);
+        }
+        size_type pos = position(key);
+        found = pos < _entries.size();
+        if (!found && (_entries.size() + 1) * 2 > _slots.size())
+            hash(_entries.size() + 1);
+        return pos;
+    }
+
+    ValueMap::size_type ValueMap::position(const Value& key) const {
+        if (!_hashed) {
+            size_type pos = lowerBound(key);
+            if (pos < _entries.size() && !(key < *_entries[pos].first))
+                return pos;
+            return _entries.size();
+        }
+        if (_slots.empty())
+            return _entries.size();
+        std::size_t mask = _slots.size() - 1;
+        for (std::size_t i = keyHash(key) & mask; _slots[i]; i = (i + 1) & mask)
+            if (sameKey(*_entries[_slots[i] - 1].first, key))
+                return _slots[i] - 1;
+        return _entries.size();
+    }
+
+    ValueMap::size_type ValueMap::position(const char* key, const std::size_t size) const {
+        if (!_hashed) {
+            size_type pos = lowerBound(key, size);
+            if (pos < _entries.size() && sameKey(*_entries[pos].first, key, size))
+                return pos;
+            return _entries.size();
+        }
+        if (_slots.empty())
+            return _entries.size();
+        std::size_t mask = _slots.size() - 1;
+        for (std::size_t i = keyHash(key, size) & mask; _slots[i]; i = (i + 1) & mask)
+            if (sameKey(*_entries[_slots[i] - 1].first, key, size))
+                return _slots[i] - 1;
+        return _entries.size();
+    }
+
+    ValueMap::size_type ValueMap::lowerBound(const Value& key) const {
+        size_type low = 0;
+        size_type high = _entries.size();
+        while (low < high) {
+            size_type middle = low + (high - low) / 2;
+            if (*_entries[middle].first < key)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return low;
+    }
+
+    ValueMap::size_type ValueMap::lowerBound(const char* key, const std::size_t size) const {
+        size_type low = 0;
+        size_type high = _entries.size();
+        while (low < high) {
+            size_type middle = low + (high - low) / 2;
+            if (lessKey(*_entries[middle].first, key, size))
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return low;
+    }
+
+    // switches to hashed lookups, with room for capacity entries
+    void ValueMap::hash(const size_type capacity) {
+        size_type slots = 32;
+        while (slots < capacity * 2)
+            slots *= 2;
+        _slots.assign(slots, 0);
+        _hashed = true;
+        for (size_type i = 0; i < _entries.size(); i++)
+            indexEntry(i);
+    }
+
+    void ValueMap::indexEntry(const size_type position) {
+        std::size_t mask = _slots.size() - 1;
+        std::size_t i = keyHash(*_entries[position].first) & mask;
+        while (_slots[i])
+            i = (i + 1) & mask;
+        _slots[i] = (UInt32) position + 1;
+    }
+
     /////////////////
     // Value
 
+    // a list or a map together with its type name, a STRING value or
+    // NULL when untyped. The copies are for Value's copy constructor and
+    // always allocate from the heap, while a copy of the container alone
+    // would keep its arena.
+    struct Value::ListData {
+
+        ListData(HessianArena* arena)
+        : type(),
+        list(ArenaAllocator<ValuePtr>(arena)) {
+        }
+
+        ListData(const ListData& data)
+        : type(data.type),
+        list() {
+            list = data.list;
+        }
+
+        ValuePtr type;
+        List list;
+    };
+
+    struct Value::MapData {
+
+        MapData(HessianArena* arena)
+        : type(),
+        map(Map::REPRESENTATION_AUTO, arena) {
+        }
+
+        MapData(const MapData& data)
+        : type(data.type),
+        map(data.map.getRepresentation()) {
+            map = data.map;
+        }
+
+        ValuePtr type;
+        Map map;
+    };
+
+    struct Value::RemoteData {
+
+        RemoteData(std::string& type, std::string& url)
+        : type(),
+        url() {
+            this->type.swap(type);
+            this->url.swap(url);
+        }
+
+        std::string type;
+        std::string url;
+    };
+
+    struct Value::FaultData {
+
+        FaultData(const ValuePtr& code, std::string& message, const ValuePtr& detail)
+        : code(code),
+        message(),
+        detail(detail) {
+            this->message.swap(message);
+        }
+
+        ValuePtr code;
+        std::string message;
+        ValuePtr detail;
+    };
+
+    // only the vector matching elementType is used
+    struct Value::ArrayData {
+
+        ArrayData(const ValuePtr& type, const Type elementType, HessianArena* arena)
+        : type(type),
+        elementType(elementType),
+        booleans(ArenaAllocator<bool>(arena)),
+        integers(ArenaAllocator<Int32>(arena)),
+        longs(ArenaAllocator<Int64>(arena)),
+        doubles(ArenaAllocator<double>(arena)) {
+        }
+
+        ArrayData(const ArrayData& data)
+        : type(data.type),
+        elementType(data.elementType),
+        booleans(),
+        integers(),
+        longs(),
+        doubles() {
+            booleans = data.booleans;
+            integers = data.integers;
+            longs = data.longs;
+            doubles = data.doubles;
+        }
+
+        ValuePtr type;
+        Type elementType;
+        BooleanArray booleans;
+        IntArray integers;
+        LongArray longs;
+        DoubleArray doubles;
+    };
+
+    static void checkElementType(const Value::Type elementType) {
+        if (elementType != Value::TYPE_BOOLEAN
+                && elementType != Value::TYPE_INTEGER
+                && elementType != Value::TYPE_LONG
+                && elementType != Value::TYPE_DOUBLE)
+            throw Exception("Must be a BOOLEAN, INTEGER, LONG or DOUBLE element type");
+    }
+
+    // type names and fault codes are STRING values, NULL when empty, so
+    // that a HessianInternTable can share them
+    static ValuePtr nameValue(const std::string& name) {
+        if (name.empty())
+            return ValuePtr();
+        return new Value(name);
+    }
+
+    static const std::string& nameString(const ValuePtr& name) {
+        static const std::string empty;
+        if (!name)
+            return empty;
+        return name->getString();
+    }
+
+    static void checkName(const ValuePtr& name) {
+        if (!!name && !name->isString())
+            throw Exception("Must be a STRING");
+    }
+
+    static void checkStringType(const Value::Type type) {
+        if (type != Value::TYPE_STRING
+                && type != Value::TYPE_XML
+                && type != Value::TYPE_BINARY
+                && type != Value::TYPE_LIST
+                && type != Value::TYPE_MAP)
+            throw Exception("Must be a STRING, XML, BINARY, LIST or MAP");
+    }
+
+    std::string& Value::string() {
+        return *_string;
+    }
+
+    const std::string& Value::string() const {
+        return *_string;
+    }
+
+    Value::ListData& Value::listData() {
+        return *_list;
+    }
+
+    const Value::ListData& Value::listData() const {
+        return *_list;
+    }
+
+    Value::MapData& Value::mapData() {
+        return *_map;
+    }
+
+    const Value::MapData& Value::mapData() const {
+        return *_map;
+    }
+
+    void Value::checkMutable() const {
+        if (_frozen)
+            throw Exception("Must not be frozen");
+    }
+
+    // the string, list, map or array of a value made with an arena comes
+    // from it too, and is only destroyed with the value, its memory going
+    // with the arena
+    template <class T>
+    static void freeData(T* data, const bool arenaData) {
+        data->~T();
+        if (!arenaData)
+            ::operator delete(data);
+    }
+
+    void Value::construct(const Value& value) {
+        switch (value._type) {
+            case TYPE_NULL:
+                break;
+            case TYPE_BOOLEAN:
+                _bool = value._bool;
+                break;
+            case TYPE_INTEGER:
+            case TYPE_LONG:
+            case TYPE_DATE:
+                _integer = value._integer;
+                break;
+            case TYPE_DOUBLE:
+                _double = value._double;
+                break;
+            case TYPE_STRING:
+            case TYPE_XML:
+            case TYPE_BINARY:
+                _string = new std::string(value.string());
+                break;
+            case TYPE_LIST:
+                _list = new ListData(value.listData());
+                break;
+            case TYPE_MAP:
+                _map = new MapData(value.mapData());
+                break;
+            case TYPE_REMOTE:
+                _remote = new RemoteData(*value._remote);
+                break;
+            case TYPE_FAULT:
+                _fault = new FaultData(*value._fault);
+                break;
+            case TYPE_ARRAY:
+                _array = new ArrayData(*value._array);
+                break;
+        }
+        _type = value._type;
+        _arenaData = false;
+    }
+
+    // steals the payload of value, which is left NULL; must be called on a
+    // destroyed value. A value from the heap copies the payload of one
+    // from an arena instead, so as not to depend on the arena.
+    void Value::take(Value& value) {
+        Type type = value._type;
+        if (value._arenaData && !_arena)
+            type = TYPE_NULL;
+        switch (type) {
+            // out of line, the pointer changes hands
+            case TYPE_STRING:
+            case TYPE_XML:
+            case TYPE_BINARY:
+                _string = value._string;
+                break;
+            case TYPE_LIST:
+                _list = value._list;
+                break;
+            case TYPE_MAP:
+                _map = value._map;
+                break;
+            case TYPE_REMOTE:
+                _remote = value._remote;
+                break;
+            case TYPE_FAULT:
+                _fault = value._fault;
+                break;
+            case TYPE_ARRAY:
+                _array = value._array;
+                break;
+            default:
+                construct(value);
+                value.destroy();
+                value._type = TYPE_NULL;
+                return;
+        }
+        _type = type;
+        _arenaData = value._arenaData;
+        value._type = TYPE_NULL;
+    }
+
+    void Value::destroy() {
+        switch (_type) {
+            case TYPE_STRING:
+            case TYPE_XML:
+            case TYPE_BINARY:
+                freeData(_string, _arenaData);
+                break;
+            case TYPE_LIST:
+                freeData(_list, _arenaData);
+                break;
+            case TYPE_MAP:
+                freeData(_map, _arenaData);
+                break;
+            case TYPE_REMOTE:
+                freeData(_remote, _arenaData);
+                break;
+            case TYPE_FAULT:
+                freeData(_fault, _arenaData);
+                break;
+            case TYPE_ARRAY:
+                freeData(_array, _arenaData);
+                break;
+            default:
+                break;
+        }
+    }
+
     Value::Value(const Value& value)
-    : _type(value._type),
-	_bool(value._bool),
-    _integer(value._integer),
-    _double(value._double),
-    _string(value._string),
-    _string2(value._string2),
-    _list(value._list),
-    _map(value._map),
-    _value(value._value) {
-    }
-
-    Value::Value(const Type type)
-    : _type(type) {
-        if (type != TYPE_NULL
-                && type != TYPE_LIST
-                && type != TYPE_MAP)
-            throw Exception("Must be a NULL, LIST or MAP");
-    }
-
-    Value::Value(const bool boolean)
+    : RefCounted<>(),
+    _type(TYPE_NULL),
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        construct(value);
+    }
+
+    Value::Value(const Type type, HessianArena* arena)
+    : _type(type),
+    _frozen(false),
+    _arena(arena != NULL),
+    _arenaData(arena != NULL),
+    _root(false) {
+        switch (type) {
+            case TYPE_NULL:
+                break;
+            case TYPE_LIST:
+                _list = new (arenaAllocate(arena, sizeof (ListData))) ListData(arena);
+                break;
+            case TYPE_MAP:
+                _map = new (arenaAllocate(arena, sizeof (MapData))) MapData(arena);
+                break;
+            default:
+                _type = TYPE_NULL;
+                throw Exception("Must be a NULL, LIST or MAP");
+        }
+    }
+
+    Value::Value(const bool boolean, HessianArena* arena)
     : _type(Value::TYPE_BOOLEAN),
-    _bool(boolean) {
+    _frozen(false),
+    _arena(arena != NULL),
+    _arenaData(false),
+    _root(false) {
+        _bool = boolean;
     }
 
-    Value::Value(const Int32 integer)
+    Value::Value(const Int32 integer, HessianArena* arena)
     : _type(Value::TYPE_INTEGER),
-    _integer(integer) {
+    _frozen(false),
+    _arena(arena != NULL),
+    _arenaData(false),
+    _root(false) {
+        _integer = integer;
     }
 
-    Value::Value(const double value)
+    Value::Value(const double value, HessianArena* arena)
     : _type(Value::TYPE_DOUBLE),
-    _double(value) {
+    _frozen(false),
+    _arena(arena != NULL),
+    _arenaData(false),
+    _root(false) {
+        _double = value;
     }
 
-    Value::Value(const Int64 value, const Type type)
+    Value::Value(const Int64 value, const Type type, HessianArena* arena)
     : _type(type),
-    _integer(value) {
+    _frozen(false),
+    _arena(arena != NULL),
+    _arenaData(false),
+    _root(false) {
         if (type != TYPE_LONG
                 && type != TYPE_DATE)
             throw Exception("Must be a LONG or DATE");
+        _integer = value;
     }
 
     Value::Value(const Timestamp dateAsTimestamp)
     : _type(Value::TYPE_DATE),
-    _integer(dateAsTimestamp.epochMicroseconds() / 1000) {
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        _integer = dateAsTimestamp.epochMicroseconds() / 1000;
     }
 
     Value::Value(const char* value, const Type type)
-    : _type(type),
-    _string(value) {
-        if (type != TYPE_STRING
-                && type != TYPE_XML
-                && type != TYPE_BINARY
-                && type != TYPE_LIST
-                && type != TYPE_MAP)
-            throw Exception("Must be a STRING, XML, BINARY, LIST or MAP");
-    }
-
-    Value::Value(const std::string& value, const Type type)
-    : _type(type),
-    _string(value) {
-        if (type != TYPE_STRING
-                && type != TYPE_XML
-                && type != TYPE_BINARY
-                && type != TYPE_LIST
-                && type != TYPE_MAP)
-            throw Exception("Must be a STRING, XML, BINARY, LIST or MAP");
+    : _type(TYPE_NULL),
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        checkStringType(type);
+        if (type == TYPE_LIST) {
+            ValuePtr name = nameValue(value);
+            _list = new ListData(NULL);
+            _list->type.swap(name);
+        } else if (type == TYPE_MAP) {
+            ValuePtr name = nameValue(value);
+            _map = new MapData(NULL);
+            _map->type.swap(name);
+        } else {
+            _string = new std::string(value);
+        }
+        _type = type;
+    }
+
+    // the string itself is in the arena, but what does not fit in it still
+    // comes from the heap: std::string is what getString() hands out
+    Value::Value(std::string value, const Type type, HessianArena* arena)
+    : _type(TYPE_NULL),
+    _frozen(false),
+    _arena(arena != NULL),
+    _arenaData(arena != NULL),
+    _root(false) {
+        checkStringType(type);
+        if (type == TYPE_LIST) {
+            ValuePtr name = nameValue(value);
+            _list = new (arenaAllocate(arena, sizeof (ListData))) ListData(arena);
+            _list->type.swap(name);
+        } else if (type == TYPE_MAP) {
+            ValuePtr name = nameValue(value);
+            _map = new (arenaAllocate(arena, sizeof (MapData))) MapData(arena);
+            _map->type.swap(name);
+        } else {
+            _string = new (arenaAllocate(arena, sizeof (std::string))) std::string();
+            _string->swap(value);
+        }
+        _type = type;
+    }
+
+    Value::Value(const ValuePtr& name, const Type type, const Type elementType, HessianArena* arena)
+    : _type(TYPE_NULL),
+    _frozen(false),
+    _arena(arena != NULL),
+    _arenaData(arena != NULL),
+    _root(false) {
+        if (type != TYPE_LIST
+                && type != TYPE_MAP
+                && type != TYPE_ARRAY)
+            throw Exception("Must be a LIST, MAP or ARRAY");
+        checkName(name);
+        if (type == TYPE_LIST) {
+            _list = new (arenaAllocate(arena, sizeof (ListData))) ListData(arena);
+            _list->type = name;
+        } else if (type == TYPE_MAP) {
+            _map = new (arenaAllocate(arena, sizeof (MapData))) MapData(arena);
+            _map->type = name;
+        } else {
+            checkElementType(elementType);
+            _array = new (arenaAllocate(arena, sizeof (ArrayData))) ArrayData(name, elementType, arena);
+        }
+        _type = type;
     }
 
-    Value::Value(const List& list, const char* listType)
+    Value::Value(List list, const char* listType)
     : _type(Value::TYPE_LIST),
-    _string(listType),
-    _list(list) {
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        ValuePtr name = nameValue(listType);
+        _list = new ListData(NULL);
+        _list->type.swap(name);
+        _list->list.swap(list);
     }
 
-    Value::Value(const List& list, const std::string& listType)
+    Value::Value(List list, const std::string& listType)
     : _type(Value::TYPE_LIST),
-    _string(listType),
-    _list(list) {
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        ValuePtr name = nameValue(listType);
+        _list = new ListData(NULL);
+        _list->type.swap(name);
+        _list->list.swap(list);
     }
 
-    Value::Value(const Map& map, const char* mapType)
+    Value::Value(Map map, const char* mapType)
     : _type(Value::TYPE_MAP),
-    _string(mapType),
-    _map(map) {
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        ValuePtr name = nameValue(mapType);
+        _map = new MapData(NULL);
+        _map->type.swap(name);
+        _map->map.swap(map);
     }
 
-    Value::Value(const Map& map, const std::string& mapType)
+    Value::Value(Map map, const std::string& mapType)
     : _type(Value::TYPE_MAP),
-    _string(mapType),
-    _map(map) {
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        ValuePtr name = nameValue(mapType);
+        _map = new MapData(NULL);
+        _map->type.swap(name);
+        _map->map.swap(map);
+    }
+
+    Value::Value(BooleanArray array, const std::string& arrayType)
+    : _type(Value::TYPE_ARRAY),
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        _array = new ArrayData(nameValue(arrayType), TYPE_BOOLEAN, NULL);
+        _array->booleans.swap(array);
+    }
+
+    Value::Value(IntArray array, const std::string& arrayType)
+    : _type(Value::TYPE_ARRAY),
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        _array = new ArrayData(nameValue(arrayType), TYPE_INTEGER, NULL);
+        _array->integers.swap(array);
+    }
+
+    Value::Value(LongArray array, const std::string& arrayType)
+    : _type(Value::TYPE_ARRAY),
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        _array = new ArrayData(nameValue(arrayType), TYPE_LONG, NULL);
+        _array->longs.swap(array);
+    }
+
+    Value::Value(DoubleArray array, const std::string& arrayType)
+    : _type(Value::TYPE_ARRAY),
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        _array = new ArrayData(nameValue(arrayType), TYPE_DOUBLE, NULL);
+        _array->doubles.swap(array);
     }
 
     Value::Value(const char* remoteType, const char* remoteUrl)
     : _type(Value::TYPE_REMOTE),
-    _string(remoteType),
-    _string2(remoteUrl) {
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        std::string type(remoteType);
+        std::string url(remoteUrl);
+        _remote = new RemoteData(type, url);
     }
 
-    Value::Value(const std::string& remoteType, const std::string& remoteUrl)
+    Value::Value(std::string remoteType, std::string remoteUrl, HessianArena* arena)
     : _type(Value::TYPE_REMOTE),
-    _string(remoteType),
-    _string2(remoteUrl) {
+    _frozen(false),
+    _arena(arena != NULL),
+    _arenaData(arena != NULL),
+    _root(false) {
+        _remote = new (arenaAllocate(arena, sizeof (RemoteData))) RemoteData(remoteType, remoteUrl);
     }
 
     Value::Value(const char* faultCode, const char* faultMessage, const ValuePtr& faultDetail)
     : _type(Value::TYPE_FAULT),
-    _string(faultCode),
-    _string2(faultMessage),
-    _value(faultDetail) {
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        std::string message(faultMessage);
+        _fault = new FaultData(nameValue(faultCode), message, faultDetail);
     }
 
-    Value::Value(const std::string& faultCode, const std::string& faultMessage, const ValuePtr& faultDetail)
+    Value::Value(const std::string& faultCode, std::string faultMessage, const ValuePtr& faultDetail)
     : _type(Value::TYPE_FAULT),
-    _string(faultCode),
-    _string2(faultMessage),
-    _value(faultDetail) {
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        _fault = new FaultData(nameValue(faultCode), faultMessage, faultDetail);
+    }
+
+    Value::Value(const ValuePtr& faultCode, std::string faultMessage, const ValuePtr& faultDetail, HessianArena* arena)
+    : _type(Value::TYPE_FAULT),
+    _frozen(false),
+    _arena(arena != NULL),
+    _arenaData(arena != NULL),
+    _root(false) {
+        checkName(faultCode);
+        _fault = new (arenaAllocate(arena, sizeof (FaultData))) FaultData(faultCode, faultMessage, faultDetail);
+    }
+
+#ifdef PoHessian_HAVE_MOVE
+    Value::Value(Value&& value)
+    : RefCounted<>(),
+    _type(TYPE_NULL),
+    _frozen(false),
+    _arena(false),
+    _arenaData(false),
+    _root(false) {
+        if (value._frozen)
+            construct(value);
+        else
+            take(value);
+    }
+#endif
+
+    Value::~Value() {
+        destroy();
+    }
+
+    void* Value::operator new(std::size_t size) {
+        return ::operator new(size);
+    }
+
+    void* Value::operator new(std::size_t size, HessianArena* arena) {
+        if (!arena)
+            return ::operator new(size);
+        return arena->allocateValue();
+    }
+
+    void Value::operator delete(void* ptr) {
+        ::operator delete(ptr);
+    }
+
+    // a constructor threw: the arena destroys every value it handed out,
+    // so this one is left NULL for it
+    void Value::operator delete(void* ptr, HessianArena* arena) {
+        if (!arena)
+            ::operator delete(ptr);
+        else
+            ::new (ptr) Value();
+    }
+
+    // the values of an arena are destroyed with it, which the root holds
+    // a reference to
+    void disposeObject(Value* value) {
+        if (!value->_arena)
+            delete value;
+        else if (value->_root)
+            HessianArena::releaseRoot(value);
+    }
+
+    Value& Value::operator=(const Value& value) {
+        checkMutable();
+        if (this != &value) {
+            Value copy(value);
+            destroy();
+            _type = TYPE_NULL;
+            take(copy);
+        }
+        return *this;
+    }
+
+#ifdef PoHessian_HAVE_MOVE
+    Value& Value::operator=(Value&& value) {
+        checkMutable();
+        if (value._frozen)
+            return *this = static_cast<const Value&>(value);
+        if (this != &value) {
+            destroy();
+            _type = TYPE_NULL;
+            take(value);
+        }
+        return *this;
     }
+#endif
 
     Value::Type Value::getType() const {
         return _type;
     }
 
+    // type names and fault codes need no freezing, they are not reachable
+    // as values; a value already frozen stops the walk, cycles included
+    void Value::freeze() const {
+        if (_frozen)
+            return;
+        share();
+        _frozen = true;
+        switch (_type) {
+            case TYPE_LIST:
+                for (List::const_iterator it = listData().list.begin(); it != listData().list.end(); it++)
+                    if (!!*it)
+                        (*it)->freeze();
+                break;
+            case TYPE_MAP:
+                for (Map::const_iterator it = mapData().map.begin(); it != mapData().map.end(); it++) {
+                    if (!!it->first)
+                        it->first->freeze();
+                    if (!!it->second)
+                        it->second->freeze();
+                }
+                break;
+            case TYPE_FAULT:
+                if (!!_fault->detail)
+                    _fault->detail->freeze();
+                break;
+            default:
+                break;
+        }
+    }
+
+    bool Value::isFrozen() const {
+        return _frozen;
+    }
+
+    static void shareValue(const ValuePtr& value) {
+        if (!!value)
+            value->share();
+    }
+
+    // with an always atomic counter this returns right away
+    void Value::share() const {
+        if (isCountShared())
+            return;
+        shareCount();
+        switch (_type) {
+            case TYPE_LIST:
+                shareValue(listData().type);
+                for (List::const_iterator it = listData().list.begin(); it != listData().list.end(); it++)
+                    shareValue(*it);
+                break;
+            case TYPE_MAP:
+                shareValue(mapData().type);
+                for (Map::const_iterator it = mapData().map.begin(); it != mapData().map.end(); it++) {
+                    shareValue(it->first);
+                    shareValue(it->second);
+                }
+                break;
+            case TYPE_FAULT:
+                shareValue(_fault->code);
+                shareValue(_fault->detail);
+                break;
+            case TYPE_ARRAY:
+                shareValue(_array->type);
+                break;
+            default:
+                break;
+        }
+    }
+
     bool Value::isNull() const {
         return _type == Value::TYPE_NULL;
     }
@@ -215,6 +1382,10 @@ namespace PoHessian {
         return _type == Value::TYPE_FAULT;
     }
 
+    bool Value::isArray() const {
+        return _type == Value::TYPE_ARRAY;
+    }
+
     bool Value::getBoolean() const {
         if (_type != TYPE_BOOLEAN)
             throw Exception("Must be a BOOLEAN");
@@ -254,126 +1425,337 @@ namespace PoHessian {
     const std::string& Value::getString() const {
         if (_type != TYPE_STRING)
             throw Exception("Must be a STRING");
-        return _string;
+        return string();
     }
 
     const std::string& Value::getXml() const {
         if (_type != TYPE_XML)
             throw Exception("Must be a XML");
-        return _string;
+        return string();
     }
 
     const std::string& Value::getBinary() const {
         if (_type != TYPE_BINARY)
             throw Exception("Must be a BINARY");
-        return _string;
+        return string();
     }
 
     const std::string& Value::getListType() const {
         if (_type != TYPE_LIST)
             throw Exception("Must be a LIST");
-        return _string;
+        return nameString(listData().type);
     }
 
     const Value::List& Value::getList() const {
         if (_type != TYPE_LIST)
             throw Exception("Must be a LIST");
-        return _list;
+        return listData().list;
     }
 
     Value::List::size_type Value::getListSize() const {
         if (_type != TYPE_LIST)
             throw Exception("Must be a LIST");
-        return _list.size();
+        return listData().list.size();
     }
 
     const std::string& Value::getMapType() const {
         if (_type != TYPE_MAP)
             throw Exception("Must be a MAP");
-        return _string;
+        return nameString(mapData().type);
     }
 
     const Value::Map& Value::getMap() const {
         if (_type != TYPE_MAP)
             throw Exception("Must be a MAP");
-        return _map;
+        return mapData().map;
     }
 
     Value::Map::size_type Value::getMapSize() const {
         if (_type != TYPE_MAP)
             throw Exception("Must be a MAP");
-        return _map.size();
+        return mapData().map.size();
     }
 
     const std::string& Value::getRemoteType() const {
         if (_type != TYPE_REMOTE)
             throw Exception("Must be a REMOTE");
-        return _string;
+        return _remote->type;
     }
 
     const std::string& Value::getRemoteUrl() const {
         if (_type != TYPE_REMOTE)
             throw Exception("Must be a REMOTE");
-        return _string2;
+        return _remote->url;
     }
 
     const std::string& Value::getFaultCode() const {
         if (_type != TYPE_FAULT)
             throw Exception("Must be a FAULT");
-        return _string;
+        return nameString(_fault->code);
     }
 
     const std::string& Value::getFaultMessage() const {
         if (_type != TYPE_FAULT)
             throw Exception("Must be a FAULT");
-        return _string2;
+        return _fault->message;
     }
 
     const ValuePtr& Value::getFaultDetail() const {
         if (_type != TYPE_FAULT)
             throw Exception("Must be a FAULT");
-        return _value;
+        return _fault->detail;
+    }
+
+    const std::string& Value::getArrayType() const {
+        if (_type != TYPE_ARRAY)
+            throw Exception("Must be an ARRAY");
+        return nameString(_array->type);
+    }
+
+    Value::Type Value::getArrayElementType() const {
+        if (_type != TYPE_ARRAY)
+            throw Exception("Must be an ARRAY");
+        return _array->elementType;
+    }
+
+    std::size_t Value::getArraySize() const {
+        if (_type != TYPE_ARRAY)
+            throw Exception("Must be an ARRAY");
+        switch (_array->elementType) {
+            case TYPE_BOOLEAN:
+                return _array->booleans.size();
+            case TYPE_INTEGER:
+                return _array->integers.size();
+            case TYPE_LONG:
+                return _array->longs.size();
+            default:
+                return _array->doubles.size();
+        }
+    }
+
+    const Value::BooleanArray& Value::getBooleanArray() const {
+        if (_type != TYPE_ARRAY || _array->elementType != TYPE_BOOLEAN)
+            throw Exception("Must be an ARRAY of BOOLEAN");
+        return _array->booleans;
+    }
+
+    const Value::IntArray& Value::getIntArray() const {
+        if (_type != TYPE_ARRAY || _array->elementType != TYPE_INTEGER)
+            throw Exception("Must be an ARRAY of INTEGER");
+        return _array->integers;
+    }
+
+    const Value::LongArray& Value::getLongArray() const {
+        if (_type != TYPE_ARRAY || _array->elementType != TYPE_LONG)
+            throw Exception("Must be an ARRAY of LONG");
+        return _array->longs;
+    }
+
+    const Value::DoubleArray& Value::getDoubleArray() const {
+        if (_type != TYPE_ARRAY || _array->elementType != TYPE_DOUBLE)
+            throw Exception("Must be an ARRAY of DOUBLE");
+        return _array->doubles;
     }
 
     void Value::reserve(const List::size_type n) {
+        checkMutable();
+        if (_type == TYPE_ARRAY) {
+            switch (_array->elementType) {
+                case TYPE_BOOLEAN:
+                    _array->booleans.reserve(n);
+                    break;
+                case TYPE_INTEGER:
+                    _array->integers.reserve(n);
+                    break;
+                case TYPE_LONG:
+                    _array->longs.reserve(n);
+                    break;
+                default:
+                    _array->doubles.reserve(n);
+                    break;
+            }
+            return;
+        }
         if (_type != TYPE_LIST)
-            throw Exception("Must be a LIST");
-        _list.reserve(n);
+            throw Exception("Must be a LIST or ARRAY");
+        listData().list.reserve(n);
     }
 
     void Value::add(const Value::List::value_type& value) {
+        checkMutable();
         if (_type != TYPE_LIST)
             throw Exception("Must be a LIST");
-        _list.push_back(value);
+        listData().list.push_back(value);
     }
 
+#ifdef PoHessian_HAVE_MOVE
+    void Value::add(Value::List::value_type&& value) {
+        checkMutable();
+        if (_type != TYPE_LIST)
+            throw Exception("Must be a LIST");
+        listData().list.push_back(std::move(value));
+    }
+#endif
+
     const Value::List::value_type& Value::atIndex(const Value::List::size_type n) const {
         if (_type != TYPE_LIST)
             throw Exception("Must be a LIST");
-        return _list.at(n);
+        return listData().list.at(n);
+    }
+
+    // replaces a frozen value by a copy that can be changed
+    static ValuePtr thaw(ValuePtr& value) {
+        if (!!value && value->isFrozen())
+            value = new Value(*value);
+        return value;
+    }
+
+    ValuePtr Value::editAtIndex(const Value::List::size_type n) {
+        checkMutable();
+        if (_type != TYPE_LIST)
+            throw Exception("Must be a LIST");
+        return thaw(listData().list.at(n));
+    }
+
+    void Value::addBoolean(const bool element) {
+        checkMutable();
+        if (_type != TYPE_ARRAY || _array->elementType != TYPE_BOOLEAN)
+            throw Exception("Must be an ARRAY of BOOLEAN");
+        _array->booleans.push_back(element);
+    }
+
+    void Value::addInteger(const Int32 element) {
+        checkMutable();
+        if (_type != TYPE_ARRAY || _array->elementType != TYPE_INTEGER)
+            throw Exception("Must be an ARRAY of INTEGER");
+        _array->integers.push_back(element);
+    }
+
+    void Value::addLong(const Int64 element) {
+        checkMutable();
+        if (_type != TYPE_ARRAY || _array->elementType != TYPE_LONG)
+            throw Exception("Must be an ARRAY of LONG");
+        _array->longs.push_back(element);
+    }
+
+    void Value::addDouble(const double element) {
+        checkMutable();
+        if (_type != TYPE_ARRAY || _array->elementType != TYPE_DOUBLE)
+            throw Exception("Must be an ARRAY of DOUBLE");
+        _array->doubles.push_back(element);
+    }
+
+    void Value::addBooleans(const bool* elements, const std::size_t count) {
+        checkMutable();
+        if (_type != TYPE_ARRAY || _array->elementType != TYPE_BOOLEAN)
+            throw Exception("Must be an ARRAY of BOOLEAN");
+        _array->booleans.insert(_array->booleans.end(), elements, elements + count);
+    }
+
+    void Value::addIntegers(const Int32* elements, const std::size_t count) {
+        checkMutable();
+        if (_type != TYPE_ARRAY || _array->elementType != TYPE_INTEGER)
+            throw Exception("Must be an ARRAY of INTEGER");
+        _array->integers.insert(_array->integers.end(), elements, elements + count);
+    }
+
+    void Value::addLongs(const Int64* elements, const std::size_t count) {
+        checkMutable();
+        if (_type != TYPE_ARRAY || _array->elementType != TYPE_LONG)
+            throw Exception("Must be an ARRAY of LONG");
+        _array->longs.insert(_array->longs.end(), elements, elements + count);
+    }
+
+    void Value::addDoubles(const double* elements, const std::size_t count) {
+        checkMutable();
+        if (_type != TYPE_ARRAY || _array->elementType != TYPE_DOUBLE)
+            throw Exception("Must be an ARRAY of DOUBLE");
+        _array->doubles.insert(_array->doubles.end(), elements, elements + count);
     }
 
     std::pair<Value::Map::iterator, bool> Value::put(const Value::Map::key_type& key, const Value::Map::mapped_type& value) {
+        checkMutable();
         if (_type != TYPE_MAP)
             throw Exception("Must be a MAP");
-        return _map.insert(Value::Map::value_type(key, value));
+        return mapData().map.insert(Value::Map::value_type(key, value));
     }
 
-    const Value::Map::mapped_type& Value::atKey(const Value::Map::key_type& key) const {
+#ifdef PoHessian_HAVE_MOVE
+    std::pair<Value::Map::iterator, bool> Value::put(Value::Map::key_type&& key, Value::Map::mapped_type&& value) {
+        checkMutable();
         if (_type != TYPE_MAP)
             throw Exception("Must be a MAP");
-        return _map.find(key)->second;
+        return mapData().map.insert(Value::Map::value_type(std::move(key), std::move(value)));
+    }
+#endif
+
+    static const ValuePtr NULL_VALUE;
+
+    const Value::Map::mapped_type& Value::atKey(const Value::Map::key_type& key) const {
+        return atKey(*key);
     }
 
     const Value::Map::mapped_type& Value::atKey(const Value& key) const {
         if (_type != TYPE_MAP)
             throw Exception("Must be a MAP");
-        ValuePtr ptr = new Value(key);
-        return _map.find(ptr)->second;
+        Map::const_iterator it = mapData().map.find(key);
+        return it == mapData().map.end() ? NULL_VALUE : it->second;
+    }
+
+    const Value::Map::mapped_type& Value::atKey(const std::string& key) const {
+        if (_type != TYPE_MAP)
+            throw Exception("Must be a MAP");
+        Map::const_iterator it = mapData().map.find(key);
+        return it == mapData().map.end() ? NULL_VALUE : it->second;
+    }
+
+    const Value::Map::mapped_type& Value::atKey(const char* key) const {
+        if (_type != TYPE_MAP)
+            throw Exception("Must be a MAP");
+        Map::const_iterator it = mapData().map.find(key);
+        return it == mapData().map.end() ? NULL_VALUE : it->second;
+    }
+
+    const Value::Map::mapped_type& Value::atKey(const bool key) const {
+        return atKey(Value(key));
+    }
+
+    const Value::Map::mapped_type& Value::atKey(const Int32 key) const {
+        return atKey(Value(key));
+    }
+
+    const Value::Map::mapped_type& Value::atKey(const Int64 key) const {
+        return atKey(Value(key));
+    }
+
+    const Value::Map::mapped_type& Value::atKey(const double key) const {
+        return atKey(Value(key));
+    }
+
+    ValuePtr Value::editAtKey(const Value::Map::key_type& key) {
+        checkMutable();
+        if (_type != TYPE_MAP)
+            throw Exception("Must be a MAP");
+        Map::iterator it = mapData().map.find(key);
+        return it == mapData().map.end() ? NULL_VALUE : thaw(it->second);
+    }
+
+    ValuePtr Value::editAtKey(const std::string& key) {
+        checkMutable();
+        if (_type != TYPE_MAP)
+            throw Exception("Must be a MAP");
+        Map& map = mapData().map;
+        Map::const_iterator found = static_cast<const Map&>(map).find(key);
+        if (found == map.end())
+            return NULL_VALUE;
+        Map::iterator it = map.begin() + (found - static_cast<const Map&>(map).begin());
+        return thaw(it->second);
     }
 
     bool Value::operator<(const Value& value) const {
         // TODO: good enough for now
+        if (this == &value)
+            return false;
         if (_type == value._type) {
             switch (_type) {
                 case TYPE_NULL:
@@ -389,20 +1771,44 @@ namespace PoHessian {
                 case TYPE_STRING:
                 case TYPE_XML:
                 case TYPE_BINARY:
-                    return _string < value._string;
+                    return string() < value.string();
                 case TYPE_LIST:
-                    return _list < value._list;
+                    return listData().list < value.listData().list;
                 case TYPE_MAP:
-                    return _map < value._map;
+                    return mapData().map < value.mapData().map;
                 case TYPE_REMOTE:
-                    return _string + _string2 < value._string + value._string2;
+                    return _remote->type + _remote->url < value._remote->type + value._remote->url;
                 case TYPE_FAULT:
-                    return _string + _string2 < value._string + value._string2;
+                    return nameString(_fault->code) + _fault->message < nameString(value._fault->code) + value._fault->message;
+                case TYPE_ARRAY:
+                    if (_array->elementType != value._array->elementType)
+                        return _array->elementType < value._array->elementType;
+                    switch (_array->elementType) {
+                        case TYPE_BOOLEAN:
+                            return _array->booleans < value._array->booleans;
+                        case TYPE_INTEGER:
+                            return _array->integers < value._array->integers;
+                        case TYPE_LONG:
+                            return _array->longs < value._array->longs;
+                        default:
+                            return _array->doubles < value._array->doubles;
+                    }
             }
         }
         return _type < value._type;
     }
 
+    std::size_t Value::hash() const {
+        ValuePath path;
+        return hashValue(*this, path);
+    }
+
+    bool Value::equals(const Value& value) const {
+        ValuePath path1;
+        ValuePath path2;
+        return equalValues(*this, value, path1, path2);
+    }
+
     std::ostream& operator<<(std::ostream& out, const Value* value) {
         // TODO: good enough for now
         switch (value->_type) {
@@ -422,22 +1828,25 @@ namespace PoHessian {
                 break;
             case Value::TYPE_STRING:
             case Value::TYPE_XML:
-                out << value->_string;
+                out << value->string();
                 break;
             case Value::TYPE_BINARY:
-                out << "binary(" << value->_string.size() << ")";
+                out << "binary(" << value->string().size() << ")";
                 break;
             case Value::TYPE_LIST:
-                out << "list(" << value->_string << ")";
+                out << "list(" << nameString(value->listData().type) << ")";
                 break;
             case Value::TYPE_MAP:
-                out << "map(" << value->_string << ")";
+                out << "map(" << nameString(value->mapData().type) << ")";
                 break;
             case Value::TYPE_REMOTE:
-                out << "remote(" << value->_string << ", " << value->_string2 << ")";
+                out << "remote(" << value->_remote->type << ", " << value->_remote->url << ")";
                 break;
             case Value::TYPE_FAULT:
-                out << "fault(" << value->_string << ", " << value->_string2 << ")";
+                out << "fault(" << nameString(value->_fault->code) << ", " << value->_fault->message << ")";
+                break;
+            case Value::TYPE_ARRAY:
+                out << "array(" << nameString(value->_array->type) << ", " << value->getArraySize() << ")";
                 break;
         }
         return out;
@@ -446,9 +1855,10 @@ namespace PoHessian {
     /////////////////
     // Header
 
-    Header::Header(const std::string& name, const ValuePtr& value)
-    : _name(name),
+    Header::Header(std::string name, const ValuePtr& value)
+    : _name(),
     _value(value) {
+        _name.swap(name);
     }
 
     const std::string& Header::getName() const {
@@ -459,27 +1869,43 @@ namespace PoHessian {
         return _value;
     }
 
+    void Header::share() const {
+        shareCount();
+        shareValue(_value);
+    }
+
+    std::size_t Header::hash() const {
+        ValuePath path;
+        return hashCombine(hashString(_name), hashValue(_value, path));
+    }
+
+    bool Header::equals(const Header& header) const {
+        ValuePath path1;
+        ValuePath path2;
+        return _name == header._name && equalValues(_value, header._value, path1, path2);
+    }
+
     /////////////////
     // Call
 
-    Call::Call(const std::string& method)
-    : _method(method) {
+    Call::Call(std::string method) {
+        _method.swap(method);
     }
 
-    Call::Call(const std::string& method, const HeaderList& headers)
-    : _method(method),
-    _headers(headers) {
+    Call::Call(std::string method, HeaderList headers) {
+        _method.swap(method);
+        _headers.swap(headers);
     }
 
-    Call::Call(const std::string& method, const ParameterList& parameters)
-    : _method(method),
-    _parameters(parameters) {
+    Call::Call(std::string method, ParameterList parameters) {
+        _method.swap(method);
+        _parameters.swap(parameters);
     }
 
-    Call::Call(const std::string& method, const HeaderList& headers, const ParameterList& parameters)
-    : _method(method),
-    _headers(headers),
-    _parameters(parameters) {
+    Call::Call(std::string method, HeaderList headers, ParameterList parameters) {
+        _method.swap(method);
+        _headers.swap(headers);
+        _parameters.swap(parameters);
     }
 
     const std::string& Call::getMethod() const {
@@ -494,6 +1920,30 @@ namespace PoHessian {
         return _parameters;
     }
 
+    void Call::share() const {
+        shareCount();
+        for (HeaderList::const_iterator it = _headers.begin(); it != _headers.end(); it++)
+            (*it)->share();
+        for (ParameterList::const_iterator it = _parameters.begin(); it != _parameters.end(); it++)
+            shareValue(*it);
+    }
+
+    std::size_t Call::hash() const {
+        std::size_t hash = hashString(_method);
+        for (HeaderList::const_iterator it = _headers.begin(); it != _headers.end(); it++)
+            hash = hashCombine(hash, (*it)->hash());
+        return hashValues(hash, _parameters);
+    }
+
+    bool Call::equals(const Call& call) const {
+        if (_method != call._method || _headers.size() != call._headers.size())
+            return false;
+        for (HeaderList::size_type i = 0; i < _headers.size(); i++)
+            if (!_headers[i]->equals(*call._headers[i]))
+                return false;
+        return equalValues(_parameters, call._parameters);
+    }
+
     /////////////////
     // Reply
 
@@ -501,9 +1951,34 @@ namespace PoHessian {
     : _value(value) {
     }
 
-    Reply::Reply(const HeaderList& headers, const ValuePtr& value)
-    : _headers(headers),
+    Reply::Reply(HeaderList headers, const ValuePtr& value)
+    : _value(value) {
+        _headers.swap(headers);
+    }
+
+    Reply::Reply(HeaderList headers, const ValuePtr& value, HessianArena* arena)
+    : _arena(arena),
     _value(value) {
+        if (arena)
+            arena->duplicate();
+        _headers.swap(headers);
+    }
+
+    Reply::Reply(const Reply& reply)
+    : RefCounted<>(),
+    _arena(reply._arena),
+    _headers(reply._headers),
+    _value(reply._value) {
+    }
+
+    Reply::~Reply() {
+    }
+
+    Reply& Reply::operator=(const Reply& reply) {
+        _arena = reply._arena;
+        _headers = reply._headers;
+        _value = reply._value;
+        return *this;
     }
 
     const HeaderList& Reply::getHeaders() const {
@@ -514,6 +1989,19 @@ namespace PoHessian {
         return _value;
     }
 
+    HessianArena* Reply::getArena() const {
+        if (!_arena)
+            return NULL;
+        return _arena.deref();
+    }
+
+    void Reply::share() const {
+        shareCount();
+        for (HeaderList::const_iterator it = _headers.begin(); it != _headers.end(); it++)
+            (*it)->share();
+        shareValue(_value);
+    }
+
     /////////////////
     // Reply
 
@@ -0,0 +1,47 @@
+//
+// PoHessian
+// Portable C++ Hessian Implementation
+//
+// Copyright (C) 2012  Pierre-David Belanger
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef callvalue_INCLUDED
+#define callvalue_INCLUDED
+
+#include <string>
+
+#include "pohessian/HessianTypes.h"
+
+namespace PoHessian {
+
+    inline void throwHessianExceptionIfFault(const ValuePtr& value) {
+        if (!value || !value->isFault()) return;
+        throw HessianException(value->getFaultCode(), value->getFaultMessage(), value->getFaultDetail());
+    }
+
+    // Backs the ValuePtr call() overloads every client offers on top of
+    // its own call(const CallPtr&): a fault comes back as a HessianException
+    template <class Client>
+    ValuePtr callValue(Client& client, const std::string& method, const HeaderList& headers, const ParameterList& parameters) {
+        CallPtr call = new Call(method, headers, parameters);
+        ReplyPtr reply = client.call(call);
+        PoHessian::throwHessianExceptionIfFault(reply->getValue());
+        return reply->getValue();
+    }
+
+}
+
+#endif